@@ -0,0 +1,5 @@
+ALTER TABLE analysis_results ADD COLUMN IF NOT EXISTS fingerprint VARCHAR(64);
+
+CREATE INDEX IF NOT EXISTS analysis_results_finished_fingerprint_idx
+    ON analysis_results (fingerprint)
+    WHERE video_status = 'Finished';
@@ -0,0 +1,45 @@
+-- Analysis results are stored one row per frame and per detection, ingested with COPY;
+-- analysis_results.result only keeps the results saved before, as one JSONB value
+CREATE TABLE IF NOT EXISTS frames (
+    video_id VARCHAR(255) NOT NULL REFERENCES analysis_results (id) ON DELETE CASCADE,
+    frame_index INTEGER NOT NULL,
+    file VARCHAR(255) NOT NULL,
+    inherited_from VARCHAR(255),
+    PRIMARY KEY (video_id, frame_index)
+);
+
+CREATE TABLE IF NOT EXISTS detections (
+    video_id VARCHAR(255) NOT NULL,
+    frame_index INTEGER NOT NULL,
+    detection_index INTEGER NOT NULL,
+    class_name VARCHAR(255) NOT NULL,
+    x_min REAL NOT NULL,
+    y_min REAL NOT NULL,
+    x_max REAL NOT NULL,
+    y_max REAL NOT NULL,
+    confidence REAL,
+    PRIMARY KEY (video_id, frame_index, detection_index),
+    FOREIGN KEY (video_id, frame_index) REFERENCES frames (video_id, frame_index) ON DELETE CASCADE
+);
+
+-- The JSON result of a video rebuilt from its rows, in the format of analysis_results.result
+CREATE OR REPLACE VIEW video_results AS
+SELECT f.video_id AS id,
+       jsonb_agg(
+           jsonb_strip_nulls(jsonb_build_object(
+               'file', f.file,
+               'inherited_from', f.inherited_from,
+               'boxes', COALESCE(d.boxes, '[]'::jsonb)))
+           ORDER BY f.frame_index) AS result
+FROM frames f
+LEFT JOIN LATERAL (
+    SELECT jsonb_agg(
+               jsonb_strip_nulls(jsonb_build_object(
+                   'box', jsonb_build_array(x_min, y_min, x_max, y_max),
+                   'class', class_name,
+                   'confidence', confidence))
+               ORDER BY detection_index) AS boxes
+    FROM detections
+    WHERE detections.video_id = f.video_id AND detections.frame_index = f.frame_index
+) d ON TRUE
+GROUP BY f.video_id;
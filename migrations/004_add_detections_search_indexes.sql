@@ -0,0 +1,13 @@
+-- Detections are searched by class, video, time and box area, see utils::db::SearchDetections.
+-- The tree has no capture time of the footage, a detection is timed when its video's result is saved.
+ALTER TABLE detections ADD COLUMN IF NOT EXISTS detected_at TIMESTAMPTZ NOT NULL DEFAULT now();
+ALTER TABLE detections ADD COLUMN IF NOT EXISTS box_area REAL
+    GENERATED ALWAYS AS ((x_max - x_min) * (y_max - y_min)) STORED;
+
+-- Rows are appended in the order they are saved, so a BRIN index stays tiny and selective for time windows
+CREATE INDEX IF NOT EXISTS detections_detected_at_brin_idx
+    ON detections USING BRIN (detected_at);
+
+-- Searches by class are served in the order of the keyset pagination, which follows the primary key
+CREATE INDEX IF NOT EXISTS detections_class_name_video_idx
+    ON detections (class_name, video_id, frame_index, detection_index);
@@ -0,0 +1,12 @@
+-- Detection searches are paginated in time order, on (detected_at, video_id, frame_index, detection_index),
+-- so that the indexes serve both the time window and the order of a page without sorting the window.
+CREATE INDEX IF NOT EXISTS detections_detected_at_key_idx
+    ON detections (detected_at, video_id, frame_index, detection_index);
+
+-- Searches by class read the window of the class only, in the order of the pagination
+CREATE INDEX IF NOT EXISTS detections_class_name_detected_at_key_idx
+    ON detections (class_name, detected_at, video_id, frame_index, detection_index);
+
+-- Superseded by the indexes above
+DROP INDEX IF EXISTS detections_detected_at_brin_idx;
+DROP INDEX IF EXISTS detections_class_name_video_idx;
@@ -1,3 +1,4 @@
 #pragma once
 
+#include "metrics.h"
 #include "yolo.h"
\ No newline at end of file
@@ -0,0 +1,34 @@
+#include "metrics.h"
+
+#include <utility>
+
+namespace handlers {
+
+/**
+ * Binds the metrics handler to the specified Crow application.
+ * GET /metrics returns the counters of the result cache, used to tune its Hamming tolerance and capacity.
+ *
+ * @param app The Crow application to bind the handler to.
+ * @param cache The result cache, nullptr if disabled.
+ */
+void BindMetricsHandler(crow::SimpleApp& app, const inference::ResultCache* cache) {
+    CROW_ROUTE(app, "/metrics").methods(crow::HTTPMethod::GET)
+    ([cache]() {
+        crow::json::wvalue result_cache;
+        result_cache["enabled"] = cache != nullptr;
+        if (cache != nullptr) {
+            const auto stats = cache->GetStats();
+            const auto lookups = stats.hits + stats.misses;
+            result_cache["hits"] = stats.hits;
+            result_cache["misses"] = stats.misses;
+            result_cache["hit_rate"] = lookups > 0 ? static_cast<double>(stats.hits) / lookups : 0.0;
+            result_cache["entries"] = stats.entries;
+        }
+
+        crow::json::wvalue metrics;
+        metrics["result_cache"] = std::move(result_cache);
+        return crow::response(200, metrics);
+    });
+}
+
+} // namespace handlers
@@ -0,0 +1,11 @@
+#pragma once
+
+#include <crow.h>
+
+#include "../inference/result_cache.h"
+
+namespace handlers {
+
+void BindMetricsHandler(crow::SimpleApp& app, const inference::ResultCache* cache);
+
+} // namespace handlers
@@ -1,82 +1,257 @@
 #include "yolo.h"
 
 #include <iostream>
-#include <cstdlib>
-#include <array>
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
 #include <cstdio>
-#include <memory>
-#include <regex>
 #include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <limits>
+#include <sstream>
+#include <thread>
+#include <unordered_map>
+#include <utility>
+#include <vector>
 
 #include "../../../../utils/redis/redis.h"
+#include "../../../../utils/redis/redis_pool.h"
+#include "../../../../utils/redis/redis_stream.h"
+#include "../../../../utils/redis/stage_jobs.h"
 #include "../../../../utils/cfg/global_config.h"
-
-#ifdef _WIN32
-    #define popen _popen
-    #define pclose _pclose
-#endif
+#include "../../../../utils/http/health.h"
 
 namespace handlers {
 
 namespace {
 
+// Written by the pre-processing next to the chunk directories when it skipped unchanged frames
+constexpr const char* kFramesManifest = "manifest.json";
+
 /**
- * Filters the output of a YOLO Python script by extracting the JSON portion.
- * If the JSON portion is not found, an error message is returned.
- * If the output is not enclosed in square brackets, it is wrapped in square brackets.
+ * Lists the frames of a chunk directory in their order.
  *
- * @param output The output string to be filtered.
+ * @param folder_path The path to the chunk directory.
+ * @return The paths to the frames.
  */
-void FilterYoloPyScriptOutput(std::string& output) {
-    std::regex json_regex(R"(\{.*\})", std::regex::extended);
-    std::smatch match;
-    if (std::regex_search(output, match, json_regex, std::regex_constants::match_any)) {
-        output = match.str();
-    } else {
-        output = "{\"Yolo analyze script error\": \"Failed to find JSON in the output\"}";
+std::vector<std::string> ListFrames(const std::string& folder_path) {
+    std::vector<std::string> frames;
+    for (const auto& entry : std::filesystem::directory_iterator(folder_path)) {
+        const auto extension = entry.path().extension();
+        if (entry.is_regular_file() && (extension == ".png" || extension == ".jpg")) {
+            frames.push_back(entry.path().string());
+        }
     }
+    std::sort(frames.begin(), frames.end());
+    return frames;
+}
 
-    if (!output.empty() && output.front() != '[' && output.back() != ']') {
-        output = "[" + output + "]";
+/**
+ * Joins per-frame JSON results into a JSON array.
+ *
+ * @param results The JSON results.
+ * @return The JSON array.
+ */
+std::string JoinResults(const std::vector<std::string>& results) {
+    std::string joined = "[";
+    for (std::size_t i = 0; i < results.size(); ++i) {
+        if (i > 0) {
+            joined += ",";
+        }
+        joined += results[i];
     }
+    joined += "]";
+    return joined;
 }
 
 /**
- * Runs the YOLO script to analyze the frames in the specified folder.
- * 
- * @param folder_path The path to the folder containing the frames.
- * @return A string containing the result of the YOLO script execution.
- * @throws std::runtime_error if the popen() function fails.
+ * Returns the number of a chunk directory named dir_N, directories with other names are sorted last.
+ *
+ * @param path The path to the chunk directory.
+ * @return The number of the chunk.
+ */
+std::size_t GetChunkNumber(const std::string& path) {
+    const std::string name = std::filesystem::path(path).filename().string();
+    const std::string prefix = "dir_";
+    if (name.rfind(prefix, 0) == 0) {
+        try {
+            return std::stoul(name.substr(prefix.size()));
+        } catch (const std::exception&) {
+        }
+    }
+    return std::numeric_limits<std::size_t>::max();
+}
+
+/**
+ * Returns the number of a frame named frame_N.png, frames with other names are sorted last.
  */
-std::string RunYoloScript(const std::string& folder_path) {
-    std::string command = "python3 ../yolo/yolo_analyze.py " + folder_path;
-    std::cout << "Running YOLO script with command: " << command << std::endl;
-    std::array<char, 128> buffer;
-    std::string result;
-    std::shared_ptr<FILE> pipe(popen(command.c_str(), "r"), pclose);
-    if (!pipe) {
-        throw std::runtime_error("popen() failed!");
-    }
-    while (fgets(buffer.data(), buffer.size(), pipe.get()) != nullptr) {
-        result += buffer.data();
-    }
-    return result;
+std::size_t GetFrameNumber(const std::string& path) {
+    const std::string name = std::filesystem::path(path).filename().string();
+    std::size_t number = 0;
+    if (std::sscanf(name.c_str(), "frame_%zu", &number) == 1) {
+        return number;
+    }
+    return std::numeric_limits<std::size_t>::max();
 }
 
 /**
- * Runs the YOLO script in all subdirectories of the specified folder.
+ * Loads the manifest the pre-processing writes next to the chunk directories of a video.
+ *
+ * @param folder_path The path to the frames of the video.
+ * @return The manifest, or an invalid value if the video has none.
+ */
+crow::json::rvalue LoadFramesManifest(const std::string& folder_path) {
+    std::ifstream file(folder_path + "/" + kFramesManifest);
+    if (!file) {
+        return crow::json::rvalue();
+    }
+    std::stringstream buffer;
+    buffer << file.rdbuf();
+    return crow::json::load(buffer.str());
+}
+
+/**
+ * Returns the perceptual hashes of the frames recorded in the manifest, by frame file name.
+ */
+std::unordered_map<std::string, std::uint64_t> GetFrameHashes(const crow::json::rvalue& manifest) {
+    std::unordered_map<std::string, std::uint64_t> hashes;
+    if (!manifest || !manifest.has("hashes") || manifest["hashes"].t() != crow::json::type::Object) {
+        return hashes;
+    }
+    for (const auto& entry : manifest["hashes"]) {
+        try {
+            hashes.emplace(entry.key(), std::stoull(std::string(entry.s()), nullptr, 16));
+        } catch (const std::exception&) {
+        }
+    }
+    return hashes;
+}
+
+/**
+ * Returns a copy of the result of another frame with the file name of the given frame.
+ */
+crow::json::wvalue CopyResult(const std::string& result, const std::string& name) {
+    crow::json::wvalue copy(crow::json::load(result));
+    copy["file"] = name;
+    return copy;
+}
+
+/**
+ * Analyzes the frames of a chunk. A frame whose hash is close to the hash of an already analyzed
+ * frame reuses its result, only the other frames are analyzed and their results cached.
+ *
+ * @param frames The paths to the frames.
+ * @param hashes The perceptual hashes of the frames by file name, frames may have none.
+ * @param backend The inference backend.
+ * @param cache The result cache, nullptr if disabled.
+ * @return One JSON result per frame in the same order, or std::nullopt if the analysis failed.
+ */
+std::optional<std::vector<std::string>> AnalyzeChunk(const std::vector<std::string>& frames,
+                                                     const std::unordered_map<std::string, std::uint64_t>& hashes,
+                                                     inference::Backend& backend,
+                                                     inference::ResultCache* cache) {
+    std::vector<std::string> results(frames.size());
+    std::vector<std::string> missed_frames;
+    std::vector<std::size_t> missed_indices;
+    std::vector<std::optional<std::uint64_t>> missed_hashes;
+    for (std::size_t i = 0; i < frames.size(); ++i) {
+        const std::string name = std::filesystem::path(frames[i]).filename().string();
+        const auto hash_it = cache != nullptr ? hashes.find(name) : hashes.end();
+        if (hash_it != hashes.end()) {
+            if (auto cached = cache->Find(hash_it->second)) {
+                results[i] = CopyResult(*cached, name).dump();
+                continue;
+            }
+        }
+        missed_frames.push_back(frames[i]);
+        missed_indices.push_back(i);
+        missed_hashes.push_back(hash_it != hashes.end() ? std::optional<std::uint64_t>(hash_it->second)
+                                                        : std::nullopt);
+    }
+
+    // Every frame of a chunk may have been skipped as unchanged or found in the cache
+    if (missed_frames.empty()) {
+        return results;
+    }
+    auto analyzed = backend.Analyze(missed_frames);
+    if (!analyzed.has_value() || analyzed->size() != missed_frames.size()) {
+        return std::nullopt;
+    }
+    for (std::size_t i = 0; i < missed_frames.size(); ++i) {
+        if (missed_hashes[i].has_value()) {
+            cache->Insert(*missed_hashes[i], (*analyzed)[i]);
+        }
+        results[missed_indices[i]] = std::move((*analyzed)[i]);
+    }
+    return results;
+}
+
+/**
+ * Adds the results of the frames the pre-processing skipped because they did not change.
+ * A skipped frame gets the detections of the analyzed frame it inherits them from, recorded in the
+ * manifest of the video. The results are then ordered by frame number.
+ *
+ * @param manifest The manifest of the video.
+ * @param frames The paths to the analyzed frames.
+ * @param results The results of the analyzed frames in the same order.
+ * @return True if the results are complete, false if the manifest refers to a frame with no result.
+ */
+bool AddInheritedResults(const crow::json::rvalue& manifest, const std::vector<std::string>& frames,
+                         std::vector<std::string>& results) {
+    if (!manifest || !manifest.has("inherited") || manifest["inherited"].t() != crow::json::type::Object) {
+        return true;
+    }
+
+    std::unordered_map<std::string, std::size_t> analyzed;
+    for (std::size_t i = 0; i < frames.size(); ++i) {
+        analyzed.emplace(std::filesystem::path(frames[i]).filename().string(), i);
+    }
+
+    std::vector<std::pair<std::size_t, std::string>> ordered;
+    ordered.reserve(results.size() + manifest["inherited"].size());
+    for (const auto& entry : manifest["inherited"]) {
+        const std::string name = entry.key();
+        const std::string source = entry.s();
+        const auto source_it = analyzed.find(source);
+        if (source_it == analyzed.end()) {
+            std::cerr << "No result of " << source << " inherited by " << name << std::endl;
+            return false;
+        }
+        auto result = CopyResult(results[source_it->second], name);
+        result["inherited_from"] = source;
+        ordered.emplace_back(GetFrameNumber(name), result.dump());
+    }
+    for (std::size_t i = 0; i < results.size(); ++i) {
+        ordered.emplace_back(GetFrameNumber(frames[i]), std::move(results[i]));
+    }
+    std::stable_sort(ordered.begin(), ordered.end(), [](const auto& a, const auto& b) {
+        return a.first < b.first;
+    });
+
+    results.clear();
+    for (auto& [number, result] : ordered) {
+        results.push_back(std::move(result));
+    }
+    return true;
+}
+
+/**
+ * Analyzes the frames in all subdirectories of the specified folder.
+ * The chunks are analyzed concurrently by at most chunk_concurrency threads, each of which checks the
+ * video status before taking the next chunk, so a stop request cancels the remaining chunks.
  * 
  * @param folder_path The path to the folder containing the subdirectories.
  * @param video_id The ID of the video.
- * @return An optional string containing the merged result of running the YOLO script in all subdirectories,
- *         or std::nullopt if the video status is not YoloStarted or if an error occurs.
+ * @param backend The inference backend.
+ * @param cache The result cache, nullptr if disabled.
+ * @return An optional string containing the JSON array of the results of all frames in chunk order,
+ *         including the frames skipped by the pre-processing, or std::nullopt if the video status is not YoloStarted or if an error occurs.
  */
-std::optional<std::string> RunYoloScriptInSubdirectories(const std::string& folder_path, 
-                                                         const std::string& video_id,
-                                                         redisContext *redis_conn) {
-    std::string merged_result;
-    const std::string command_prefix = "python3 ../yolo/yolo_analyze.py ";
-
+std::optional<std::string> AnalyzeSubdirectories(const std::string& folder_path,
+                                                 const std::string& video_id,
+                                                 inference::Backend& backend,
+                                                 inference::ResultCache* cache) {
     // Get the list of subdirectories in the specified folder
     std::vector<std::string> subdirectories;
     for (const auto& entry : std::filesystem::directory_iterator(folder_path)) {
@@ -84,35 +259,172 @@ std::optional<std::string> RunYoloScriptInSubdirectories(const std::string& fold
             subdirectories.push_back(entry.path().string());
         }
     }
+    std::sort(subdirectories.begin(), subdirectories.end(), [](const std::string& a, const std::string& b) {
+        const auto a_number = GetChunkNumber(a);
+        const auto b_number = GetChunkNumber(b);
+        return a_number != b_number ? a_number < b_number : a < b;
+    });
+
+    const auto& config = cfg::GlobalConfig::getInstance();
+    const std::size_t threads_count = std::max<std::size_t>(1, std::min(config.getInference().chunk_concurrency,
+                                                                        subdirectories.size()));
+
+    const auto manifest = LoadFramesManifest(folder_path);
+    const auto hashes = GetFrameHashes(manifest);
+
+    std::vector<std::vector<std::string>> chunk_frames(subdirectories.size());
+    std::vector<std::optional<std::vector<std::string>>> chunk_results(subdirectories.size());
+    std::atomic<std::size_t> next_chunk{0};
+    std::atomic<bool> failed{false};
+
+    const auto analyze_chunks = [&]() {
+        while (!failed) {
+            const std::size_t chunk = next_chunk++;
+            if (chunk >= subdirectories.size()) {
+                break;
+            }
+
+            // Check video status before analyzing the chunk, the connection is not held during inference
+            const auto status_opt = [&video_id]() {
+                auto redis_conn = redis::RedisPool::getInstance().acquire();
+                return redis_utils::RedisGetRequestVideoStatus(redis_conn.get(), video_id);
+            }();
+            if (!status_opt.has_value() || status_opt.value() != requests::VideoStatus::YoloStarted) {
+                failed = true;
+                break;
+            }
 
-    // Iterate over each subdirectory and run the YOLO script
-    for (const auto& subdirectory : subdirectories) {
-        // Check video status before running YOLO script
-        const auto status_opt = redis_utils::RedisGetRequestVideoStatus(redis_conn, video_id);
-        if (!status_opt.has_value() || status_opt.value() != requests::VideoStatus::YoloStarted) {
-            return std::nullopt;
+            std::cout << "Analyzing frames in " << subdirectories[chunk] << std::endl;
+            try {
+                chunk_frames[chunk] = ListFrames(subdirectories[chunk]);
+                chunk_results[chunk] = AnalyzeChunk(chunk_frames[chunk], hashes, backend, cache);
+            } catch (const std::exception& e) {
+                std::cerr << "Exception while analyzing frames: " << e.what() << std::endl;
+            }
+            if (!chunk_results[chunk].has_value()) {
+                std::cerr << "Failed to analyze frames in " << subdirectories[chunk] << std::endl;
+                failed = true;
+            }
         }
+    };
 
-        const std::string result = RunYoloScript(subdirectory);
+    std::vector<std::thread> threads;
+    threads.reserve(threads_count - 1);
+    for (std::size_t i = 1; i < threads_count; ++i) {
+        threads.emplace_back(analyze_chunks);
+    }
+    analyze_chunks();
+    for (auto& thread : threads) {
+        thread.join();
+    }
 
-        // Merge the result with the previous results
-        merged_result += result;
+    if (failed) {
+        return std::nullopt;
+    }
+
+    // Merge the results in chunk order
+    std::vector<std::string> frames;
+    std::vector<std::string> results;
+    for (std::size_t chunk = 0; chunk < subdirectories.size(); ++chunk) {
+        frames.insert(frames.end(), chunk_frames[chunk].begin(), chunk_frames[chunk].end());
+        results.insert(results.end(), std::make_move_iterator(chunk_results[chunk]->begin()),
+                       std::make_move_iterator(chunk_results[chunk]->end()));
+    }
+    if (!AddInheritedResults(manifest, frames, results)) {
+        return std::nullopt;
     }
 
-    return merged_result;
+    return JoinResults(results);
 }
 
 } // namespace
 
+/**
+ * Analyzes the frames of a video using the YOLO algorithm and saves the result to Redis.
+ *
+ * @param body The job body with the redis_id of the video and the frames_path to analyze.
+ * @param backend The inference backend running the model.
+ * @param cache The result cache, nullptr if disabled.
+ * @return The response with the analysis result, or describing the error.
+ */
+crow::response AnalyzeFrames(const crow::json::rvalue& body, inference::Backend& backend,
+                             inference::ResultCache* cache) {
+    utils::http::InFlightGuard in_flight;
+    const std::string redis_id = body["redis_id"].s();
+    const std::string frames_path = body["frames_path"].s();
+    std::cout << "Parsed request body: redis_id=" << redis_id << ", frames_path=" << frames_path << std::endl;
+
+    {
+        auto redis_conn = redis::RedisPool::getInstance().acquire();
+        if (!redis_conn) {
+            std::cerr << "Redis connection error" << std::endl;
+            return crow::response(500, "Redis connection error");
+        }
+        const auto transition = redis_utils::RedisUpdateVideoStatus(redis_conn.get(), redis_id,
+                                                                    requests::VideoStatus::YoloStarted);
+        if (transition.result == redis_utils::StatusTransition::Result::Rejected && transition.previous.has_value() &&
+            requests::IsVideoPastStatus(transition.previous.value(), requests::VideoStatus::YoloStarted)) {
+            std::cout << "Video " << redis_id << " has already been analyzed, skipping the job" << std::endl;
+            return crow::response(requests::kStageSkippedCode);
+        }
+        if (transition.result == redis_utils::StatusTransition::Result::Rejected) {
+            const std::string status = transition.previous.has_value()
+                ? requests::VideoStatusToString(transition.previous.value()) : "unknown";
+            return crow::response(400, "Pipe broken by video status = " + status);
+        }
+    }
+
+    // The chunk threads check connections out of the same pool, none is held while the frames are analyzed
+    const auto update_status = [&redis_id](const requests::VideoStatus status) {
+        auto redis_conn = redis::RedisPool::getInstance().acquire();
+        redis_utils::RedisUpdateVideoStatus(redis_conn.get(), redis_id, status);
+    };
+
+    try {
+        auto result_str_opt = AnalyzeSubdirectories(frames_path, redis_id, backend, cache);
+        if (!result_str_opt.has_value()) {
+            std::cerr << "Failed to analyze frames" << std::endl;
+            update_status(requests::VideoStatus::Failed);
+            return crow::response(500, "Failed to analyze frames");
+        }
+
+        const auto& result_str = result_str_opt.value();
+
+        const auto result_json = crow::json::load(result_str);
+        if (!result_json) {
+            std::cerr << "Failed to parse YOLO result. Yolo response str: " << result_str << std::endl;
+            update_status(requests::VideoStatus::Failed);
+            return crow::response(500, "Failed to parse YOLO result. Yolo response str: " + result_str);
+        }
+
+        std::cout << "Finished YOLO analysis" << std::endl;
+
+        // Save YOLO result to redis
+        {
+            auto redis_conn = redis::RedisPool::getInstance().acquire();
+            redis_utils::RedisSaveYoloResponse(redis_conn.get(), redis_id, result_json);
+            redis_utils::RedisUpdateVideoStatus(redis_conn.get(), redis_id, requests::VideoStatus::YoloFinished);
+        }
+
+        return crow::response(200, result_str);
+    } catch (const std::exception& e) {
+        std::cerr << "Exception in YOLO handler: " << e.what() << std::endl;
+        return crow::response(500, e.what());
+    }
+}
+
 /**
  * Binds the YOLO handler to the specified Crow application.
- * The YOLO handler analyzes frames using the YOLO algorithm and saves the result to Redis.
+ * With the queue dispatch mode the handler only adds the job to the frame analytics stream,
+ * otherwise it analyzes the frames before answering.
  * 
  * @param app The Crow application to bind the handler to.
+ * @param backend The inference backend running the model.
+ * @param cache The result cache, nullptr if disabled.
  */
-void BindYoloHandler(crow::SimpleApp& app) {
+void BindYoloHandler(crow::SimpleApp& app, inference::Backend& backend, inference::ResultCache* cache) {
     CROW_ROUTE(app, "/yolo_analyze_frames").methods(crow::HTTPMethod::POST)
-    ([](const crow::request& req) {
+    ([&backend, cache](const crow::request& req) {
         std::cout << "Received request for /yolo_analyze_frames" << std::endl;
         auto body = crow::json::load(req.body);
         if (!body) {
@@ -120,53 +432,11 @@ void BindYoloHandler(crow::SimpleApp& app) {
             return crow::response(400, "Invalid JSON");
         }
 
-        const std::string redis_id = body["redis_id"].s();
-        const std::string frames_path = body["frames_path"].s();
-        std::cout << "Parsed request body: redis_id=" << redis_id << ", frames_path=" << frames_path << std::endl;
-
-        const auto& config = cfg::GlobalConfig::getInstance();
-        const auto& redis = config.getRedis();
-        redisContext *redis_conn = redis_utils::RedisConnect(redis.host, redis.port);
-        if (redis_conn == nullptr) {
-            std::cerr << "Redis connection error" << std::endl;
-            redis_utils::RedisUpdateVideoStatus(redis_conn, redis_id, requests::VideoStatus::Failed);
-            return crow::response(500, "Redis connection error");
-        }
-        std::cout << "Connected to Redis" << std::endl;
-        redis_utils::RedisUpdateVideoStatus(redis_conn, redis_id, requests::VideoStatus::YoloStarted);
-
-        try {
-            auto result_str_opt = RunYoloScriptInSubdirectories(frames_path, redis_id, redis_conn);
-            if (!result_str_opt.has_value()) {
-                std::cerr << "Failed to run YOLO script" << std::endl;
-                redis_utils::RedisUpdateVideoStatus(redis_conn, redis_id, requests::VideoStatus::Failed);
-                redisFree(redis_conn);
-                return crow::response(500, "Failed to run YOLO script");
-            }
-
-            auto& result_str = result_str_opt.value();
-            FilterYoloPyScriptOutput(result_str);
-
-            const auto result_json = crow::json::load(result_str);
-            if (!result_json) {
-                std::cerr << "Failed to parse YOLO result. Yolo response str: " << result_str << std::endl;
-                redis_utils::RedisUpdateVideoStatus(redis_conn, redis_id, requests::VideoStatus::Failed);
-                redisFree(redis_conn);
-                return crow::response(500, "Failed to parse YOLO result. Yolo response str: " + result_str);
-            }
-
-            std::cout << "Finished YOLO analysis" << std::endl;
-
-            // Save YOLO result to redis
-            redis_utils::RedisSaveYoloResponse(redis_conn, redis_id, result_json);
-            redis_utils::RedisUpdateVideoStatus(redis_conn, redis_id, requests::VideoStatus::YoloFinished);
-            redisFree(redis_conn);
-
-            return crow::response(200, result_str);
-        } catch (const std::exception& e) {
-            std::cerr << "Exception in YOLO handler: " << e.what() << std::endl;
-            return crow::response(500, e.what());
+        const auto& queue = cfg::GlobalConfig::getInstance().getQueue();
+        if (queue.dispatch == cfg::GlobalConfig::DispatchMode::Queue) {
+            return redis_utils::EnqueueStageJob(redis_utils::kFrameAnalyticsStream, req.body);
         }
+        return AnalyzeFrames(body, backend, cache);
     });
 }
 
@@ -2,8 +2,14 @@
 
 #include <crow.h>
 
+#include "../inference/backend.h"
+#include "../inference/result_cache.h"
+
 namespace handlers {
 
-void BindYoloHandler(crow::SimpleApp& app);
+crow::response AnalyzeFrames(const crow::json::rvalue& body, inference::Backend& backend,
+                             inference::ResultCache* cache);
+
+void BindYoloHandler(crow::SimpleApp& app, inference::Backend& backend, inference::ResultCache* cache);
 
 } // namespace handlers
@@ -0,0 +1,28 @@
+#pragma once
+
+#include <optional>
+#include <string>
+#include <vector>
+
+namespace inference {
+
+/**
+ * @brief Runs the object detection model on frames.
+ *
+ * A result is a JSON object {"file": <file name>, "boxes": [{"box": [x_min, y_min, x_max, y_max],
+ * "class": <label>}, ...]}. Implementations must be safe to call from several threads at once.
+ */
+class Backend {
+public:
+    virtual ~Backend() = default;
+
+    /**
+     * @brief Analyzes the images.
+     *
+     * @param image_paths The paths to the images to analyze.
+     * @return One JSON result per image in the same order, or std::nullopt if the analysis failed.
+     */
+    virtual std::optional<std::vector<std::string>> Analyze(const std::vector<std::string>& image_paths) = 0;
+};
+
+} // namespace inference
@@ -0,0 +1,177 @@
+#include "batch_scheduler.h"
+
+#include <algorithm>
+#include <iostream>
+#include <utility>
+
+namespace inference {
+
+BatchScheduler::BatchScheduler(std::unique_ptr<Backend> backend, Options options)
+    : backend_(std::move(backend)), options_(options) {
+    options_.batch_size = std::max<std::size_t>(1, options_.batch_size);
+    options_.dispatchers = std::max<std::size_t>(1, options_.dispatchers);
+}
+
+BatchScheduler::~BatchScheduler() {
+    Stop();
+}
+
+void BatchScheduler::Start() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (!dispatchers_.empty()) {
+        return;
+    }
+    stopped_ = false;
+    for (std::size_t i = 0; i < options_.dispatchers; ++i) {
+        dispatchers_.emplace_back([this] {
+            RunDispatcher();
+        });
+    }
+}
+
+/**
+ * Stops the dispatchers once their current batches are done. Frames still queued are failed.
+ */
+void BatchScheduler::Stop() {
+    std::vector<std::thread> dispatchers;
+    std::vector<Frame> pending;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stopped_ = true;
+        dispatchers.swap(dispatchers_);
+        pending.assign(std::make_move_iterator(queue_.begin()), std::make_move_iterator(queue_.end()));
+        queue_.clear();
+    }
+    queue_cv_.notify_all();
+    for (auto& dispatcher : dispatchers) {
+        dispatcher.join();
+    }
+    if (!pending.empty()) {
+        CompleteBatch(pending, std::nullopt);
+    }
+}
+
+/**
+ * Queues the frames and waits until all of them have been analyzed as parts of batches.
+ *
+ * @param image_paths The paths to the images to analyze.
+ * @return One JSON result per image in the same order, or std::nullopt if any batch of the frames failed.
+ */
+std::optional<std::vector<std::string>> BatchScheduler::Analyze(const std::vector<std::string>& image_paths) {
+    if (image_paths.empty()) {
+        return std::vector<std::string>{};
+    }
+
+    auto call = std::make_shared<Call>();
+    call->results.resize(image_paths.size());
+    call->remaining = image_paths.size();
+    auto result = call->promise.get_future();
+
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (stopped_) {
+            return std::nullopt;
+        }
+        const auto now = std::chrono::steady_clock::now();
+        for (std::size_t i = 0; i < image_paths.size(); ++i) {
+            queue_.push_back(Frame{call, i, image_paths[i], now});
+        }
+    }
+    queue_cv_.notify_all();
+
+    return result.get();
+}
+
+void BatchScheduler::RunDispatcher() {
+    while (true) {
+        auto batch = TakeBatch();
+        if (batch.empty()) {
+            return;
+        }
+
+        std::vector<std::string> paths;
+        paths.reserve(batch.size());
+        for (const auto& frame : batch) {
+            paths.push_back(frame.path);
+        }
+
+        std::optional<std::vector<std::string>> results;
+        try {
+            results = backend_->Analyze(paths);
+        } catch (const std::exception& e) {
+            std::cerr << "Exception while analyzing a batch: " << e.what() << std::endl;
+        }
+        CompleteBatch(batch, std::move(results));
+    }
+}
+
+/**
+ * Waits for the next batch: either batch_size frames or the frames queued once the oldest of them
+ * has waited max_wait.
+ *
+ * @return The frames of the batch, empty once the scheduler has been stopped.
+ */
+std::vector<BatchScheduler::Frame> BatchScheduler::TakeBatch() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    queue_cv_.wait(lock, [this] {
+        return stopped_ || !queue_.empty();
+    });
+
+    while (!stopped_ && !queue_.empty() && queue_.size() < options_.batch_size) {
+        const auto deadline = queue_.front().queued_at + options_.max_wait;
+        if (queue_cv_.wait_until(lock, deadline) == std::cv_status::timeout) {
+            break;
+        }
+    }
+    if (stopped_) {
+        return {};
+    }
+
+    const std::size_t batch_size = std::min(options_.batch_size, queue_.size());
+    std::vector<Frame> batch(std::make_move_iterator(queue_.begin()),
+                             std::make_move_iterator(queue_.begin() + batch_size));
+    queue_.erase(queue_.begin(), queue_.begin() + batch_size);
+
+    // Another dispatcher can start collecting the next batch right away
+    if (!queue_.empty()) {
+        queue_cv_.notify_one();
+    }
+    return batch;
+}
+
+/**
+ * Hands the results of a batch over to the calls the frames belong to, and completes every call whose
+ * frames are all done.
+ *
+ * @param batch The frames of the batch.
+ * @param results The results of the batch in frame order, or std::nullopt if the batch failed.
+ */
+void BatchScheduler::CompleteBatch(std::vector<Frame>& batch, std::optional<std::vector<std::string>> results) {
+    const bool failed = !results.has_value() || results->size() != batch.size();
+
+    std::vector<std::shared_ptr<Call>> completed;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        for (std::size_t i = 0; i < batch.size(); ++i) {
+            auto& call = batch[i].call;
+            if (failed) {
+                call->failed = true;
+            } else {
+                call->results[batch[i].index] = std::move((*results)[i]);
+            }
+            if (--call->remaining == 0) {
+                completed.push_back(call);
+            }
+        }
+    }
+
+    for (auto& call : completed) {
+        if (call->failed) {
+            call->promise.set_value(std::nullopt);
+        } else {
+            call->promise.set_value(std::move(call->results));
+        }
+    }
+}
+
+} // namespace inference
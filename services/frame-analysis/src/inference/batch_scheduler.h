@@ -0,0 +1,77 @@
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "backend.h"
+
+namespace inference {
+
+/**
+ * @brief Collects the frames of all concurrent analysis requests into batches for an inner backend.
+ *
+ * Every Analyze() call queues its frames and waits for their results. Dispatcher threads take up to
+ * batch_size frames from the queue, regardless of which video they belong to, and analyze them in one
+ * call of the inner backend. A batch that is not full is dispatched once its oldest frame has waited
+ * max_wait, which bounds the latency a video pays for being batched. The results are routed back to
+ * the calls that queued the frames.
+ */
+class BatchScheduler : public Backend {
+public:
+    struct Options {
+        std::size_t batch_size = 16;
+        std::chrono::milliseconds max_wait{20};
+        // Batches analyzed at the same time, should match the parallelism of the inner backend
+        std::size_t dispatchers = 1;
+    };
+
+    BatchScheduler(std::unique_ptr<Backend> backend, Options options);
+    ~BatchScheduler() override;
+
+    BatchScheduler(const BatchScheduler&) = delete;
+    BatchScheduler& operator=(const BatchScheduler&) = delete;
+
+    void Start();
+    void Stop();
+
+    std::optional<std::vector<std::string>> Analyze(const std::vector<std::string>& image_paths) override;
+
+private:
+    struct Call {
+        std::vector<std::string> results;
+        std::size_t remaining;
+        bool failed = false;
+        std::promise<std::optional<std::vector<std::string>>> promise;
+    };
+
+    struct Frame {
+        std::shared_ptr<Call> call;
+        std::size_t index;
+        std::string path;
+        std::chrono::steady_clock::time_point queued_at;
+    };
+
+    void RunDispatcher();
+    std::vector<Frame> TakeBatch();
+    void CompleteBatch(std::vector<Frame>& batch, std::optional<std::vector<std::string>> results);
+
+    std::unique_ptr<Backend> backend_;
+    Options options_;
+
+    std::mutex mutex_;
+    std::condition_variable queue_cv_;
+    std::deque<Frame> queue_;
+    bool stopped_ = false;
+    std::vector<std::thread> dispatchers_;
+};
+
+} // namespace inference
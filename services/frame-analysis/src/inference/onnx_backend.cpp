@@ -0,0 +1,337 @@
+#ifdef WITH_ONNXRUNTIME
+
+#include "onnx_backend.h"
+
+#include <algorithm>
+#include <array>
+#include <cctype>
+#include <cmath>
+#include <filesystem>
+#include <iostream>
+#include <utility>
+
+#include <crow/json.h>
+
+#define STB_IMAGE_IMPLEMENTATION
+#include <stb_image.h>
+
+namespace inference {
+
+namespace {
+
+// Padding color of the letterbox, the same as ultralytics uses
+constexpr float kPadValue = 114.0f / 255.0f;
+
+/**
+ * Parses the class labels stored by ultralytics in the model metadata,
+ * a Python dict literal like "{0: 'person', 1: 'bicycle'}".
+ *
+ * @param names The value of the "names" metadata.
+ * @return The labels indexed by class ID.
+ */
+std::vector<std::string> ParseClassNames(const std::string& names) {
+    std::vector<std::string> class_names;
+    std::size_t pos = 0;
+    while (pos < names.size()) {
+        while (pos < names.size() && !std::isdigit(static_cast<unsigned char>(names[pos]))) {
+            ++pos;
+        }
+        if (pos >= names.size()) {
+            break;
+        }
+        std::size_t class_id = 0;
+        while (pos < names.size() && std::isdigit(static_cast<unsigned char>(names[pos]))) {
+            class_id = class_id * 10 + static_cast<std::size_t>(names[pos] - '0');
+            ++pos;
+        }
+
+        const std::size_t quote_pos = names.find_first_of("'\"", pos);
+        if (quote_pos == std::string::npos) {
+            break;
+        }
+        const std::size_t end_pos = names.find(names[quote_pos], quote_pos + 1);
+        if (end_pos == std::string::npos) {
+            break;
+        }
+
+        if (class_names.size() <= class_id) {
+            class_names.resize(class_id + 1);
+        }
+        class_names[class_id] = names.substr(quote_pos + 1, end_pos - quote_pos - 1);
+        pos = end_pos + 1;
+    }
+    return class_names;
+}
+
+float IntersectionOverUnion(const float* a, const float* b) {
+    const float x_min = std::max(a[0], b[0]);
+    const float y_min = std::max(a[1], b[1]);
+    const float x_max = std::min(a[2], b[2]);
+    const float y_max = std::min(a[3], b[3]);
+    const float intersection = std::max(0.0f, x_max - x_min) * std::max(0.0f, y_max - y_min);
+    const float area_a = (a[2] - a[0]) * (a[3] - a[1]);
+    const float area_b = (b[2] - b[0]) * (b[3] - b[1]);
+    const float union_area = area_a + area_b - intersection;
+    return union_area > 0.0f ? intersection / union_area : 0.0f;
+}
+
+} // namespace
+
+OnnxBackend::OnnxBackend(Options options)
+    : options_(std::move(options)), env_(ORT_LOGGING_LEVEL_WARNING, "frame-analysis") {}
+
+bool OnnxBackend::Load() {
+    try {
+        Ort::SessionOptions session_options;
+        session_options.SetGraphOptimizationLevel(GraphOptimizationLevel::ORT_ENABLE_ALL);
+        if (options_.threads > 0) {
+            session_options.SetIntraOpNumThreads(static_cast<int>(options_.threads));
+        }
+
+#ifdef _WIN32
+        const std::wstring model_path = std::filesystem::path(options_.model_path).wstring();
+        session_ = std::make_unique<Ort::Session>(env_, model_path.c_str(), session_options);
+#else
+        session_ = std::make_unique<Ort::Session>(env_, options_.model_path.c_str(), session_options);
+#endif
+
+        Ort::AllocatorWithDefaultOptions allocator;
+        input_name_ = session_->GetInputNameAllocated(0, allocator).get();
+        output_name_ = session_->GetOutputNameAllocated(0, allocator).get();
+
+        // Models exported with a dynamic input size use the default 640x640
+        const auto input_shape = session_->GetInputTypeInfo(0).GetTensorTypeAndShapeInfo().GetShape();
+        if (input_shape.size() == 4 && input_shape[2] > 0 && input_shape[3] > 0) {
+            input_height_ = input_shape[2];
+            input_width_ = input_shape[3];
+        }
+
+        auto metadata = session_->GetModelMetadata();
+        const auto names = metadata.LookupCustomMetadataMapAllocated("names", allocator);
+        if (names) {
+            class_names_ = ParseClassNames(names.get());
+        }
+    } catch (const Ort::Exception& e) {
+        std::cerr << "Failed to load ONNX model " << options_.model_path << ": " << e.what() << std::endl;
+        session_.reset();
+        return false;
+    }
+
+    std::cout << "Loaded ONNX model " << options_.model_path << " with input " << input_width_ << "x"
+              << input_height_ << " and " << class_names_.size() << " classes" << std::endl;
+    return true;
+}
+
+/**
+ * Analyzes the images one after another. The session runs every image on its own thread pool,
+ * and concurrent calls are safe because ONNX Runtime sessions may be run from several threads.
+ *
+ * @param image_paths The paths to the images to analyze.
+ * @return One JSON result per image in the same order, or std::nullopt if the analysis failed.
+ */
+std::optional<std::vector<std::string>> OnnxBackend::Analyze(const std::vector<std::string>& image_paths) {
+    if (!session_) {
+        std::cerr << "ONNX model is not loaded" << std::endl;
+        return std::nullopt;
+    }
+
+    std::vector<std::string> results;
+    results.reserve(image_paths.size());
+    for (const auto& path : image_paths) {
+        auto image = LoadImage(path);
+        if (!image.has_value()) {
+            // Like the Python worker, an unreadable frame has no detections rather than failing the video
+            results.push_back(ToJson(path, {}));
+            continue;
+        }
+
+        const auto detections = Detect(image.value());
+        if (!detections.has_value()) {
+            return std::nullopt;
+        }
+        results.push_back(ToJson(path, detections.value()));
+    }
+    return results;
+}
+
+/**
+ * Decodes an image and letterboxes it into the normalized RGB CHW tensor the model expects.
+ *
+ * @param path The path to the image.
+ * @return The letterboxed image, or std::nullopt if the image could not be decoded.
+ */
+std::optional<OnnxBackend::LetterboxedImage> OnnxBackend::LoadImage(const std::string& path) const {
+    int width = 0;
+    int height = 0;
+    int channels = 0;
+    std::unique_ptr<unsigned char, decltype(&stbi_image_free)> pixels(
+        stbi_load(path.c_str(), &width, &height, &channels, 3), stbi_image_free);
+    if (!pixels || width <= 0 || height <= 0) {
+        std::cerr << "Failed to decode image " << path << std::endl;
+        return std::nullopt;
+    }
+
+    const int target_width = static_cast<int>(input_width_);
+    const int target_height = static_cast<int>(input_height_);
+    const float scale = std::min(static_cast<float>(target_width) / width, static_cast<float>(target_height) / height);
+    const int resized_width = std::max(1, static_cast<int>(std::round(width * scale)));
+    const int resized_height = std::max(1, static_cast<int>(std::round(height * scale)));
+    const int pad_x = (target_width - resized_width) / 2;
+    const int pad_y = (target_height - resized_height) / 2;
+
+    LetterboxedImage image;
+    image.width = width;
+    image.height = height;
+    image.scale = scale;
+    image.pad_x = static_cast<float>(pad_x);
+    image.pad_y = static_cast<float>(pad_y);
+    const std::size_t plane_size = static_cast<std::size_t>(target_width) * target_height;
+    image.tensor.assign(plane_size * 3, kPadValue);
+
+    // Bilinear resize straight into the planes of the tensor
+    const float x_ratio = static_cast<float>(width) / resized_width;
+    const float y_ratio = static_cast<float>(height) / resized_height;
+    const unsigned char* src = pixels.get();
+    for (int y = 0; y < resized_height; ++y) {
+        const float src_y = std::clamp((y + 0.5f) * y_ratio - 0.5f, 0.0f, static_cast<float>(height - 1));
+        const int y0 = static_cast<int>(src_y);
+        const int y1 = std::min(y0 + 1, height - 1);
+        const float wy = src_y - y0;
+
+        for (int x = 0; x < resized_width; ++x) {
+            const float src_x = std::clamp((x + 0.5f) * x_ratio - 0.5f, 0.0f, static_cast<float>(width - 1));
+            const int x0 = static_cast<int>(src_x);
+            const int x1 = std::min(x0 + 1, width - 1);
+            const float wx = src_x - x0;
+
+            const std::size_t dst = static_cast<std::size_t>(y + pad_y) * target_width + (x + pad_x);
+            for (int c = 0; c < 3; ++c) {
+                const float top = src[(y0 * width + x0) * 3 + c] * (1.0f - wx) + src[(y0 * width + x1) * 3 + c] * wx;
+                const float bottom = src[(y1 * width + x0) * 3 + c] * (1.0f - wx) + src[(y1 * width + x1) * 3 + c] * wx;
+                image.tensor[c * plane_size + dst] = (top * (1.0f - wy) + bottom * wy) / 255.0f;
+            }
+        }
+    }
+
+    return image;
+}
+
+/**
+ * Runs the model on a letterboxed image and decodes its predictions.
+ *
+ * The output of a YOLOv8 detection model is [1, 4 + classes, anchors]: the box center, width and height
+ * in input pixels followed by the score of every class.
+ *
+ * @param image The letterboxed image.
+ * @return The detections in the coordinates of the original image, or std::nullopt if the model failed.
+ */
+std::optional<std::vector<OnnxBackend::Detection>> OnnxBackend::Detect(LetterboxedImage& image) {
+    std::vector<Detection> candidates;
+    try {
+        const std::array<std::int64_t, 4> input_shape{1, 3, input_height_, input_width_};
+        const auto memory_info = Ort::MemoryInfo::CreateCpu(OrtArenaAllocator, OrtMemTypeDefault);
+        Ort::Value input = Ort::Value::CreateTensor<float>(memory_info, image.tensor.data(), image.tensor.size(),
+                                                           input_shape.data(), input_shape.size());
+
+        const char* input_names[] = {input_name_.c_str()};
+        const char* output_names[] = {output_name_.c_str()};
+        auto outputs = session_->Run(Ort::RunOptions{nullptr}, input_names, &input, 1, output_names, 1);
+
+        const auto output_shape = outputs[0].GetTensorTypeAndShapeInfo().GetShape();
+        if (output_shape.size() != 3 || output_shape[1] <= 4) {
+            std::cerr << "Unexpected output shape of the ONNX model" << std::endl;
+            return std::nullopt;
+        }
+        const auto channels = static_cast<std::size_t>(output_shape[1]);
+        const auto anchors = static_cast<std::size_t>(output_shape[2]);
+        const float* data = outputs[0].GetTensorData<float>();
+
+        for (std::size_t i = 0; i < anchors; ++i) {
+            std::size_t best_class = 0;
+            float best_score = 0.0f;
+            for (std::size_t c = 4; c < channels; ++c) {
+                const float score = data[c * anchors + i];
+                if (score > best_score) {
+                    best_score = score;
+                    best_class = c - 4;
+                }
+            }
+            if (best_score < options_.confidence_threshold) {
+                continue;
+            }
+
+            const float center_x = data[i];
+            const float center_y = data[anchors + i];
+            const float half_width = data[2 * anchors + i] / 2.0f;
+            const float half_height = data[3 * anchors + i] / 2.0f;
+            const auto to_image_x = [&image](const float x) {
+                return std::clamp((x - image.pad_x) / image.scale, 0.0f, static_cast<float>(image.width));
+            };
+            const auto to_image_y = [&image](const float y) {
+                return std::clamp((y - image.pad_y) / image.scale, 0.0f, static_cast<float>(image.height));
+            };
+            candidates.push_back(Detection{to_image_x(center_x - half_width), to_image_y(center_y - half_height),
+                                           to_image_x(center_x + half_width), to_image_y(center_y + half_height),
+                                           best_score, best_class});
+        }
+    } catch (const Ort::Exception& e) {
+        std::cerr << "ONNX Runtime error: " << e.what() << std::endl;
+        return std::nullopt;
+    }
+
+    // Per-class non-maximum suppression
+    std::sort(candidates.begin(), candidates.end(), [](const Detection& a, const Detection& b) {
+        return a.confidence > b.confidence;
+    });
+    std::vector<Detection> detections;
+    for (const auto& candidate : candidates) {
+        if (detections.size() >= options_.max_detections) {
+            break;
+        }
+        const float candidate_box[4] = {candidate.x_min, candidate.y_min, candidate.x_max, candidate.y_max};
+        const bool suppressed = std::any_of(detections.begin(), detections.end(),
+            [this, &candidate, &candidate_box](const Detection& kept) {
+                const float kept_box[4] = {kept.x_min, kept.y_min, kept.x_max, kept.y_max};
+                return kept.class_id == candidate.class_id &&
+                       IntersectionOverUnion(kept_box, candidate_box) > options_.iou_threshold;
+            });
+        if (!suppressed) {
+            detections.push_back(candidate);
+        }
+    }
+    return detections;
+}
+
+/**
+ * Builds the JSON result of a frame, in the same format as the Python worker.
+ *
+ * @param path The path to the frame.
+ * @param detections The detections of the frame.
+ * @return The JSON result.
+ */
+std::string OnnxBackend::ToJson(const std::string& path, const std::vector<Detection>& detections) const {
+    std::vector<crow::json::wvalue> boxes;
+    boxes.reserve(detections.size());
+    for (const auto& detection : detections) {
+        crow::json::wvalue box;
+        box["box"] = std::vector<double>{detection.x_min, detection.y_min, detection.x_max, detection.y_max};
+        box["class"] = GetClassName(detection.class_id);
+        boxes.push_back(std::move(box));
+    }
+
+    crow::json::wvalue result;
+    result["file"] = std::filesystem::path(path).filename().string();
+    result["boxes"] = std::move(boxes);
+    return result.dump();
+}
+
+std::string OnnxBackend::GetClassName(const std::size_t class_id) const {
+    if (class_id < class_names_.size() && !class_names_[class_id].empty()) {
+        return class_names_[class_id];
+    }
+    return std::to_string(class_id);
+}
+
+} // namespace inference
+
+#endif // WITH_ONNXRUNTIME
@@ -0,0 +1,85 @@
+#pragma once
+
+#ifdef WITH_ONNXRUNTIME
+
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <string>
+#include <vector>
+
+#include <onnxruntime_cxx_api.h>
+
+#include "backend.h"
+
+namespace inference {
+
+/**
+ * @brief Runs an exported YOLOv8 ONNX model in-process with ONNX Runtime on the CPU.
+ *
+ * Frames are letterboxed to the model's input size, and the raw predictions are filtered by confidence
+ * and per-class non-maximum suppression, as ultralytics does with its default settings. The class labels
+ * are read from the "names" metadata that ultralytics stores in the exported model.
+ */
+class OnnxBackend : public Backend {
+public:
+    struct Options {
+        std::string model_path;
+        // Threads used to run one frame, 0 lets ONNX Runtime decide
+        std::size_t threads = 0;
+        float confidence_threshold = 0.25f;
+        float iou_threshold = 0.7f;
+        std::size_t max_detections = 300;
+    };
+
+    explicit OnnxBackend(Options options);
+
+    OnnxBackend(const OnnxBackend&) = delete;
+    OnnxBackend& operator=(const OnnxBackend&) = delete;
+
+    /**
+     * @brief Loads the model.
+     *
+     * @return True if the model has been loaded, false otherwise.
+     */
+    bool Load();
+
+    std::optional<std::vector<std::string>> Analyze(const std::vector<std::string>& image_paths) override;
+
+private:
+    struct Detection {
+        float x_min;
+        float y_min;
+        float x_max;
+        float y_max;
+        float confidence;
+        std::size_t class_id;
+    };
+
+    struct LetterboxedImage {
+        std::vector<float> tensor;
+        int width;
+        int height;
+        float scale;
+        float pad_x;
+        float pad_y;
+    };
+
+    std::optional<LetterboxedImage> LoadImage(const std::string& path) const;
+    std::optional<std::vector<Detection>> Detect(LetterboxedImage& image);
+    std::string ToJson(const std::string& path, const std::vector<Detection>& detections) const;
+    std::string GetClassName(std::size_t class_id) const;
+
+    Options options_;
+    Ort::Env env_;
+    std::unique_ptr<Ort::Session> session_;
+    std::string input_name_;
+    std::string output_name_;
+    std::int64_t input_width_ = 640;
+    std::int64_t input_height_ = 640;
+    std::vector<std::string> class_names_;
+};
+
+} // namespace inference
+
+#endif // WITH_ONNXRUNTIME
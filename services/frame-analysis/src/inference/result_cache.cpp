@@ -0,0 +1,112 @@
+#include "result_cache.h"
+
+#include <algorithm>
+#include <bitset>
+#include <limits>
+#include <utility>
+
+namespace inference {
+
+namespace {
+
+constexpr std::size_t kHashBits = 64;
+
+std::size_t GetDistance(const std::uint64_t a, const std::uint64_t b) {
+    return std::bitset<kHashBits>(a ^ b).count();
+}
+
+} // namespace
+
+ResultCache::ResultCache(Options options)
+    : options_(options),
+      blocks_count_(std::min(options.max_distance + 1, kHashBits)),
+      blocks_(blocks_count_) {
+}
+
+/**
+ * Returns the bits of a block of the hash, the blocks split the 64 bits as evenly as possible.
+ */
+std::uint64_t ResultCache::GetBlockKey(const std::size_t block, const std::uint64_t hash) const {
+    const std::size_t begin = block * kHashBits / blocks_count_;
+    const std::size_t end = (block + 1) * kHashBits / blocks_count_;
+    const std::size_t width = end - begin;
+    const std::uint64_t mask = width >= kHashBits ? std::numeric_limits<std::uint64_t>::max()
+                                                  : (std::uint64_t{1} << width) - 1;
+    return (hash >> begin) & mask;
+}
+
+std::optional<std::string> ResultCache::Find(const std::uint64_t hash) {
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    auto best = entries_.find(hash);
+    if (best == entries_.end() && options_.max_distance > 0) {
+        std::size_t best_distance = options_.max_distance + 1;
+        for (std::size_t block = 0; block < blocks_count_ && best_distance > 1; ++block) {
+            const auto candidates = blocks_[block].equal_range(GetBlockKey(block, hash));
+            for (auto it = candidates.first; it != candidates.second; ++it) {
+                const std::size_t distance = GetDistance(hash, it->second);
+                if (distance < best_distance) {
+                    best_distance = distance;
+                    best = entries_.find(it->second);
+                }
+            }
+        }
+    }
+
+    if (best == entries_.end()) {
+        ++misses_;
+        return std::nullopt;
+    }
+    ++hits_;
+    lru_.splice(lru_.begin(), lru_, best->second.lru_position);
+    return best->second.result;
+}
+
+void ResultCache::Insert(const std::uint64_t hash, std::string result) {
+    if (options_.capacity == 0) {
+        return;
+    }
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    auto existing = entries_.find(hash);
+    if (existing != entries_.end()) {
+        existing->second.result = std::move(result);
+        lru_.splice(lru_.begin(), lru_, existing->second.lru_position);
+        return;
+    }
+
+    while (entries_.size() >= options_.capacity) {
+        Evict(lru_.back());
+    }
+    lru_.push_front(hash);
+    entries_.emplace(hash, Entry{std::move(result), lru_.begin()});
+    for (std::size_t block = 0; block < blocks_count_; ++block) {
+        blocks_[block].emplace(GetBlockKey(block, hash), hash);
+    }
+}
+
+void ResultCache::Evict(const std::uint64_t hash) {
+    for (std::size_t block = 0; block < blocks_count_; ++block) {
+        auto candidates = blocks_[block].equal_range(GetBlockKey(block, hash));
+        for (auto it = candidates.first; it != candidates.second; ++it) {
+            if (it->second == hash) {
+                blocks_[block].erase(it);
+                break;
+            }
+        }
+    }
+    auto entry = entries_.find(hash);
+    lru_.erase(entry->second.lru_position);
+    entries_.erase(entry);
+}
+
+ResultCache::Stats ResultCache::GetStats() const {
+    Stats stats;
+    stats.hits = hits_;
+    stats.misses = misses_;
+    std::lock_guard<std::mutex> lock(mutex_);
+    stats.entries = entries_.size();
+    return stats;
+}
+
+} // namespace inference
@@ -0,0 +1,77 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <list>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace inference {
+
+/**
+ * @brief Cache of inference results keyed by the perceptual hash of the frame.
+ *
+ * Frames of the same camera are often near-identical across videos and days, so a frame whose hash
+ * is within max_distance bits of a cached hash reuses the cached result instead of being analyzed.
+ * The hashes are split into max_distance + 1 blocks each indexed by its value: two hashes within
+ * max_distance bits of each other share at least one block, so a lookup only compares the hashes
+ * sharing a block with it. The least recently used results are evicted above capacity.
+ *
+ * The cache is thread-safe.
+ */
+class ResultCache {
+public:
+    struct Options {
+        std::size_t capacity = 100000;
+        // Maximum Hamming distance between the 64-bit hashes of a frame and of a cached frame
+        std::size_t max_distance = 4;
+    };
+
+    struct Stats {
+        std::uint64_t hits = 0;
+        std::uint64_t misses = 0;
+        std::size_t entries = 0;
+    };
+
+    explicit ResultCache(Options options);
+
+    ResultCache(const ResultCache&) = delete;
+    ResultCache& operator=(const ResultCache&) = delete;
+
+    /**
+     * @brief Returns the result of the closest cached hash within max_distance, counting a hit or a miss.
+     */
+    std::optional<std::string> Find(std::uint64_t hash);
+
+    void Insert(std::uint64_t hash, std::string result);
+
+    Stats GetStats() const;
+
+private:
+    struct Entry {
+        std::string result;
+        std::list<std::uint64_t>::iterator lru_position;
+    };
+
+    std::uint64_t GetBlockKey(std::size_t block, std::uint64_t hash) const;
+    void Evict(std::uint64_t hash);
+
+    Options options_;
+    std::size_t blocks_count_;
+
+    mutable std::mutex mutex_;
+    std::unordered_map<std::uint64_t, Entry> entries_;
+    // Most recently used first
+    std::list<std::uint64_t> lru_;
+    // One index per block, from the value of the block to the hashes having it
+    std::vector<std::unordered_multimap<std::uint64_t, std::uint64_t>> blocks_;
+
+    std::atomic<std::uint64_t> hits_{0};
+    std::atomic<std::uint64_t> misses_{0};
+};
+
+} // namespace inference
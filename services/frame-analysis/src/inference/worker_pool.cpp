@@ -0,0 +1,199 @@
+#include "worker_pool.h"
+
+#include <iostream>
+#include <utility>
+
+#include <crow/json.h>
+
+namespace inference {
+
+WorkerPool::WorkerPool(Options options) : options_(std::move(options)) {}
+
+WorkerPool::~WorkerPool() {
+    Stop();
+}
+
+bool WorkerPool::Start() {
+    std::size_t ready_count = 0;
+    for (std::size_t i = 0; i < options_.workers; ++i) {
+        auto worker = std::make_unique<Worker>();
+        worker->index = i;
+        if (StartWorker(*worker)) {
+            ++ready_count;
+        }
+        // Workers that failed to start are restarted when they are first used
+        std::lock_guard<std::mutex> lock(mutex_);
+        idle_.push_back(std::move(worker));
+    }
+    idle_cv_.notify_all();
+
+    std::cout << "Started " << ready_count << " of " << options_.workers << " inference workers" << std::endl;
+    return ready_count > 0;
+}
+
+/**
+ * Stops all the workers. Requests in flight keep their workers until they complete,
+ * the workers are killed when they are given back.
+ */
+void WorkerPool::Stop() {
+    std::vector<std::unique_ptr<Worker>> idle;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stopped_ = true;
+        idle.swap(idle_);
+    }
+    idle_cv_.notify_all();
+    for (auto& worker : idle) {
+        worker->process.Kill();
+    }
+}
+
+/**
+ * Analyzes the images on an idle worker, restarting the worker if it crashed.
+ *
+ * @param image_paths The paths to the images to analyze.
+ * @return One JSON result per image in the same order, or std::nullopt if the analysis failed.
+ */
+std::optional<std::vector<std::string>> WorkerPool::Analyze(const std::vector<std::string>& image_paths) {
+    if (image_paths.empty()) {
+        return std::vector<std::string>{};
+    }
+
+    crow::json::wvalue request;
+    request["images"] = image_paths;
+    const std::string request_str = request.dump();
+
+    auto worker = AcquireWorker();
+    if (!worker) {
+        return std::nullopt;
+    }
+
+    bool timed_out = false;
+    auto response_str = Exchange(*worker, request_str, timed_out);
+    if (!response_str.has_value() && !timed_out) {
+        // The worker died or broke the protocol, retry once on its restarted process
+        std::cerr << "Inference worker " << worker->index << " failed, restarting it" << std::endl;
+        worker->process.Kill();
+        worker->ready = false;
+        response_str = Exchange(*worker, request_str, timed_out);
+    }
+    if (timed_out) {
+        // Its response may still arrive and would be taken for the response to the next request
+        std::cerr << "Inference worker " << worker->index << " timed out, restarting it" << std::endl;
+        worker->process.Kill();
+        worker->ready = false;
+    }
+    ReleaseWorker(std::move(worker));
+
+    if (!response_str.has_value()) {
+        return std::nullopt;
+    }
+
+    const auto response = crow::json::load(response_str.value());
+    if (!response) {
+        std::cerr << "Invalid response of inference worker: " << response_str.value() << std::endl;
+        return std::nullopt;
+    }
+    if (response.has("error")) {
+        std::cerr << "Inference worker error: " << response["error"].s() << std::endl;
+        return std::nullopt;
+    }
+    if (!response.has("results") || response["results"].t() != crow::json::type::List ||
+        response["results"].size() != image_paths.size()) {
+        std::cerr << "Inference worker returned an unexpected number of results" << std::endl;
+        return std::nullopt;
+    }
+
+    std::vector<std::string> results;
+    results.reserve(image_paths.size());
+    for (const auto& result : response["results"]) {
+        results.push_back(crow::json::wvalue(result).dump());
+    }
+    return results;
+}
+
+std::unique_ptr<WorkerPool::Worker> WorkerPool::AcquireWorker() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    idle_cv_.wait(lock, [this] {
+        return stopped_ || !idle_.empty();
+    });
+    if (stopped_) {
+        return nullptr;
+    }
+    auto worker = std::move(idle_.back());
+    idle_.pop_back();
+    return worker;
+}
+
+void WorkerPool::ReleaseWorker(std::unique_ptr<Worker> worker) {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (!stopped_) {
+            idle_.push_back(std::move(worker));
+        }
+    }
+    idle_cv_.notify_one();
+    // A worker given back after Stop() is killed by its destructor here
+}
+
+/**
+ * Starts the process of a worker and waits for its ready frame, sent once the model has been loaded.
+ *
+ * @param worker The worker to start.
+ * @return True if the worker is ready to serve requests, false otherwise.
+ */
+bool WorkerPool::StartWorker(Worker& worker) {
+    worker.ready = false;
+    if (!worker.process.Spawn(options_.command)) {
+        std::cerr << "Failed to start inference worker " << worker.index << std::endl;
+        return false;
+    }
+
+    std::string frame;
+    const auto deadline = std::chrono::steady_clock::now() + options_.startup_timeout;
+    const auto result = worker.process.ReadFrame(frame, deadline);
+    if (result != WorkerProcess::ReadResult::Ok) {
+        std::cerr << "Inference worker " << worker.index
+                  << (result == WorkerProcess::ReadResult::TimedOut ? " did not start in time" : " exited during startup")
+                  << std::endl;
+        worker.process.Kill();
+        return false;
+    }
+    const auto hello = crow::json::load(frame);
+    if (!hello || !hello.has("ready")) {
+        std::cerr << "Inference worker " << worker.index << " failed to start: " << frame << std::endl;
+        worker.process.Kill();
+        return false;
+    }
+
+    worker.ready = true;
+    return true;
+}
+
+/**
+ * Sends a request to a worker and reads its response, starting the worker first if needed.
+ *
+ * @param worker The worker.
+ * @param request The request frame.
+ * @param timed_out Set to true if the worker did not answer before the request timeout.
+ * @return The response frame, or std::nullopt if the worker could not be started, died or timed out.
+ */
+std::optional<std::string> WorkerPool::Exchange(Worker& worker, const std::string& request, bool& timed_out) {
+    timed_out = false;
+    if ((!worker.ready || !worker.process.IsRunning()) && !StartWorker(worker)) {
+        return std::nullopt;
+    }
+
+    if (!worker.process.WriteFrame(request)) {
+        return std::nullopt;
+    }
+    std::string response;
+    const auto result = worker.process.ReadFrame(response, std::chrono::steady_clock::now() + options_.request_timeout);
+    if (result != WorkerProcess::ReadResult::Ok) {
+        timed_out = result == WorkerProcess::ReadResult::TimedOut;
+        return std::nullopt;
+    }
+    return response;
+}
+
+} // namespace inference
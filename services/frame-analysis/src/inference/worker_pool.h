@@ -0,0 +1,75 @@
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <vector>
+
+#include "backend.h"
+#include "worker_process.h"
+
+namespace inference {
+
+/**
+ * @brief Pool of long-lived Python inference workers.
+ *
+ * Every worker is a yolo_worker.py process that loads the model once and then serves requests over
+ * its stdin and stdout with length-prefixed JSON frames. A request is sent to the first idle worker;
+ * a worker that crashed or broke the protocol is restarted and the request retried once. A worker that
+ * does not answer before the request timeout is killed and restarted when it is next used, the request
+ * is not retried since it would most likely hang again.
+ */
+class WorkerPool : public Backend {
+public:
+    struct Options {
+        std::size_t workers = 2;
+        // The command starting a worker, e.g. {"python3", "../yolo/yolo_worker.py"}
+        std::vector<std::string> command;
+        // Time a worker has to load the model and send its ready frame
+        std::chrono::milliseconds startup_timeout{120000};
+        // Time a worker has to answer one request
+        std::chrono::milliseconds request_timeout{60000};
+    };
+
+    explicit WorkerPool(Options options);
+    ~WorkerPool() override;
+
+    WorkerPool(const WorkerPool&) = delete;
+    WorkerPool& operator=(const WorkerPool&) = delete;
+
+    /**
+     * @brief Starts all the workers and waits until they have loaded the model.
+     *
+     * @return True if at least one worker is ready, false otherwise.
+     */
+    bool Start();
+    void Stop();
+
+    std::optional<std::vector<std::string>> Analyze(const std::vector<std::string>& image_paths) override;
+
+private:
+    struct Worker {
+        std::size_t index;
+        WorkerProcess process;
+        bool ready = false;
+    };
+
+    std::unique_ptr<Worker> AcquireWorker();
+    void ReleaseWorker(std::unique_ptr<Worker> worker);
+
+    bool StartWorker(Worker& worker);
+    std::optional<std::string> Exchange(Worker& worker, const std::string& request, bool& timed_out);
+
+    Options options_;
+
+    std::mutex mutex_;
+    std::condition_variable idle_cv_;
+    std::vector<std::unique_ptr<Worker>> idle_;
+    bool stopped_ = false;
+};
+
+} // namespace inference
@@ -0,0 +1,341 @@
+#include "worker_process.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <iostream>
+#include <mutex>
+
+#ifndef _WIN32
+    #include <cerrno>
+    #include <csignal>
+    #include <fcntl.h>
+    #include <poll.h>
+    #include <sys/wait.h>
+    #include <unistd.h>
+#endif
+
+namespace inference {
+
+WorkerProcess::~WorkerProcess() {
+    Kill();
+}
+
+/**
+ * Writes one frame to the stdin of the process.
+ *
+ * @param payload The payload of the frame.
+ * @return True if the whole frame has been written, false otherwise.
+ */
+bool WorkerProcess::WriteFrame(const std::string& payload) {
+    if (payload.size() > kMaxFrameSize) {
+        std::cerr << "Worker frame of " << payload.size() << " bytes is too large" << std::endl;
+        return false;
+    }
+    const auto size = static_cast<std::uint32_t>(payload.size());
+    const char header[4] = {
+        static_cast<char>((size >> 24) & 0xFF),
+        static_cast<char>((size >> 16) & 0xFF),
+        static_cast<char>((size >> 8) & 0xFF),
+        static_cast<char>(size & 0xFF)
+    };
+    return WriteAll(header, sizeof(header)) && WriteAll(payload.data(), payload.size());
+}
+
+/**
+ * Reads one frame from the stdout of the process, blocking until it is complete or the deadline has passed.
+ *
+ * @param payload Receives the payload of the frame.
+ * @param deadline The time by which the whole frame must have been read.
+ * @return Ok if a whole frame has been read, Failed if the process closed its stdout or the frame is invalid,
+ *         TimedOut if the deadline has passed first.
+ */
+WorkerProcess::ReadResult WorkerProcess::ReadFrame(std::string& payload, const Deadline deadline) {
+    unsigned char header[4];
+    const ReadResult header_result = ReadAll(reinterpret_cast<char*>(header), sizeof(header), deadline);
+    if (header_result != ReadResult::Ok) {
+        return header_result;
+    }
+    const std::uint32_t size = (static_cast<std::uint32_t>(header[0]) << 24) |
+                               (static_cast<std::uint32_t>(header[1]) << 16) |
+                               (static_cast<std::uint32_t>(header[2]) << 8) |
+                               static_cast<std::uint32_t>(header[3]);
+    if (size > kMaxFrameSize) {
+        std::cerr << "Worker frame of " << size << " bytes is too large" << std::endl;
+        return ReadResult::Failed;
+    }
+    payload.resize(size);
+    return size == 0 ? ReadResult::Ok : ReadAll(payload.data(), size, deadline);
+}
+
+#ifdef _WIN32
+
+bool WorkerProcess::Spawn(const std::vector<std::string>& args) {
+    Kill();
+
+    SECURITY_ATTRIBUTES attributes{};
+    attributes.nLength = sizeof(attributes);
+    attributes.bInheritHandle = TRUE;
+
+    HANDLE child_stdin = nullptr;
+    HANDLE child_stdout = nullptr;
+    if (!CreatePipe(&child_stdin, &stdin_, &attributes, 0)) {
+        return false;
+    }
+    if (!CreatePipe(&stdout_, &child_stdout, &attributes, 0)) {
+        CloseHandle(child_stdin);
+        CloseHandle(stdin_);
+        stdin_ = nullptr;
+        return false;
+    }
+    // Only the child's ends of the pipes are inherited
+    SetHandleInformation(stdin_, HANDLE_FLAG_INHERIT, 0);
+    SetHandleInformation(stdout_, HANDLE_FLAG_INHERIT, 0);
+
+    std::string command_line;
+    for (const auto& arg : args) {
+        if (!command_line.empty()) {
+            command_line += ' ';
+        }
+        command_line += "\"" + arg + "\"";
+    }
+
+    STARTUPINFOA startup_info{};
+    startup_info.cb = sizeof(startup_info);
+    startup_info.dwFlags = STARTF_USESTDHANDLES;
+    startup_info.hStdInput = child_stdin;
+    startup_info.hStdOutput = child_stdout;
+    startup_info.hStdError = GetStdHandle(STD_ERROR_HANDLE);
+
+    PROCESS_INFORMATION process_info{};
+    const BOOL created = CreateProcessA(nullptr, command_line.data(), nullptr, nullptr, TRUE, 0,
+                                        nullptr, nullptr, &startup_info, &process_info);
+    CloseHandle(child_stdin);
+    CloseHandle(child_stdout);
+    if (!created) {
+        std::cerr << "Failed to start worker: " << command_line << std::endl;
+        Kill();
+        return false;
+    }
+
+    CloseHandle(process_info.hThread);
+    process_ = process_info.hProcess;
+    return true;
+}
+
+bool WorkerProcess::IsRunning() {
+    return process_ != nullptr && WaitForSingleObject(process_, 0) == WAIT_TIMEOUT;
+}
+
+void WorkerProcess::Kill() {
+    if (stdin_ != nullptr) {
+        CloseHandle(stdin_);
+        stdin_ = nullptr;
+    }
+    if (stdout_ != nullptr) {
+        CloseHandle(stdout_);
+        stdout_ = nullptr;
+    }
+    if (process_ != nullptr) {
+        if (WaitForSingleObject(process_, 0) == WAIT_TIMEOUT) {
+            TerminateProcess(process_, 1);
+            WaitForSingleObject(process_, INFINITE);
+        }
+        CloseHandle(process_);
+        process_ = nullptr;
+    }
+}
+
+bool WorkerProcess::WriteAll(const char* data, std::size_t size) {
+    while (size > 0) {
+        DWORD written = 0;
+        if (!WriteFile(stdin_, data, static_cast<DWORD>(size), &written, nullptr)) {
+            return false;
+        }
+        data += written;
+        size -= written;
+    }
+    return true;
+}
+
+/**
+ * Anonymous pipes do not support overlapped reads, so the pipe is peeked and only read once data is
+ * available. In between, the wait on the process handle returns early if the process exits.
+ */
+WorkerProcess::ReadResult WorkerProcess::ReadAll(char* data, std::size_t size, const Deadline deadline) {
+    while (size > 0) {
+        DWORD available = 0;
+        if (!PeekNamedPipe(stdout_, nullptr, 0, nullptr, &available, nullptr)) {
+            return ReadResult::Failed;
+        }
+        if (available == 0) {
+            const auto now = std::chrono::steady_clock::now();
+            if (now >= deadline) {
+                return ReadResult::TimedOut;
+            }
+            const auto remaining = std::chrono::duration_cast<std::chrono::milliseconds>(deadline - now).count();
+            // The process may have written its last bytes before exiting, the pipe is peeked once more
+            WaitForSingleObject(process_, static_cast<DWORD>(std::min<long long>(remaining, 10)));
+            continue;
+        }
+
+        DWORD read = 0;
+        const auto to_read = static_cast<DWORD>(std::min<std::size_t>(size, available));
+        if (!ReadFile(stdout_, data, to_read, &read, nullptr) || read == 0) {
+            return ReadResult::Failed;
+        }
+        data += read;
+        size -= read;
+    }
+    return ReadResult::Ok;
+}
+
+#else
+
+bool WorkerProcess::Spawn(const std::vector<std::string>& args) {
+    Kill();
+    if (args.empty()) {
+        return false;
+    }
+
+    // A worker dying while a request is written to it must not kill the whole service
+    std::signal(SIGPIPE, SIG_IGN);
+
+    // Everything the child needs is prepared before fork(), the child only calls async-signal-safe functions
+    std::vector<char*> argv;
+    argv.reserve(args.size() + 1);
+    for (const auto& arg : args) {
+        argv.push_back(const_cast<char*>(arg.c_str()));
+    }
+    argv.push_back(nullptr);
+
+    // Serializes pipe() and fork() so that no other worker can inherit the pipes of this one
+    static std::mutex spawn_mutex;
+    std::lock_guard<std::mutex> lock(spawn_mutex);
+
+    int to_child[2];
+    int from_child[2];
+    if (pipe(to_child) != 0) {
+        return false;
+    }
+    if (pipe(from_child) != 0) {
+        close(to_child[0]);
+        close(to_child[1]);
+        return false;
+    }
+    // No end of the pipes may leak into other workers, dup2() clears the flag on the child's stdin and stdout
+    for (const int fd : {to_child[0], to_child[1], from_child[0], from_child[1]}) {
+        fcntl(fd, F_SETFD, FD_CLOEXEC);
+    }
+
+    const pid_t pid = fork();
+    if (pid < 0) {
+        close(to_child[0]);
+        close(to_child[1]);
+        close(from_child[0]);
+        close(from_child[1]);
+        return false;
+    }
+
+    if (pid == 0) {
+        dup2(to_child[0], STDIN_FILENO);
+        dup2(from_child[1], STDOUT_FILENO);
+        execvp(argv[0], argv.data());
+        _exit(127);
+    }
+
+    close(to_child[0]);
+    close(from_child[1]);
+    pid_ = pid;
+    stdin_fd_ = to_child[1];
+    stdout_fd_ = from_child[0];
+    return true;
+}
+
+bool WorkerProcess::IsRunning() {
+    if (pid_ <= 0) {
+        return false;
+    }
+    int status = 0;
+    const pid_t result = waitpid(pid_, &status, WNOHANG);
+    if (result == 0) {
+        return true;
+    }
+    // The process has exited and been reaped, it must not be waited for again
+    pid_ = -1;
+    return false;
+}
+
+void WorkerProcess::Kill() {
+    if (stdin_fd_ >= 0) {
+        close(stdin_fd_);
+        stdin_fd_ = -1;
+    }
+    if (stdout_fd_ >= 0) {
+        close(stdout_fd_);
+        stdout_fd_ = -1;
+    }
+    if (pid_ > 0) {
+        kill(pid_, SIGKILL);
+        int status = 0;
+        while (waitpid(pid_, &status, 0) < 0 && errno == EINTR) {
+        }
+        pid_ = -1;
+    }
+}
+
+bool WorkerProcess::WriteAll(const char* data, std::size_t size) {
+    while (size > 0) {
+        const ssize_t written = write(stdin_fd_, data, size);
+        if (written < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return false;
+        }
+        data += written;
+        size -= static_cast<std::size_t>(written);
+    }
+    return true;
+}
+
+WorkerProcess::ReadResult WorkerProcess::ReadAll(char* data, std::size_t size, const Deadline deadline) {
+    while (size > 0) {
+        const auto now = std::chrono::steady_clock::now();
+        if (now >= deadline) {
+            return ReadResult::TimedOut;
+        }
+        // Rounded up so that the deadline has passed when poll() times out
+        const auto remaining = std::chrono::ceil<std::chrono::milliseconds>(deadline - now).count();
+
+        pollfd poll_fd{stdout_fd_, POLLIN, 0};
+        const int ready = poll(&poll_fd, 1, static_cast<int>(std::min<long long>(remaining, INT32_MAX)));
+        if (ready < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return ReadResult::Failed;
+        }
+        if (ready == 0) {
+            continue;
+        }
+
+        // POLLHUP without data is reported as end of file by read()
+        const ssize_t read_count = read(stdout_fd_, data, size);
+        if (read_count < 0) {
+            if (errno == EINTR || errno == EAGAIN) {
+                continue;
+            }
+            return ReadResult::Failed;
+        }
+        if (read_count == 0) {
+            return ReadResult::Failed;
+        }
+        data += read_count;
+        size -= static_cast<std::size_t>(read_count);
+    }
+    return ReadResult::Ok;
+}
+
+#endif
+
+} // namespace inference
@@ -0,0 +1,83 @@
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#ifdef _WIN32
+    #ifndef NOMINMAX
+        #define NOMINMAX
+    #endif
+    #include <windows.h>
+#else
+    #include <sys/types.h>
+#endif
+
+namespace inference {
+
+/**
+ * @brief A child process exchanging length-prefixed frames with the parent over its stdin and stdout.
+ *
+ * Every frame is a 4-byte big-endian length followed by the payload. The child's stderr is inherited,
+ * so its logs end up next to the service's own. The class is not thread-safe.
+ */
+class WorkerProcess {
+public:
+    using Deadline = std::chrono::steady_clock::time_point;
+
+    enum class ReadResult {
+        Ok,
+        // The process closed its stdout or sent an invalid frame
+        Failed,
+        // The frame was not complete before the deadline, the stream is out of sync and the process must be killed
+        TimedOut
+    };
+
+    // Frames larger than this are treated as a corrupted stream
+    static constexpr std::uint32_t kMaxFrameSize = 256 * 1024 * 1024;
+
+    WorkerProcess() = default;
+    ~WorkerProcess();
+
+    WorkerProcess(const WorkerProcess&) = delete;
+    WorkerProcess& operator=(const WorkerProcess&) = delete;
+
+    /**
+     * @brief Starts the process.
+     *
+     * @param args The program followed by its arguments, the program is searched in PATH.
+     * @return True if the process has been started, false otherwise.
+     */
+    bool Spawn(const std::vector<std::string>& args);
+
+    bool WriteFrame(const std::string& payload);
+    ReadResult ReadFrame(std::string& payload, Deadline deadline);
+
+    /**
+     * @brief Tells whether the process has been started and has not exited since.
+     */
+    bool IsRunning();
+
+    /**
+     * @brief Closes the pipes and kills the process if it is still running.
+     */
+    void Kill();
+
+private:
+    bool WriteAll(const char* data, std::size_t size);
+    ReadResult ReadAll(char* data, std::size_t size, Deadline deadline);
+
+#ifdef _WIN32
+    HANDLE process_ = nullptr;
+    HANDLE stdin_ = nullptr;
+    HANDLE stdout_ = nullptr;
+#else
+    pid_t pid_ = -1;
+    int stdin_fd_ = -1;
+    int stdout_fd_ = -1;
+#endif
+};
+
+} // namespace inference
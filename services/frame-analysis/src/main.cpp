@@ -1,17 +1,126 @@
+#include <chrono>
+#include <iostream>
+#include <memory>
+
 #include <crow.h>
 
 #include "../../../utils/cfg/global_config.h"
+#include "../../../utils/http/health.h"
+#include "../../../utils/redis/redis_stream.h"
+#include "../../../utils/redis/stage_jobs.h"
 
 #include "handlers/handlers_frw.h"
+#include "inference/batch_scheduler.h"
+#include "inference/onnx_backend.h"
+#include "inference/result_cache.h"
+#include "inference/worker_pool.h"
 
-int main() {
-    crow::SimpleApp app;
+namespace {
+
+/**
+ * Creates the inference backend selected in the config and loads its model.
+ *
+ * @param inference_config The inference section of the config.
+ * @return The backend, or nullptr if it could not be started.
+ */
+std::unique_ptr<inference::Backend> CreateModelBackend(const cfg::GlobalConfig::InferenceConfig& inference_config) {
+    if (inference_config.backend == cfg::GlobalConfig::InferenceBackend::Onnx) {
+#ifdef WITH_ONNXRUNTIME
+        inference::OnnxBackend::Options onnx_options;
+        onnx_options.model_path = inference_config.onnx_model;
+        onnx_options.threads = inference_config.onnx_threads;
+        auto onnx_backend = std::make_unique<inference::OnnxBackend>(onnx_options);
+        if (!onnx_backend->Load()) {
+            return nullptr;
+        }
+        return onnx_backend;
+#else
+        std::cerr << "The ONNX backend is not available, build with -DFRAME_ANALYSIS_WITH_ONNXRUNTIME=ON" << std::endl;
+        return nullptr;
+#endif
+    }
+
+    // The model is loaded once per worker instead of once per chunk of frames
+    inference::WorkerPool::Options pool_options;
+    pool_options.workers = inference_config.workers;
+    pool_options.command = {inference_config.python, inference_config.worker_script};
+    pool_options.startup_timeout = std::chrono::milliseconds(inference_config.worker_startup_timeout_ms);
+    pool_options.request_timeout = std::chrono::milliseconds(inference_config.worker_request_timeout_ms);
+    auto worker_pool = std::make_unique<inference::WorkerPool>(pool_options);
+    if (!worker_pool->Start()) {
+        std::cerr << "No inference worker could be started" << std::endl;
+        return nullptr;
+    }
+    return worker_pool;
+}
 
-    handlers::BindYoloHandler(app);
+/**
+ * Creates the inference backend and, for the Python workers and unless batching is disabled, the scheduler
+ * batching the frames of all videos in front of it. The ONNX backend runs one frame at a time and its
+ * session can be run from several threads, so it gains nothing from batching and a scheduler would only
+ * serialize the chunks analyzed concurrently.
+ *
+ * @param inference_config The inference section of the config.
+ * @return The backend, or nullptr if it could not be started.
+ */
+std::unique_ptr<inference::Backend> CreateBackend(const cfg::GlobalConfig::InferenceConfig& inference_config) {
+    auto backend = CreateModelBackend(inference_config);
+    if (!backend || inference_config.batch_size <= 1 ||
+        inference_config.backend != cfg::GlobalConfig::InferenceBackend::Python) {
+        return backend;
+    }
 
+    inference::BatchScheduler::Options batch_options;
+    batch_options.batch_size = inference_config.batch_size;
+    batch_options.max_wait = std::chrono::milliseconds(inference_config.batch_max_wait_ms);
+    // Every Python worker takes a batch of its own
+    batch_options.dispatchers = inference_config.workers;
+    auto scheduler = std::make_unique<inference::BatchScheduler>(std::move(backend), batch_options);
+    scheduler->Start();
+    return scheduler;
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
     const auto& config = cfg::GlobalConfig::getInstance();
+
+    std::unique_ptr<inference::Backend> backend = CreateBackend(config.getInference());
+    if (!backend) {
+        return 1;
+    }
+
+    // Results of near-identical frames are reused across videos
+    std::unique_ptr<inference::ResultCache> cache;
+    const auto& cache_config = config.getResultCache();
+    if (cache_config.enabled) {
+        inference::ResultCache::Options cache_options;
+        cache_options.capacity = cache_config.capacity;
+        cache_options.max_distance = cache_config.max_distance;
+        cache = std::make_unique<inference::ResultCache>(cache_options);
+    }
+
+    crow::SimpleApp app;
+
+    handlers::BindYoloHandler(app, *backend, cache.get());
+    handlers::BindMetricsHandler(app, cache.get());
+    utils::http::BindHealthHandler(app);
+
+    std::unique_ptr<redis::StreamWorker> worker;
+    if (config.getQueue().dispatch == cfg::GlobalConfig::DispatchMode::Queue) {
+        worker = redis_utils::StartStageWorker(redis_utils::kFrameAnalyticsStream, "frame-analytics",
+            [&backend, &cache](const crow::json::rvalue& body) {
+                return handlers::AnalyzeFrames(body, *backend, cache.get());
+            });
+    }
+
     const auto& app_config = config.getFrameAnalytics();
-    app.port(app_config.port).multithreaded().run();
+    app.port(cfg::GetListenPort(argc, argv, app_config.port)).multithreaded().run();
+
+    if (worker) {
+        worker->Stop();
+    }
+    backend.reset();
 
     return 0;
-}
\ No newline at end of file
+}
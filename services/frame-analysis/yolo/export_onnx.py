@@ -0,0 +1,8 @@
+from ultralytics import YOLO
+
+from yolo_analyze import weight_file
+
+
+if __name__ == "__main__":
+    # Writes yolov8n.onnx next to the weights, used by the "onnx" inference backend
+    YOLO(weight_file).export(format="onnx", imgsz=640, dynamic=False, simplify=True)
@@ -0,0 +1,142 @@
+import sys
+import json
+import os
+import struct
+
+from ultralytics import YOLO
+
+from yolo_analyze import analyze_frame, weight_file
+
+
+# Every frame is a 4-byte big-endian length followed by a UTF-8 JSON document
+HEADER = struct.Struct(">I")
+
+
+def read_frame(stream):
+    """
+    Reads one frame from the stream.
+
+    Args:
+        stream: The binary stream to read from.
+
+    Returns:
+        The decoded JSON document, or None if the stream has been closed.
+    """
+    header = stream.read(HEADER.size)
+    if len(header) < HEADER.size:
+        return None
+    (length,) = HEADER.unpack(header)
+    payload = stream.read(length)
+    if len(payload) < length:
+        return None
+    return json.loads(payload.decode("utf-8"))
+
+
+def write_frame(stream, document):
+    """
+    Writes one frame to the stream.
+
+    Args:
+        stream: The binary stream to write to.
+        document: The JSON serializable document to write.
+    """
+    payload = json.dumps(document).encode("utf-8")
+    stream.write(HEADER.pack(len(payload)))
+    stream.write(payload)
+    stream.flush()
+
+
+def result_to_json(result, image_path):
+    """
+    Converts the result of the model on one image to the format of analyze_frame().
+
+    Args:
+        result: The ultralytics result of the image.
+        image_path (str): The path to the image.
+
+    Returns:
+        dict: The result of the image.
+    """
+    boxes = []
+    if hasattr(result, 'boxes') and result.boxes.data.size(0) > 0:
+        box_data = result.boxes.xyxy.cpu().numpy().tolist()
+        cls_data = result.boxes.cls.cpu().numpy().tolist()
+        boxes = [
+            {
+                "box": box,
+                "class": result.names[int(cls)]
+            }
+            for box, cls in zip(box_data, cls_data)
+        ]
+    return {"file": os.path.basename(image_path), "boxes": boxes}
+
+
+def analyze_images(model, image_paths):
+    """
+    Analyzes the images as one batch, falling back to one image at a time if the batch fails,
+    e.g. because one of the images cannot be read.
+
+    Args:
+        model: The loaded YOLO model.
+        image_paths (list): The paths to the images to analyze.
+
+    Returns:
+        list: One result per image in the same order, see analyze_frame().
+    """
+    if not image_paths:
+        return []
+
+    try:
+        results = model(image_paths, verbose=False)
+        if len(results) == len(image_paths):
+            return [result_to_json(result, image_path) for result, image_path in zip(results, image_paths)]
+    except Exception:
+        pass
+
+    results = []
+    for image_path in image_paths:
+        frame_results = analyze_frame(model, image_path)
+        if frame_results:
+            results.append(frame_results[0])
+        else:
+            results.append({"file": os.path.basename(image_path), "boxes": []})
+    return results
+
+
+def main():
+    """
+    Serves analysis requests of the frame-analysis service until stdin is closed.
+
+    The model is loaded once at startup, then a {"ready": true} frame is sent. Every request is a
+    {"images": [<path>, ...]} frame answered with a {"results": [...]} frame holding one result per image,
+    or an {"error": <message>} frame.
+    """
+    requests = sys.stdin.buffer
+    responses = sys.stdout.buffer
+    # Anything printed by the libraries must not corrupt the protocol
+    sys.stdout = sys.stderr
+
+    try:
+        model = YOLO(weight_file)
+    except Exception as e:
+        write_frame(responses, {"error": f"Failed to load model: {str(e)}"})
+        return 1
+    write_frame(responses, {"ready": True})
+
+    while True:
+        try:
+            request = read_frame(requests)
+        except ValueError as e:
+            write_frame(responses, {"error": f"Invalid request: {str(e)}"})
+            continue
+        if request is None:
+            return 0
+
+        try:
+            write_frame(responses, {"results": analyze_images(model, request.get("images", []))})
+        except Exception as e:
+            write_frame(responses, {"error": str(e)})
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,196 @@
+#include "detections.h"
+
+#include <cstdint>
+#include <exception>
+#include <optional>
+#include <regex>
+#include <sstream>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "../../utils/db/pg.h"
+
+namespace handlers {
+
+namespace {
+
+constexpr std::size_t kDefaultLimit = 100;
+constexpr std::size_t kMaxLimit = 1000;
+
+/**
+ * Splits a comma-separated list, leaving out the empty items.
+ */
+std::vector<std::string> SplitList(const std::string& list) {
+    std::vector<std::string> items;
+    std::istringstream stream(list);
+    std::string item;
+    while (std::getline(stream, item, ',')) {
+        if (!item.empty()) {
+            items.push_back(item);
+        }
+    }
+    return items;
+}
+
+/**
+ * Returns the pagination cursor of a detection,
+ * "<detected_at in microseconds>:<frame_index>:<detection_index>:<video_id>".
+ */
+std::string MakeCursor(const utils::db::DetectionKey& key) {
+    return std::to_string(key.detected_at_us) + ":" + std::to_string(key.frame_index) + ":" +
+           std::to_string(key.detection_index) + ":" + key.video_id;
+}
+
+std::optional<utils::db::DetectionKey> ParseCursor(const std::string& cursor) {
+    std::size_t separators[3];
+    std::size_t start = 0;
+    for (auto& separator : separators) {
+        separator = cursor.find(':', start);
+        if (separator == std::string::npos) {
+            return std::nullopt;
+        }
+        start = separator + 1;
+    }
+    if (start >= cursor.size()) {
+        return std::nullopt;
+    }
+    utils::db::DetectionKey key;
+    try {
+        std::size_t parsed = 0;
+        const auto parse_number = [&cursor, &parsed](const std::size_t begin, const std::size_t end) {
+            const std::string number = cursor.substr(begin, end - begin);
+            const long long value = std::stoll(number, &parsed);
+            if (parsed != number.size()) {
+                throw std::invalid_argument("Trailing characters in cursor");
+            }
+            return value;
+        };
+        key.detected_at_us = parse_number(0, separators[0]);
+        key.frame_index = parse_number(separators[0] + 1, separators[1]);
+        key.detection_index = parse_number(separators[1] + 1, separators[2]);
+    } catch (const std::exception&) {
+        return std::nullopt;
+    }
+    key.video_id = cursor.substr(start);
+    return key;
+}
+
+/**
+ * Tells whether a from or to parameter is a timestamp PostgreSQL accepts, in ISO 8601:
+ * a date, optionally followed by a time and by Z or a UTC offset. Invalid dates such as 2024-02-30
+ * are rejected here rather than by the database cast.
+ */
+bool IsValidTimestamp(const std::string& value) {
+    static const std::regex kTimestamp(
+        R"((\d{4})-(\d{2})-(\d{2})(?:[T ](\d{2}):(\d{2})(?::(\d{2})(?:\.\d{1,6})?)?(?:Z|[+-](\d{2})(?::?\d{2})?)?)?)");
+    std::smatch match;
+    if (!std::regex_match(value, match, kTimestamp)) {
+        return false;
+    }
+    const auto field = [&match](const std::size_t index) {
+        return match[index].matched ? std::stoi(match[index].str()) : 0;
+    };
+    const int year = field(1);
+    const int month = field(2);
+    const int day = field(3);
+    if (year == 0 || month < 1 || month > 12 || day < 1) {
+        return false;
+    }
+    const bool leap = (year % 4 == 0 && year % 100 != 0) || year % 400 == 0;
+    constexpr int kDaysInMonth[] = {31, 28, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31};
+    if (day > kDaysInMonth[month - 1] + (month == 2 && leap ? 1 : 0)) {
+        return false;
+    }
+    return field(4) <= 23 && field(5) <= 59 && field(6) <= 59 && field(7) <= 15;
+}
+
+crow::json::wvalue MakeDetectionBody(const utils::db::Detection& detection) {
+    crow::json::wvalue body;
+    body["video_id"] = detection.key.video_id;
+    body["frame_index"] = static_cast<std::int64_t>(detection.key.frame_index);
+    body["class"] = detection.class_name;
+    body["box"] = std::vector<double>{detection.x_min, detection.y_min, detection.x_max, detection.y_max};
+    if (detection.confidence.has_value()) {
+        body["confidence"] = detection.confidence.value();
+    }
+    body["detected_at"] = detection.detected_at;
+    return body;
+}
+
+} // namespace
+
+/**
+ * Binds the detections search handler to the given Crow application.
+ * GET /detections/search finds the detections of all the analyzed videos, filtered by any of
+ * class=<label>, video_ids=<id>,<id>,..., from=<timestamp>, to=<timestamp> and min_area=<pixels>.
+ * The detections are answered in time order, at most limit of them, with a next cursor to send
+ * as after for the next page when there may be more.
+ *
+ * @param app The Crow application to bind the handler to.
+ */
+void BindDetectionsSearchHandler(crow::SimpleApp& app) {
+    CROW_ROUTE(app, "/detections/search").methods(crow::HTTPMethod::GET)
+    ([](const crow::request& req) {
+        utils::db::DetectionQuery query;
+        if (const char* class_name = req.url_params.get("class")) {
+            query.class_name = class_name;
+        }
+        if (const char* video_ids = req.url_params.get("video_ids")) {
+            query.video_ids = SplitList(video_ids);
+        }
+        if (const char* from = req.url_params.get("from")) {
+            query.from = from;
+            if (!IsValidTimestamp(query.from.value())) {
+                return crow::response(400, "Invalid from, expected an ISO 8601 timestamp");
+            }
+        }
+        if (const char* to = req.url_params.get("to")) {
+            query.to = to;
+            if (!IsValidTimestamp(query.to.value())) {
+                return crow::response(400, "Invalid to, expected an ISO 8601 timestamp");
+            }
+        }
+        try {
+            if (const char* min_area = req.url_params.get("min_area")) {
+                query.min_area = std::stod(min_area);
+            }
+            if (const char* limit = req.url_params.get("limit")) {
+                query.limit = std::stoul(limit);
+            } else {
+                query.limit = kDefaultLimit;
+            }
+        } catch (const std::exception&) {
+            return crow::response(400, "Invalid min_area or limit");
+        }
+        if (query.limit == 0 || query.limit > kMaxLimit) {
+            return crow::response(400, "limit must be between 1 and " + std::to_string(kMaxLimit));
+        }
+        if (const char* after = req.url_params.get("after")) {
+            query.after = ParseCursor(after);
+            if (!query.after.has_value()) {
+                return crow::response(400, "Invalid after");
+            }
+        }
+
+        const auto detections = utils::db::SearchDetections(query);
+        if (!detections.has_value()) {
+            return crow::response(500, "Failed to search detections");
+        }
+
+        crow::json::wvalue::list detections_body;
+        detections_body.reserve(detections->size());
+        for (const auto& detection : detections.value()) {
+            detections_body.push_back(MakeDetectionBody(detection));
+        }
+
+        crow::json::wvalue response;
+        response["detections"] = std::move(detections_body);
+        if (detections->size() == query.limit) {
+            response["next"] = MakeCursor(detections->back().key);
+        }
+        return crow::response(200, response);
+    });
+}
+
+} // namespace handlers
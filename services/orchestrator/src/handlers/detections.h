@@ -0,0 +1,9 @@
+#pragma once
+
+#include <crow.h>
+
+namespace handlers {
+
+void BindDetectionsSearchHandler(crow::SimpleApp& app);
+
+} // namespace handlers
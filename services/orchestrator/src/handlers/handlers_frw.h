@@ -1,5 +1,7 @@
 #pragma once
 
+#include "detections.h"
+#include "metrics.h"
 #include "status.h"
 #include "submit_video.h"
-#include "stop.h"
+#include "stop.h"
\ No newline at end of file
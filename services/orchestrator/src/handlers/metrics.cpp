@@ -0,0 +1,37 @@
+#include "metrics.h"
+
+#include <utility>
+
+namespace handlers {
+
+/**
+ * Binds the metrics handler to the specified Crow application.
+ * GET /metrics returns the counters of the finished responses cache, used to tune its memory budget.
+ *
+ * @param app The Crow application to bind the handler to.
+ * @param cache The finished responses cache, nullptr if disabled.
+ */
+void BindMetricsHandler(crow::SimpleApp& app, const status::FinishedCache* cache) {
+    CROW_ROUTE(app, "/metrics").methods(crow::HTTPMethod::GET)
+    ([cache]() {
+        crow::json::wvalue finished_cache;
+        finished_cache["enabled"] = cache != nullptr;
+        if (cache != nullptr) {
+            const auto stats = cache->GetStats();
+            const auto lookups = stats.hits + stats.misses;
+            finished_cache["hits"] = stats.hits;
+            finished_cache["misses"] = stats.misses;
+            finished_cache["hit_rate"] = lookups > 0 ? static_cast<double>(stats.hits) / lookups : 0.0;
+            finished_cache["evictions"] = stats.evictions;
+            finished_cache["invalidations"] = stats.invalidations;
+            finished_cache["entries"] = stats.entries;
+            finished_cache["bytes"] = stats.bytes;
+        }
+
+        crow::json::wvalue metrics;
+        metrics["finished_cache"] = std::move(finished_cache);
+        return crow::response(200, metrics);
+    });
+}
+
+} // namespace handlers
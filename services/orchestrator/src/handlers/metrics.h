@@ -0,0 +1,11 @@
+#pragma once
+
+#include <crow.h>
+
+#include "../status/finished_cache.h"
+
+namespace handlers {
+
+void BindMetricsHandler(crow::SimpleApp& app, const status::FinishedCache* cache);
+
+} // namespace handlers
@@ -1,74 +1,525 @@
 #include "status.h"
 
-#include "../../utils/redis/redis.h"
+#include <chrono>
+#include <cstdint>
+#include <exception>
+#include <optional>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include "../../utils/http/requests.h"
 #include "../../utils/cfg/global_config.h"
 #include "pg.h"
 
 namespace handlers {
 
+namespace {
+
+/**
+ * Completes an asynchronous response with a JSON body.
+ *
+ * @param res The response to complete.
+ * @param code The HTTP status code.
+ * @param body The JSON body of the response.
+ */
+void EndJsonResponse(crow::response& res, const int code, const crow::json::wvalue& body) {
+    res.code = code;
+    res.set_header("Content-Type", "application/json");
+    res.write(body.dump());
+    res.end();
+}
+
+/**
+ * Completes an asynchronous response with a plain text message.
+ */
+void EndResponse(crow::response& res, const int code, const std::string& message) {
+    res.code = code;
+    res.write(message);
+    res.end();
+}
+
+/**
+ * Answers with the status of a video that is no longer in Redis, and its result once it is finished.
+ *
+ * The response of a finished video is cached, its result no longer changes.
+ *
+ * @param res The response to complete.
+ * @param id The ID of the video.
+ * @param cache The cache of finished responses, nullptr if none.
+ */
+void EndWithDatabaseStatus(crow::response& res, const std::string& id, status::FinishedCache* cache) {
+    const auto pg_status = utils::db::GetVideoStatus(id);
+    if (!pg_status.has_value()) {
+        EndResponse(res, 404, "Video with given id not found");
+        return;
+    }
+    const auto pg_status_enum = requests::StringToVideoStatus(pg_status.value());
+    if (pg_status_enum == requests::VideoStatus::Finished) {
+        const auto pg_result = utils::db::GetAnalysisResult(id);
+        if (!pg_result.has_value()) {
+            EndResponse(res, 404, "Analysis result not found");
+            return;
+        }
+        const crow::json::wvalue response{
+            {"id", id},
+            {"status", pg_status.value()},
+            {"result", pg_result.value()},
+        };
+        if (cache != nullptr) {
+            cache->Insert(id, response.dump());
+        }
+        EndJsonResponse(res, 200, response);
+        return;
+    }
+    EndJsonResponse(res, 200, crow::json::wvalue{
+        {"id", id},
+        {"status", pg_status.value()},
+    });
+}
+
+/**
+ * Answers with the status of a video from the database. The query runs on the blocking pool rather than
+ * on the io_context, whose threads drive every request in flight, and no exception escapes from it.
+ */
+void EndWithDatabaseStatusSafely(crow::response& res, asio::thread_pool& blocking_pool, const std::string& id,
+                                 status::FinishedCache* cache = nullptr) {
+    asio::post(blocking_pool, [&res, id, cache] {
+        try {
+            EndWithDatabaseStatus(res, id, cache);
+        } catch (const std::exception& e) {
+            EndResponse(res, 500, e.what());
+        }
+    });
+}
+
+/**
+ * Answers with the status of a video that Redis reports as finished, together with its result, which is
+ * only kept in the database. The response is cached, so that the next requests for the video are answered
+ * from memory. Runs on the blocking pool.
+ *
+ * @param res The response to complete.
+ * @param id The ID of the video.
+ * @param redis_response The response built from the request hash, answered as is if the result is missing.
+ * @param cache The cache of finished responses, nullptr if none.
+ */
+void EndWithFinishedResult(crow::response& res, const std::string& id, crow::json::wvalue redis_response,
+                           status::FinishedCache* cache) {
+    const auto pg_result = utils::db::GetAnalysisResult(id);
+    if (!pg_result.has_value()) {
+        EndJsonResponse(res, 200, redis_response);
+        return;
+    }
+    // The same body as for the finished videos Redis no longer knows, the cache holds one response per video
+    const crow::json::wvalue response{
+        {"id", id},
+        {"status", requests::VideoStatusToString(requests::VideoStatus::Finished)},
+        {"result", pg_result.value()},
+    };
+    if (cache != nullptr) {
+        cache->Insert(id, response.dump());
+    }
+    EndJsonResponse(res, 200, response);
+}
+
+std::string GetVideoId(std::string id) {
+    const auto i = id.find("request:");
+    if (i != std::string::npos) {
+        id = id.substr(i + 8); // 8 is the length of "request:"
+    }
+    return id;
+}
+
+crow::json::wvalue MakeStatusBody(const std::string& id, const std::string& status, const long long version) {
+    return crow::json::wvalue{
+        {"id", id},
+        {"status", status},
+        {"version", static_cast<std::int64_t>(version)},
+    };
+}
+
+/**
+ * The status and its version read from a request hash with HMGET status version.
+ */
+struct StatusSnapshot {
+    std::string status;
+    long long version = 0;
+};
+
+std::optional<StatusSnapshot> GetStatusSnapshot(const redis::Reply& reply) {
+    if (reply.IsError() || reply.elements.size() != 2 || reply.elements[0].IsNil()) {
+        return std::nullopt;
+    }
+    StatusSnapshot snapshot;
+    snapshot.status = reply.elements[0].str;
+    if (!reply.elements[1].IsNil()) {
+        try {
+            snapshot.version = std::stoll(reply.elements[1].str);
+        } catch (const std::exception&) {
+            snapshot.version = 0;
+        }
+    }
+    return snapshot;
+}
+
+void EndWithSnapshot(crow::response& res, asio::thread_pool& blocking_pool, const std::string& id,
+                     const std::optional<StatusSnapshot>& snapshot) {
+    if (!snapshot.has_value()) {
+        EndWithDatabaseStatusSafely(res, blocking_pool, id);
+        return;
+    }
+    EndJsonResponse(res, 200, MakeStatusBody(id, snapshot->status, snapshot->version));
+}
+
+/**
+ * Reads the current status of a video and answers with it.
+ */
+void EndWithCurrentStatus(crow::response& res, redis::AsyncRedis& async_redis, asio::thread_pool& blocking_pool,
+                          const std::string& id) {
+    async_redis.Command({"HMGET", "request:" + id, "status", "version"},
+        [&res, &blocking_pool, id](const redis::Reply& reply) {
+            EndWithSnapshot(res, blocking_pool, id, GetStatusSnapshot(reply));
+        });
+}
+
+bool IsFinalStatus(const std::string& status) {
+    try {
+        return requests::IsFinalVideoStatus(requests::StringToVideoStatus(status));
+    } catch (const std::exception&) {
+        return false;
+    }
+}
+
+// Bounds the size of the Redis pipeline and of the database query of one batch
+constexpr std::size_t kMaxBatchSize = 1000;
+
+/**
+ * The fields of each video answered by the batch status handler.
+ */
+struct BatchFields {
+    bool id = true;
+    bool status = true;
+    bool version = true;
+    bool result = true;
+};
+
+/**
+ * Reads the fields projection of a batch status request, all the fields when it has none.
+ *
+ * @param body The body of the request.
+ * @return The fields to answer, std::nullopt if the projection is invalid.
+ */
+std::optional<BatchFields> ParseBatchFields(const crow::json::rvalue& body) {
+    if (!body.has("fields")) {
+        return BatchFields{};
+    }
+    const auto& fields_value = body["fields"];
+    if (fields_value.t() != crow::json::type::List) {
+        return std::nullopt;
+    }
+    BatchFields fields{false, false, false, false};
+    for (const auto& field_value : fields_value) {
+        if (field_value.t() != crow::json::type::String) {
+            return std::nullopt;
+        }
+        const std::string field = field_value.s();
+        if (field == "id") {
+            fields.id = true;
+        }
+        else if (field == "status") {
+            fields.status = true;
+        }
+        else if (field == "version") {
+            fields.version = true;
+        }
+        else if (field == "result") {
+            fields.result = true;
+        }
+        else {
+            return std::nullopt;
+        }
+    }
+    return fields;
+}
+
+/**
+ * Reads the IDs of a batch status request, without duplicates and in the order they were given.
+ *
+ * @param body The body of the request.
+ * @return The IDs, std::nullopt if they are missing or invalid.
+ */
+std::optional<std::vector<std::string>> ParseBatchIds(const crow::json::rvalue& body) {
+    if (!body.has("ids") || body["ids"].t() != crow::json::type::List) {
+        return std::nullopt;
+    }
+    std::vector<std::string> ids;
+    std::unordered_set<std::string> seen;
+    for (const auto& id_value : body["ids"]) {
+        if (id_value.t() != crow::json::type::String) {
+            return std::nullopt;
+        }
+        std::string id = GetVideoId(id_value.s());
+        if (seen.insert(id).second) {
+            ids.push_back(std::move(id));
+        }
+    }
+    return ids;
+}
+
+/**
+ * Answers a batch status request from the status snapshots read from Redis, one per ID.
+ * The videos Redis does not know, and the results, which are only kept in the database,
+ * are read with a single query.
+ *
+ * @param res The response to complete.
+ * @param ids The IDs of the videos.
+ * @param fields The fields to answer for each video.
+ * @param replies The HMGET status version replies, in the order of the IDs.
+ */
+void EndWithBatchStatus(crow::response& res, const std::vector<std::string>& ids, const BatchFields& fields,
+                        const std::vector<redis::Reply>& replies) {
+    std::vector<std::optional<StatusSnapshot>> snapshots;
+    snapshots.reserve(ids.size());
+    std::vector<std::string> db_ids;
+    for (std::size_t i = 0; i < ids.size(); ++i) {
+        auto snapshot = i < replies.size() ? GetStatusSnapshot(replies[i]) : std::nullopt;
+        const bool needs_result = fields.result && snapshot.has_value() &&
+                                  snapshot->status == requests::VideoStatusToString(requests::VideoStatus::Finished);
+        if (!snapshot.has_value() || needs_result) {
+            db_ids.push_back(ids[i]);
+        }
+        snapshots.push_back(std::move(snapshot));
+    }
+
+    std::unordered_map<std::string, utils::db::VideoStatusRecord> records;
+    if (!db_ids.empty()) {
+        auto db_records = utils::db::GetVideoStatuses(db_ids, fields.result);
+        if (!db_records.has_value()) {
+            EndResponse(res, 500, "Failed to read video statuses");
+            return;
+        }
+        records = std::move(db_records.value());
+    }
+
+    crow::json::wvalue::list videos;
+    crow::json::wvalue::list not_found;
+    for (std::size_t i = 0; i < ids.size(); ++i) {
+        const std::string& id = ids[i];
+        const auto record = records.find(id);
+        const auto& snapshot = snapshots[i];
+        if (!snapshot.has_value() && record == records.end()) {
+            not_found.emplace_back(id);
+            continue;
+        }
+
+        crow::json::wvalue video;
+        if (fields.id) {
+            video["id"] = id;
+        }
+        if (fields.status) {
+            video["status"] = snapshot.has_value() ? snapshot->status : record->second.status;
+        }
+        // Only Redis keeps the version, the database has none for the videos Redis no longer knows
+        if (fields.version && snapshot.has_value()) {
+            video["version"] = static_cast<std::int64_t>(snapshot->version);
+        }
+        if (fields.result && record != records.end() && record->second.result.has_value()) {
+            video["result"] = std::move(record->second.result.value());
+        }
+        videos.push_back(std::move(video));
+    }
+
+    crow::json::wvalue response;
+    response["videos"] = std::move(videos);
+    response["not_found"] = std::move(not_found);
+    EndJsonResponse(res, 200, response);
+}
+
+} // namespace
+
 /**
  * Binds the status handler to the given Crow application.
+ * Finished videos are answered from the cache. Otherwise the status is read from Redis without holding
+ * a Crow worker thread; the response is completed from the reply handler, falling back to the database
+ * for videos Redis does not know. A finished video is answered with its result from the database,
+ * and its response is cached.
  *
  * @param app The Crow application to bind the status handler to.
+ * @param async_redis The non-blocking Redis client.
+ * @param blocking_pool The threads reading the database off the io_context.
+ * @param cache The cache of finished responses, nullptr if disabled.
  */
-void BindStatusHandler(crow::SimpleApp& app) {
+void BindStatusHandler(crow::SimpleApp& app, redis::AsyncRedis& async_redis, asio::thread_pool& blocking_pool,
+                       status::FinishedCache* cache) {
     CROW_ROUTE(app, "/status/<string>").methods(crow::HTTPMethod::GET)
-    ([](const crow::request& req, std::string id){
-        const auto& config = cfg::GlobalConfig::getInstance();
-        const auto& redis = config.getRedis();
-        redisContext *redis_conn = redis_utils::RedisConnect(redis.host, redis.port);
-        if (redis_conn == nullptr) {
-            return crow::response(500, "Redis connection error");
-        }
+    ([&async_redis, &blocking_pool, cache](const crow::request& req, crow::response& res, std::string id) {
+        id = GetVideoId(id);
 
-        const auto i = id.find("request:");
-        if (i != std::string::npos) {
-            id = id.substr(i + 8); // 8 is the length of "request:"
+        if (cache != nullptr) {
+            if (auto cached = cache->Find(id)) {
+                res.code = 200;
+                res.set_header("Content-Type", "application/json");
+                res.write(cached.value());
+                res.end();
+                return;
+            }
         }
 
-        redisReply *reply = redis_utils::RedisGetByKey(redis_conn, "HGETALL request:%s", id.c_str());
-        if (reply == nullptr) {
-            const auto pg_status = utils::db::GetVideoStatus(id);
-            if (!pg_status.has_value()) {
-                return crow::response(404, "Video with given id not found");
+        async_redis.Command({"HGETALL", "request:" + id}, [&res, &blocking_pool, id, cache](const redis::Reply& reply) {
+            if (reply.IsError() || reply.elements.empty()) {
+                EndWithDatabaseStatusSafely(res, blocking_pool, id, cache);
+                return;
             }
-            const auto pg_status_enum = requests::StringToVideoStatus(pg_status.value());
-            if (pg_status_enum == requests::VideoStatus::Finished) {
-                const auto pg_result = utils::db::GetAnalysisResult(id);
-                if (!pg_result.has_value()) {
-                    return crow::response(404, "Analysis result not found");
+
+            crow::json::wvalue response;
+            bool finished = false;
+            for (std::size_t i = 0; i + 1 < reply.elements.size(); i += 2) {
+                const std::string& key = reply.elements[i].str;
+                const std::string& value = reply.elements[i + 1].str;
+                if (key == "id") {
+                    response["id"] = value;
+                }
+                else if (key == "status") {
+                    response["status"] = value;
+                    finished = value == requests::VideoStatusToString(requests::VideoStatus::Finished);
+                }
+                else if (key == "version") {
+                    response["version"] = value;
                 }
-                return crow::response(200, crow::json::wvalue{
-                    {"id", id},
-                    {"status", pg_status.value()},
-                    {"result", pg_result.value()},
-                });
             }
-            return crow::response(200, crow::json::wvalue{
-                {"id", id},
-                {"status", pg_status.value()},
-            });
-        }
 
-        crow::json::wvalue response;
-        for (size_t i = 0; i < reply->elements; i += 2) {
-            std::string key = reply->element[i]->str;
-            std::string value = reply->element[i+1]->str;
-            if (key == "id") {
-                response["id"] = value;
+            // Request hashes are kept, so a finished video is rarely a Redis miss and its result is read here
+            if (finished) {
+                asio::post(blocking_pool, [&res, id, response = std::move(response), cache]() mutable {
+                    try {
+                        EndWithFinishedResult(res, id, std::move(response), cache);
+                    } catch (const std::exception& e) {
+                        EndResponse(res, 500, e.what());
+                    }
+                });
+                return;
             }
-            else if (key == "path") { 
-                continue;
+            EndJsonResponse(res, 200, response);
+        });
+    });
+}
+
+/**
+ * Binds the status long-poll handler to the given Crow application.
+ * GET /status/<id>/stream?since=<version> answers as soon as the status of the video has a version above
+ * since, which is right away when it already has, and otherwise when the change is published or after
+ * the long-poll timeout with the unchanged status. Without since, the current status is answered.
+ * The response carries the version to send as since with the next request.
+ *
+ * @param app The Crow application to bind the handler to.
+ * @param async_redis The non-blocking Redis client.
+ * @param blocking_pool The threads reading the database off the io_context.
+ * @param hub The hub delivering the published status changes.
+ */
+void BindStatusStreamHandler(crow::SimpleApp& app, redis::AsyncRedis& async_redis, asio::thread_pool& blocking_pool,
+                             status::StatusHub& hub) {
+    CROW_ROUTE(app, "/status/<string>/stream").methods(crow::HTTPMethod::GET)
+    ([&async_redis, &blocking_pool, &hub](const crow::request& req, crow::response& res, std::string id) {
+        id = GetVideoId(id);
+
+        long long since = -1;
+        if (const char* since_param = req.url_params.get("since")) {
+            try {
+                since = std::stoll(since_param);
+            } catch (const std::exception&) {
+                EndResponse(res, 400, "Invalid since");
+                return;
             }
-            else if (key == "status") { 
-                response["status"] = value;
+        }
+
+        // The waiter is registered before the current status is read, so a change in between is not missed
+        status::StatusHub::WaiterPtr waiter;
+        if (since >= 0) {
+            const auto timeout = std::chrono::milliseconds(
+                cfg::GlobalConfig::getInstance().getStatusUpdates().long_poll_timeout_ms);
+            waiter = hub.Wait(id, since, timeout,
+                [&res, &async_redis, &blocking_pool, id](const std::optional<status::StatusUpdate>& update) {
+                    if (update.has_value()) {
+                        EndJsonResponse(res, 200, MakeStatusBody(id, update->status, update->version));
+                        return;
+                    }
+                    EndWithCurrentStatus(res, async_redis, blocking_pool, id);
+                });
+            if (!waiter) {
+                EndResponse(res, 503, "Too many clients waiting for status changes");
+                return;
             }
         }
 
-        freeReplyObject(reply);
-        redisFree(redis_conn);
+        async_redis.Command({"HMGET", "request:" + id, "status", "version"},
+            [&res, &hub, &blocking_pool, waiter, id, since](const redis::Reply& reply) {
+                const auto snapshot = GetStatusSnapshot(reply);
+                // Nothing new yet, the waiter answers once the status changes or times out
+                if (waiter && snapshot.has_value() && snapshot->version <= since && !IsFinalStatus(snapshot->status)) {
+                    return;
+                }
+                if (waiter && !hub.Cancel(waiter)) {
+                    return;
+                }
+                EndWithSnapshot(res, blocking_pool, id, snapshot);
+            });
+    });
+}
+
+/**
+ * Binds the batch status handler to the given Crow application.
+ * POST /status/batch takes {"ids": [...], "fields": [...]} and answers {"videos": [...], "not_found": [...]}.
+ * The statuses are read from Redis in one pipeline and the videos it does not know from the database
+ * in one query. fields is any of id, status, version and result, all of them by default; leaving out
+ * result spares reading and sending the analysis results.
+ *
+ * @param app The Crow application to bind the handler to.
+ * @param async_redis The non-blocking Redis client.
+ * @param blocking_pool The threads reading the database off the io_context.
+ */
+void BindStatusBatchHandler(crow::SimpleApp& app, redis::AsyncRedis& async_redis, asio::thread_pool& blocking_pool) {
+    CROW_ROUTE(app, "/status/batch").methods(crow::HTTPMethod::POST)
+    ([&async_redis, &blocking_pool](const crow::request& req, crow::response& res) {
+        const auto body = crow::json::load(req.body);
+        if (!body) {
+            EndResponse(res, 400, "Invalid JSON");
+            return;
+        }
+        auto ids = ParseBatchIds(body);
+        if (!ids.has_value()) {
+            EndResponse(res, 400, "Missing or invalid ids");
+            return;
+        }
+        if (ids->size() > kMaxBatchSize) {
+            EndResponse(res, 400, "Too many ids, at most " + std::to_string(kMaxBatchSize) + " are allowed");
+            return;
+        }
+        const auto fields = ParseBatchFields(body);
+        if (!fields.has_value()) {
+            EndResponse(res, 400, "Invalid fields");
+            return;
+        }
+
+        std::vector<std::vector<std::string>> commands;
+        commands.reserve(ids->size());
+        for (const auto& id : ids.value()) {
+            commands.push_back({"HMGET", "request:" + id, "status", "version"});
+        }
 
-        return crow::response(200, response);
+        async_redis.Pipeline(std::move(commands),
+            [&res, &blocking_pool, ids = std::move(ids.value()), fields = fields.value()](
+                std::vector<redis::Reply> replies) mutable {
+                // The database query of the batch runs off the io_context
+                asio::post(blocking_pool,
+                    [&res, ids = std::move(ids), fields, replies = std::move(replies)] {
+                        try {
+                            EndWithBatchStatus(res, ids, fields, replies);
+                        } catch (const std::exception& e) {
+                            EndResponse(res, 500, e.what());
+                        }
+                    });
+            });
     });
 }
 
@@ -1,9 +1,19 @@
 #pragma once
 
+#include <asio.hpp>
 #include <crow.h>
 
+#include "../../utils/redis/async_redis.h"
+
+#include "../status/finished_cache.h"
+#include "../status/status_hub.h"
+
 namespace handlers {
 
-void BindStatusHandler(crow::SimpleApp& app);
+void BindStatusHandler(crow::SimpleApp& app, redis::AsyncRedis& async_redis, asio::thread_pool& blocking_pool,
+                       status::FinishedCache* cache);
+void BindStatusBatchHandler(crow::SimpleApp& app, redis::AsyncRedis& async_redis, asio::thread_pool& blocking_pool);
+void BindStatusStreamHandler(crow::SimpleApp& app, redis::AsyncRedis& async_redis, asio::thread_pool& blocking_pool,
+                             status::StatusHub& hub);
 
 } // namespace handlers
\ No newline at end of file
@@ -1,8 +1,9 @@
 #include "stop.h"
 
-#include "../../utils/cfg/global_config.h"
 #include "../../utils/redis/redis.h"
+#include "../../utils/redis/redis_pool.h"
 #include "../../utils/db/pg.h"
+#include "../../utils/db/status_batcher.h"
 
 namespace handlers {
 
@@ -11,21 +12,28 @@ void BindStopHandler(crow::SimpleApp& app) {
     ([](const crow::request& req) {
         const auto& id = req.body;
 
-        const auto& config = cfg::GlobalConfig::getInstance();
-        const auto& redis_config = config.getRedis();
-        auto redis_conn = redis_utils::RedisConnect(redis_config.host, redis_config.port);
-        if (redis_conn == nullptr) {
+        auto redis_conn = redis::RedisPool::getInstance().acquire();
+        if (!redis_conn) {
             return crow::response(500, "Failed to connect to Redis");
         }
 
-        const auto redis_status = redis_utils::RedisGetByKey(redis_conn, "HGETALL request:%s", id.c_str());
-        if (redis_status == nullptr) {
-            return crow::response(500, "No such key in Redis");
+        // Set status to Stopped, unless the video already has a final status
+        const auto transition = redis_utils::RedisUpdateVideoStatus(redis_conn.get(), id,
+                                                                    requests::VideoStatus::Stopped);
+        switch (transition.result) {
+        case redis_utils::StatusTransition::Result::NotFound:
+            return crow::response(404, "Video with given id not found");
+        case redis_utils::StatusTransition::Result::Rejected:
+            return crow::response(409, "Video is already " +
+                                  (transition.previous.has_value()
+                                      ? requests::VideoStatusToString(transition.previous.value())
+                                      : std::string("in a final status")));
+        case redis_utils::StatusTransition::Result::Error:
+            return crow::response(500, "Failed to update the video status in Redis");
+        case redis_utils::StatusTransition::Result::Applied:
+            break;
         }
-
-        // Set status to Stopped
-        redis_utils::RedisUpdateVideoStatus(redis_conn, id, requests::VideoStatus::Stopped);
-        utils::db::UpdateVideoStatus(id, requests::VideoStatusToString(requests::VideoStatus::Stopped));
+        utils::db::StatusBatcher::getInstance().Update(id, requests::VideoStatus::Stopped);
 
         return crow::response(200, "Video stopped");
     });
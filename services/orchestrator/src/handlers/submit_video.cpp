@@ -1,165 +1,146 @@
 #include "submit_video.h"
 
+#include <exception>
 #include <iostream>
+#include <optional>
+#include <vector>
 
-#include <asio.hpp>
-
-#include "../../utils/http/requests_chain.h"
 #include "../../utils/http/requests.h"
 #include "../../utils/redis/redis.h"
+#include "../../utils/redis/redis_pool.h"
 #include "../../utils/cfg/global_config.h"
 #include "../../utils/db/pg.h"
+#include "../../utils/db/status_batcher.h"
+
+#include "../pipeline/dedup.h"
 
 namespace handlers {
 
 namespace {
 
 /**
- * Callback function called when YOLO analysis is complete.
- * 
- * @param response The response from the YOLO analysis request.
- * @param chain The HTTP requests chain.
- * @param id The ID of the video analysis.
+ * Completes the submission of a video whose request has been saved to Redis: saves it to the database,
+ * serves it from an identical video when there is one, or dispatches its first stage.
+ * Runs on the blocking pool, since the database and the pooled Redis connections block.
+ *
+ * @param res The HTTP response object.
+ * @param pipeline The pipeline driving the video through the processing stages.
+ * @param id The ID of the video.
+ * @param video_path The path to the video file.
+ * @param fingerprint The fingerprint of the video, std::nullopt when duplicates are not detected.
  */
-void OnYoloAnalyzeComplete(const crow::response& response, utils::http::RequestsChain& chain, const std::string& id) {
-    if (response.code == 200) {
-        crow::json::wvalue save_body;
-        save_body["redis_id"] = id;
-        const auto& config = cfg::GlobalConfig::getInstance();
-        const auto& video_post = config.getVideoPostProcessing();
-        const auto& redis = config.getRedis();
-        redisContext *redis_conn = redis_utils::RedisConnect(redis.host, redis.port);
-        if (redis_conn == nullptr) {
+void FinishSubmission(crow::response& res, pipeline::Pipeline& pipeline, const std::string& id,
+                      const std::string& video_path, const std::optional<std::string>& fingerprint) {
+    // Save video to database
+    utils::db::SaveRequestOnReceive(id, fingerprint.value_or(""));
+
+    if (fingerprint.has_value()) {
+        auto redis_conn = redis::RedisPool::getInstance().acquire();
+        if (!redis_conn) {
+            res.code = 500;
+            res.write("Redis connection error");
+            res.end();
             return;
         }
-        redis_utils::RedisUpdateVideoStatus(redis_conn, id, requests::VideoStatus::YoloFinished);
-        chain.AddRequest(video_post.host, std::to_string(video_post.port), "/save_video", save_body, 
-[&redis_conn, &id](const crow::response& res) {
-            if (res.code == 200) {
-                std::cout << "Video analysis saved successfully\n";
-                redis_utils::RedisUpdateVideoStatus(redis_conn, id, requests::VideoStatus::Finished);
-                utils::db::UpdateVideoStatus(id, requests::VideoStatusToString(requests::VideoStatus::Finished));
-            } else {
-                std::cout << "Failed to save video analysis\n";
-                redis_utils::RedisUpdateVideoStatus(redis_conn, id, requests::VideoStatus::Failed);
-                utils::db::UpdateVideoStatus(id, requests::VideoStatusToString(requests::VideoStatus::Failed));
-            }
-        });
-        redis_utils::RedisUpdateVideoStatus(redis_conn, id, requests::VideoStatus::PostProcessing);
-        const bool able_to_exec = chain.Execute();
-        if (!able_to_exec){
-            redis_utils::RedisUpdateVideoStatus(redis_conn, id, requests::VideoStatus::Failed);
-            utils::db::UpdateVideoStatus(id, requests::VideoStatusToString(requests::VideoStatus::Failed));
-        }
-    } else {
-        std::cout << "Failed to start or finish YOLO analysis\n" << ". Response.body: " << response.body << std::endl;
-        const auto& config = cfg::GlobalConfig::getInstance();
-        const auto& redis = config.getRedis();
-        redisContext *redis_conn = redis_utils::RedisConnect(redis.host, redis.port);
-        if (redis_conn == nullptr) {
+        if (pipeline::ClaimSubmission(redis_conn.get(), id, fingerprint.value()) != pipeline::SubmissionRole::Leader) {
+            res.code = 200;
+            res.write(id);
+            res.end();
             return;
         }
-        redis_utils::RedisUpdateVideoStatus(redis_conn, id, requests::VideoStatus::Failed);
-        utils::db::UpdateVideoStatus(id, requests::VideoStatusToString(requests::VideoStatus::Failed));
     }
-}
 
-/**
- * Callback function called when video processing is complete.
- * 
- * @param response The response object containing the result of the video processing.
- * @param chain The HTTP requests chain object.
- * @param id The ID of the video being processed.
- */
-void OnProcessVideoComplete(const crow::response& response, utils::http::RequestsChain& chain, const std::string& id) {
-    const auto& config = cfg::GlobalConfig::getInstance();
-    const auto& redis = config.getRedis();
-    redisContext *redis_conn = redis_utils::RedisConnect(redis.host, redis.port);
-    if (redis_conn == nullptr) {
-        return;
-    }
-    if (response.code == 200) {
-        redis_utils::RedisUpdateVideoStatus(redis_conn, id, requests::VideoStatus::PreProcessingFinished);
-
-        crow::json::wvalue yolo_body;
-        yolo_body["redis_id"] = id;
-        std::string frames_folder = std::filesystem::absolute("../../../tmp/frames/frames-" + id).string();
-        yolo_body["frames_path"] = frames_folder;
-        const auto& frame_analytics = config.getFrameAnalytics();
-        chain.AddRequest(frame_analytics.host, std::to_string(frame_analytics.port), "/yolo_analyze_frames", yolo_body,
-            std::bind(OnYoloAnalyzeComplete, std::placeholders::_1, std::ref(chain), id));
-
-        redis_utils::RedisUpdateVideoStatus(redis_conn, id, requests::VideoStatus::YoloStarted);
-        const bool able_to_exec = chain.Execute();
-        if (!able_to_exec) {
-            redis_utils::RedisUpdateVideoStatus(redis_conn, id, requests::VideoStatus::Failed);
-            utils::db::UpdateVideoStatus(id, requests::VideoStatusToString(requests::VideoStatus::Failed));
+    if (!pipeline.Start(id, video_path)) {
+        std::cerr << "Failed to start processing video " << id << std::endl;
+        {
+            auto redis_conn = redis::RedisPool::getInstance().acquire();
+            redis_utils::RedisUpdateVideoStatus(redis_conn.get(), id, requests::VideoStatus::Failed);
         }
-    } else {
-        std::cout << "Failed to start video processing\n";
-        redis_utils::RedisUpdateVideoStatus(redis_conn, id, requests::VideoStatus::Failed);
-        utils::db::UpdateVideoStatus(id, requests::VideoStatusToString(requests::VideoStatus::Failed));
+        utils::db::StatusBatcher::getInstance().Update(id, requests::VideoStatus::Failed);
+        pipeline.ReleaseDuplicates(id);
+
+        res.code = 500;
+        res.write("Failed to start processing the video");
+        res.end();
+        return;
     }
-    redisFree(redis_conn);
+
+    res.code = 200;
+    res.write(id);
+    res.end();
 }
 
 /**
  * Handles the HTTP request for submitting a video.
+ * The request is saved to Redis without blocking the Crow worker thread, the submission is completed
+ * once Redis has acknowledged it, on the blocking pool where the video is also fingerprinted.
+ * The first stage is only dispatched, so the response is sent
+ * right away rather than once the video is processed.
+ * A video whose content has already been analyzed is finished right away with the earlier result,
+ * and one whose content is being analyzed waits for that analysis instead of running its own.
  * 
  * @param req The HTTP request object.
  * @param res The HTTP response object.
+ * @param pipeline The pipeline driving the video through the processing stages.
+ * @param async_redis The non-blocking Redis client.
+ * @param blocking_pool The threads completing the submission off the io_context.
  */
-void SubmitVideoHandler(const crow::request& req, crow::response& res) {
-    auto video_path = req.body;
-    std::string id = redis_utils::GenerateUUID();
-    requests::VideoRequest video_request = {id, video_path, requests::VideoStatus::Received};
-
-    // Connect to redis
-    const auto& config = cfg::GlobalConfig::getInstance();
-    const auto& redis = config.getRedis();
-    redisContext *redis_conn = redis_utils::RedisConnect(redis.host, redis.port);
-    if (redis_conn == nullptr) {
-        res.code = 500;
-        res.write("Redis connection error");
+void SubmitVideoHandler(const crow::request& req, crow::response& res, pipeline::Pipeline& pipeline,
+                        redis::AsyncRedis& async_redis, asio::thread_pool& blocking_pool) {
+    if (!pipeline.IsAcceptingVideos()) {
+        res.code = 503;
+        res.write("Video pre-processing service is unavailable");
         res.end();
         return;
     }
 
-    // Save request to redis
-    redis_utils::RedisSaveVideoRequest(redis_conn, video_request);
-
-    // Save video to database
-    utils::db::SaveRequestOnReceive(video_request.id);
-
-    // Create a RequestsChain and perform the first HTTP POST request
-    asio::io_context io_context;
-    auto chain = std::make_shared<utils::http::RequestsChain>(io_context); // Используем shared_ptr для цепочки запросов
-
-    crow::json::wvalue body;
-    body["redis_id"] = id;
-    body["video_path"] = video_path;
-
-    const auto& pre_processing = config.getVideoPreProcessing();
-    chain->AddRequest(pre_processing.host, std::to_string(pre_processing.port), "/process_video", body,
-    [chain, id](const crow::response& response) { // Используем shared_ptr для цепочки запросов
-        OnProcessVideoComplete(response, *chain, id);
-    });
-
-    redis_utils::RedisUpdateVideoStatus(redis_conn, id, requests::VideoStatus::PreProcessingStarted);
-    
-    io_context.post([chain] {
-        chain->Execute();
-    });
+    auto video_path = req.body;
+    std::string id = redis_utils::GenerateUUID();
 
-    res.code = 200;
-    res.write(id);
-    res.end();
+    // Save request to redis
+    std::vector<std::string> save_request = {
+        "HSET", "request:" + id,
+        "id", id,
+        "path", video_path,
+        "status", requests::VideoStatusToString(requests::VideoStatus::Received),
+    };
+    async_redis.Command(std::move(save_request),
+        [&res, &pipeline, &blocking_pool, id, video_path](const redis::Reply& reply) {
+            if (reply.IsError()) {
+                std::cerr << "Failed to save request " << id << " to Redis: " << reply.str << std::endl;
+                res.code = 500;
+                res.write("Redis connection error");
+                res.end();
+                return;
+            }
+            // The io_context threads must not wait for the database, they drive every request in flight
+            asio::post(blocking_pool, [&res, &pipeline, id, video_path] {
+                // An exception must not escape to the pool
+                try {
+                    // Identical files are recognized by a fingerprint of their content, which reads the file
+                    std::optional<std::string> fingerprint;
+                    if (cfg::GlobalConfig::getInstance().getDedup().enabled) {
+                        fingerprint = pipeline::ComputeFingerprint(video_path);
+                    }
+                    FinishSubmission(res, pipeline, id, video_path, fingerprint);
+                } catch (const std::exception& e) {
+                    std::cerr << "Failed to submit video " << id << ": " << e.what() << std::endl;
+                    res.code = 500;
+                    res.write(e.what());
+                    res.end();
+                }
+            });
+        });
 }
 
 } // namespace
 
-void BindSubmitVideoHandler(crow::SimpleApp& app) {
-    CROW_ROUTE(app, "/submit_video").methods(crow::HTTPMethod::POST)(SubmitVideoHandler);
+void BindSubmitVideoHandler(crow::SimpleApp& app, pipeline::Pipeline& pipeline, redis::AsyncRedis& async_redis,
+                            asio::thread_pool& blocking_pool) {
+    CROW_ROUTE(app, "/submit_video").methods(crow::HTTPMethod::POST)
+    ([&pipeline, &async_redis, &blocking_pool](const crow::request& req, crow::response& res) {
+        SubmitVideoHandler(req, res, pipeline, async_redis, blocking_pool);
+    });
 }
 
 } // namespace handlers
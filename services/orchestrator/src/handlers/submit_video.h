@@ -1,9 +1,15 @@
 #pragma once
 
+#include <asio.hpp>
 #include <crow.h>
 
+#include "../../utils/redis/async_redis.h"
+
+#include "../pipeline/pipeline.h"
+
 namespace handlers {
 
-void BindSubmitVideoHandler(crow::SimpleApp& app);
+void BindSubmitVideoHandler(crow::SimpleApp& app, pipeline::Pipeline& pipeline, redis::AsyncRedis& async_redis,
+                            asio::thread_pool& blocking_pool);
 
-} // namespace handlers
\ No newline at end of file
+} // namespace handlers
@@ -1,23 +1,133 @@
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <memory>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include <asio.hpp>
 #include <crow.h>
 
 #include "../../../utils/cfg/global_config.h"
+#include "../../../utils/http/health.h"
+#include "../../../utils/http/health_monitor.h"
+#include "../../../utils/http/http_client.h"
+#include "../../../utils/http/load_balancer.h"
+#include "../../../utils/redis/async_redis.h"
+#include "../../../utils/db/status_batcher.h"
 
 #include "handlers/handlers_frw.h"
+#include "pipeline/pipeline.h"
+#include "status/finished_cache.h"
+#include "status/status_hub.h"
 #include "tasks/migrations.h"
 
 int main()
 {
-    tasks::RunMigrations();
+    // The services must not run against a schema they do not expect
+    if (!tasks::RunMigrations()) {
+        std::cerr << "Failed to apply the database migrations" << std::endl;
+        return 1;
+    }
+
+    // One long-lived io_context drives the outgoing requests of every video in flight
+    asio::io_context io_context;
+    auto work_guard = asio::make_work_guard(io_context);
+
+    const std::size_t io_threads_count = std::max(2u, std::thread::hardware_concurrency());
+    std::vector<std::thread> io_threads;
+    io_threads.reserve(io_threads_count);
+    for (std::size_t i = 0; i < io_threads_count; ++i) {
+        io_threads.emplace_back([&io_context] {
+            io_context.run();
+        });
+    }
+
+    // Keep-alive connections to the pipeline services, shared by all videos
+    utils::http::HttpClient http_client(io_context);
+
+    // Background liveness probes and circuit breakers of the pipeline services
+    const auto& config = cfg::GlobalConfig::getInstance();
+    const auto& health_config = config.getHealth();
+    utils::http::HealthMonitor::Options health_options;
+    health_options.probe_interval = std::chrono::milliseconds(health_config.probe_interval_ms);
+    health_options.probe_timeout = std::chrono::milliseconds(health_config.probe_timeout_ms);
+    health_options.failure_threshold = health_config.failure_threshold;
+    health_options.open_duration = std::chrono::milliseconds(health_config.open_duration_ms);
+    utils::http::HealthMonitor health_monitor(http_client, health_options);
+
+    // Every instance of a pipeline service is probed and balanced separately
+    utils::http::LoadBalancer load_balancer(health_monitor);
+    const std::pair<pipeline::Stage, const std::vector<cfg::GlobalConfig::ServiceData>*> services[] = {
+        {pipeline::Stage::PreProcessing, &config.getVideoPreProcessingInstances()},
+        {pipeline::Stage::FrameAnalytics, &config.getFrameAnalyticsInstances()},
+        {pipeline::Stage::PostProcessing, &config.getVideoPostProcessingInstances()},
+    };
+    for (const auto& [stage, instances] : services) {
+        for (const auto& instance : *instances) {
+            health_monitor.AddService(instance.host, instance.port);
+            load_balancer.AddInstance(pipeline::StageToString(stage), instance.host, instance.port);
+        }
+    }
+    health_monitor.Start();
+
+    // Statuses are written to the database in batches, off the request path
+    auto& status_batcher = utils::db::StatusBatcher::getInstance();
+    status_batcher.Start();
+
+    // Dispatches the stages of submitted videos and, in queue mode, consumes their outcomes
+    pipeline::Pipeline video_pipeline(http_client, health_monitor, load_balancer);
+    video_pipeline.StartEventsConsumer();
+
+    // Non-blocking Redis client of the request handlers, so that they do not hold Crow worker threads
+    const auto& redis_config = config.getRedis();
+    redis::AsyncRedis async_redis(io_context, redis_config.host, static_cast<int>(redis_config.port));
+
+    // Status responses of finished videos, answered from memory instead of the database
+    std::unique_ptr<status::FinishedCache> finished_cache;
+    const auto& finished_cache_config = config.getFinishedCache();
+    if (finished_cache_config.enabled) {
+        status::FinishedCache::Options finished_cache_options;
+        finished_cache_options.max_bytes = finished_cache_config.max_bytes;
+        finished_cache = std::make_unique<status::FinishedCache>(finished_cache_options);
+    }
+
+    // Status changes published by the stages, pushed to the clients long-polling them.
+    // A subscribed connection cannot run other commands, so the hub has its own.
+    redis::AsyncRedis status_subscriber(io_context, redis_config.host, static_cast<int>(redis_config.port));
+    status::StatusHub status_hub(io_context, status_subscriber, config.getStatusUpdates().max_waiters,
+                                 finished_cache.get());
+    status_hub.Start();
+
+    // The handlers continue on these threads when they have to wait for the database or for pooled
+    // connections, the io_context threads only run non-blocking work. One thread per database connection.
+    asio::thread_pool blocking_pool(config.getPgPool().size);
 
     crow::SimpleApp app;
 
-    handlers::BindSubmitVideoHandler(app);
-    handlers::BindStatusHandler(app);
+    handlers::BindSubmitVideoHandler(app, video_pipeline, async_redis, blocking_pool);
+    handlers::BindStatusHandler(app, async_redis, blocking_pool, finished_cache.get());
+    handlers::BindStatusBatchHandler(app, async_redis, blocking_pool);
+    handlers::BindStatusStreamHandler(app, async_redis, blocking_pool, status_hub);
     handlers::BindStopHandler(app);
+    handlers::BindDetectionsSearchHandler(app);
+    handlers::BindMetricsHandler(app, finished_cache.get());
+    utils::http::BindHealthHandler(app);
 
-    const auto& config = cfg::GlobalConfig::getInstance();
     const auto& app_config = config.getOrchestrator();
     app.port(app_config.port).multithreaded().run();
 
+    blocking_pool.join();
+
+    video_pipeline.Stop();
+    health_monitor.Stop();
+    status_batcher.Stop();
+    work_guard.reset();
+    io_context.stop();
+    for (auto& thread : io_threads) {
+        thread.join();
+    }
+
     return 0;
 }
@@ -0,0 +1,271 @@
+#include "dedup.h"
+
+#include <cstdarg>
+#include <cstdint>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <vector>
+
+#include "../../utils/http/requests.h"
+#include "../../utils/redis/redis.h"
+#include "../../utils/cfg/global_config.h"
+#include "../../utils/db/pg.h"
+#include "../../utils/db/status_batcher.h"
+
+namespace pipeline {
+
+namespace {
+
+constexpr std::size_t kFingerprintBlocks = 16;
+constexpr std::size_t kFingerprintBlockSize = 64 * 1024;
+
+constexpr std::uint64_t kFnvOffsetBasis = 0xcbf29ce484222325ull;
+constexpr std::uint64_t kFnvPrime = 0x100000001b3ull;
+
+std::string GetFingerprintKey(const std::string& fingerprint) {
+    return "fingerprint:" + fingerprint;
+}
+
+std::string GetFollowersKey(const std::string& id) {
+    return "followers:" + id;
+}
+
+/**
+ * Runs a Redis command whose reply is an integer.
+ *
+ * @return The integer, or std::nullopt if the command failed.
+ */
+std::optional<long long> RedisInteger(redisContext *redis_conn, const char* format, ...) {
+    va_list args;
+    va_start(args, format);
+    redisReply *reply = static_cast<redisReply*>(redisvCommand(redis_conn, format, args));
+    va_end(args);
+    if (reply == nullptr) {
+        std::cerr << "Redis command failed: " << redis_conn->errstr << std::endl;
+        return std::nullopt;
+    }
+    std::optional<long long> result;
+    if (reply->type == REDIS_REPLY_INTEGER) {
+        result = reply->integer;
+    }
+    freeReplyObject(reply);
+    return result;
+}
+
+/**
+ * Returns the value of a Redis string, or std::nullopt if it does not exist.
+ */
+std::optional<std::string> RedisString(redisContext *redis_conn, const char* format, ...) {
+    va_list args;
+    va_start(args, format);
+    redisReply *reply = static_cast<redisReply*>(redisvCommand(redis_conn, format, args));
+    va_end(args);
+    if (reply == nullptr) {
+        std::cerr << "Redis command failed: " << redis_conn->errstr << std::endl;
+        return std::nullopt;
+    }
+    std::optional<std::string> result;
+    if (reply->type == REDIS_REPLY_STRING) {
+        result = std::string(reply->str, reply->len);
+    }
+    freeReplyObject(reply);
+    return result;
+}
+
+/**
+ * Registers a video as the one processing the content with the given fingerprint, unless another one is.
+ *
+ * @return True if the video is now the leader of the fingerprint, false otherwise.
+ */
+bool TryBecomeLeader(redisContext *redis_conn, const std::string& fingerprint, const std::string& id) {
+    const std::string ttl = std::to_string(cfg::GlobalConfig::getInstance().getDedup().in_flight_ttl_s);
+    redisReply *reply = static_cast<redisReply*>(redisCommand(redis_conn, "SET %s %s NX EX %s",
+                                                               GetFingerprintKey(fingerprint).c_str(),
+                                                               id.c_str(), ttl.c_str()));
+    if (reply == nullptr) {
+        std::cerr << "Redis command failed: " << redis_conn->errstr << std::endl;
+        return false;
+    }
+    const bool is_leader = reply->type == REDIS_REPLY_STATUS;
+    freeReplyObject(reply);
+    return is_leader;
+}
+
+/**
+ * Unregisters the leader of a fingerprint, if it still is the given video.
+ */
+void RemoveLeader(redisContext *redis_conn, const std::string& fingerprint, const std::string& id) {
+    RedisInteger(redis_conn,
+                 "EVAL %s 1 %s %s",
+                 "if redis.call('GET', KEYS[1]) == ARGV[1] then return redis.call('DEL', KEYS[1]) end return 0",
+                 GetFingerprintKey(fingerprint).c_str(), id.c_str());
+}
+
+/**
+ * Copies the finished result of another video with the same fingerprint.
+ *
+ * @return True if a result has been copied and the video is finished, false otherwise.
+ */
+bool ReuseResult(redisContext *redis_conn, const std::string& id, const std::string& fingerprint) {
+    if (!utils::db::ReuseFinishedResult(id, fingerprint)) {
+        return false;
+    }
+    redis_utils::RedisUpdateVideoStatus(redis_conn, id, requests::VideoStatus::Finished);
+    std::cout << "Reused the result of an identical video for " << id << std::endl;
+    return true;
+}
+
+void MarkFollowerFailed(redisContext *redis_conn, const std::string& id) {
+    redis_utils::RedisUpdateVideoStatus(redis_conn, id, requests::VideoStatus::Failed);
+    utils::db::StatusBatcher::getInstance().Update(id, requests::VideoStatus::Failed);
+}
+
+} // namespace
+
+std::optional<std::string> ComputeFingerprint(const std::string& video_path) {
+    std::error_code ec;
+    const std::uintmax_t size = std::filesystem::file_size(video_path, ec);
+    if (ec) {
+        return std::nullopt;
+    }
+    std::ifstream file(video_path, std::ios::binary);
+    if (!file) {
+        return std::nullopt;
+    }
+
+    // Two FNV-1a lanes with different seeds make a 128-bit hash of the size and the sampled blocks
+    std::uint64_t lanes[2] = {kFnvOffsetBasis, kFnvOffsetBasis ^ 0x9e3779b97f4a7c15ull};
+    const auto mix = [&lanes](const unsigned char* data, const std::size_t length) {
+        for (std::size_t i = 0; i < length; ++i) {
+            lanes[0] = (lanes[0] ^ data[i]) * kFnvPrime;
+            lanes[1] = (lanes[1] ^ data[i] ^ static_cast<unsigned char>(i)) * kFnvPrime;
+        }
+    };
+    const std::uint64_t size_value = size;
+    mix(reinterpret_cast<const unsigned char*>(&size_value), sizeof(size_value));
+
+    // Blocks at evenly spaced offsets, the first one at the start and the last one at the end of the file
+    std::vector<char> block(kFingerprintBlockSize);
+    const std::uintmax_t blocks_span = size > kFingerprintBlockSize ? size - kFingerprintBlockSize : 0;
+    const std::size_t blocks_count = size > kFingerprintBlocks * kFingerprintBlockSize ? kFingerprintBlocks
+        : static_cast<std::size_t>((size + kFingerprintBlockSize - 1) / kFingerprintBlockSize);
+    for (std::size_t i = 0; i < blocks_count; ++i) {
+        const std::uintmax_t offset = size > kFingerprintBlocks * kFingerprintBlockSize
+            ? (blocks_count > 1 ? blocks_span * i / (blocks_count - 1) : 0)
+            : i * kFingerprintBlockSize;
+        file.seekg(static_cast<std::streamoff>(offset));
+        file.read(block.data(), static_cast<std::streamsize>(block.size()));
+        const auto read = file.gcount();
+        if (read <= 0) {
+            return std::nullopt;
+        }
+        mix(reinterpret_cast<const unsigned char*>(block.data()), static_cast<std::size_t>(read));
+        file.clear();
+    }
+
+    char fingerprint[64];
+    std::snprintf(fingerprint, sizeof(fingerprint), "%llx-%016llx%016llx", static_cast<unsigned long long>(size),
+                  static_cast<unsigned long long>(lanes[0]), static_cast<unsigned long long>(lanes[1]));
+    return std::string(fingerprint);
+}
+
+SubmissionRole ClaimSubmission(redisContext *redis_conn, const std::string& id, const std::string& fingerprint) {
+    // The fingerprint is needed again once the video is finished
+    RedisInteger(redis_conn, "HSET request:%s fingerprint %s", id.c_str(), fingerprint.c_str());
+
+    if (ReuseResult(redis_conn, id, fingerprint)) {
+        return SubmissionRole::Reused;
+    }
+
+    // Retried once when the leader finishes while the video is being registered
+    for (int attempt = 0; attempt < 2; ++attempt) {
+        if (TryBecomeLeader(redis_conn, fingerprint, id)) {
+            return SubmissionRole::Leader;
+        }
+        const auto leader = RedisString(redis_conn, "GET %s", GetFingerprintKey(fingerprint).c_str());
+        if (!leader.has_value()) {
+            continue;
+        }
+
+        const std::string followers_key = GetFollowersKey(leader.value());
+        RedisInteger(redis_conn, "SADD %s %s", followers_key.c_str(), id.c_str());
+        const std::string ttl = std::to_string(cfg::GlobalConfig::getInstance().getDedup().in_flight_ttl_s);
+        RedisInteger(redis_conn, "EXPIRE %s %s", followers_key.c_str(), ttl.c_str());
+
+        // The leader may have released its followers before this one joined
+        const auto leader_status = redis_utils::RedisGetRequestVideoStatus(redis_conn, leader.value());
+        if (leader_status.has_value() && !requests::IsFinalVideoStatus(leader_status.value())) {
+            return SubmissionRole::Follower;
+        }
+        // Whoever removes the follower from the set hands the result over to it
+        const auto removed = RedisInteger(redis_conn, "SREM %s %s", followers_key.c_str(), id.c_str());
+        if (!removed.has_value() || removed.value() == 0) {
+            return SubmissionRole::Follower;
+        }
+        if (ReuseResult(redis_conn, id, fingerprint)) {
+            return SubmissionRole::Reused;
+        }
+        RemoveLeader(redis_conn, fingerprint, leader.value());
+    }
+    return SubmissionRole::Leader;
+}
+
+std::vector<std::string> ReleaseSubmission(redisContext *redis_conn, const std::string& id) {
+    std::vector<std::string> to_process;
+    const auto status = redis_utils::RedisGetRequestVideoStatus(redis_conn, id);
+    if (!status.has_value() || !requests::IsFinalVideoStatus(status.value())) {
+        return to_process;
+    }
+    const auto fingerprint = RedisString(redis_conn, "HGET request:%s fingerprint", id.c_str());
+    if (!fingerprint.has_value()) {
+        return to_process;
+    }
+    RemoveLeader(redis_conn, fingerprint.value(), id);
+
+    const std::string followers_key = GetFollowersKey(id);
+    redisReply *reply = static_cast<redisReply*>(redisCommand(redis_conn, "SMEMBERS %s", followers_key.c_str()));
+    if (reply == nullptr) {
+        std::cerr << "Redis command failed: " << redis_conn->errstr << std::endl;
+        return to_process;
+    }
+    std::vector<std::string> followers;
+    if (reply->type == REDIS_REPLY_ARRAY) {
+        for (std::size_t i = 0; i < reply->elements; ++i) {
+            followers.emplace_back(reply->element[i]->str, reply->element[i]->len);
+        }
+    }
+    freeReplyObject(reply);
+
+    for (const auto& follower : followers) {
+        const auto removed = RedisInteger(redis_conn, "SREM %s %s", followers_key.c_str(), follower.c_str());
+        if (!removed.has_value() || removed.value() == 0) {
+            continue;
+        }
+        const auto follower_status = redis_utils::RedisGetRequestVideoStatus(redis_conn, follower);
+        if (follower_status.has_value() && follower_status.value() == requests::VideoStatus::Stopped) {
+            continue;
+        }
+
+        switch (status.value()) {
+        case requests::VideoStatus::Finished:
+            if (!ReuseResult(redis_conn, follower, fingerprint.value())) {
+                MarkFollowerFailed(redis_conn, follower);
+            }
+            break;
+        case requests::VideoStatus::Stopped:
+            // The content still has to be processed for the followers, one of them takes over
+            if (ClaimSubmission(redis_conn, follower, fingerprint.value()) == SubmissionRole::Leader) {
+                to_process.push_back(follower);
+            }
+            break;
+        default:
+            MarkFollowerFailed(redis_conn, follower);
+            break;
+        }
+    }
+    return to_process;
+}
+
+} // namespace pipeline
@@ -0,0 +1,57 @@
+#pragma once
+
+#include <optional>
+#include <string>
+#include <vector>
+
+#include <hiredis.h>
+
+namespace pipeline {
+
+/**
+ * @brief Computes a fast content fingerprint of a video file from its size and evenly spaced blocks
+ *        of its content, so that big files are fingerprinted without being read whole.
+ *
+ * @param video_path The path to the video file.
+ * @return The fingerprint, or std::nullopt if the file cannot be read.
+ */
+std::optional<std::string> ComputeFingerprint(const std::string& video_path);
+
+enum class SubmissionRole {
+    // The result of an earlier video with the same content has been copied, nothing to run
+    Reused,
+    // The video has to be processed
+    Leader,
+    // An identical video is being processed, its result will be copied once it finishes
+    Follower
+};
+
+/**
+ * @brief Decides how a submitted video is served, given the fingerprint of its content.
+ *
+ * A finished result with the same fingerprint is reused right away. Otherwise the first submission
+ * of the content becomes the leader, registered under the fingerprint with SET NX, and concurrent
+ * identical submissions join the leader's followers instead of being processed again.
+ * The request of the video must already be saved to Redis and the database.
+ *
+ * @param redis_conn The Redis connection.
+ * @param id The ID of the submitted video.
+ * @param fingerprint The fingerprint of the video.
+ * @return The role of the submitted video.
+ */
+SubmissionRole ClaimSubmission(redisContext *redis_conn, const std::string& id, const std::string& fingerprint);
+
+/**
+ * @brief Hands the outcome of a video that reached a final status over to its followers.
+ *
+ * Followers of a finished video get a copy of its result and followers of a failed one fail as well.
+ * When the video has been stopped, its first follower becomes the new leader and has to be processed,
+ * the other followers follow the new leader. Does nothing if the video has no final status yet.
+ *
+ * @param redis_conn The Redis connection.
+ * @param id The ID of the video.
+ * @return The IDs of the followers to process instead of the stopped video.
+ */
+std::vector<std::string> ReleaseSubmission(redisContext *redis_conn, const std::string& id);
+
+} // namespace pipeline
@@ -0,0 +1,430 @@
+#include "pipeline.h"
+
+#include <filesystem>
+#include <iostream>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+#include "../../utils/http/requests.h"
+#include "../../utils/redis/redis.h"
+#include "../../utils/redis/redis_pool.h"
+#include "../../utils/redis/stage_jobs.h"
+#include "../../utils/cfg/global_config.h"
+#include "../../utils/db/pg.h"
+#include "../../utils/db/status_batcher.h"
+
+#include "dedup.h"
+
+namespace pipeline {
+
+namespace {
+
+/**
+ * Returns the HTTP endpoint of the given stage.
+ */
+std::string GetStageTarget(const Stage stage) {
+    switch (stage) {
+    case Stage::PreProcessing:
+        return "/process_video";
+    case Stage::FrameAnalytics:
+        return "/yolo_analyze_frames";
+    case Stage::PostProcessing:
+        return "/save_video";
+    }
+    throw std::runtime_error("Unknown Stage at GetStageTarget()");
+}
+
+/**
+ * Returns the work queue of the given stage.
+ */
+std::string GetStageStream(const Stage stage) {
+    switch (stage) {
+    case Stage::PreProcessing:
+        return redis_utils::kPreProcessingStream;
+    case Stage::FrameAnalytics:
+        return redis_utils::kFrameAnalyticsStream;
+    case Stage::PostProcessing:
+        return redis_utils::kPostProcessingStream;
+    }
+    throw std::runtime_error("Unknown Stage at GetStageStream()");
+}
+
+/**
+ * Builds the job body of a stage following the pre-processing stage.
+ *
+ * @param stage The stage to build the body for.
+ * @param id The ID of the video.
+ */
+crow::json::wvalue MakeStageBody(const Stage stage, const std::string& id) {
+    crow::json::wvalue body;
+    body["redis_id"] = id;
+    if (stage == Stage::FrameAnalytics) {
+        body["frames_path"] = std::filesystem::absolute("../../../tmp/frames/frames-" + id).string();
+    }
+    return body;
+}
+
+/**
+ * Marks the video as failed both in Redis and in the database, unless it already has a final status.
+ *
+ * @param redis_conn The Redis connection, may be nullptr.
+ * @param id The ID of the video.
+ */
+void MarkVideoFailed(redisContext *redis_conn, const std::string& id) {
+    const auto transition = redis_utils::RedisUpdateVideoStatus(redis_conn, id, requests::VideoStatus::Failed);
+    if (transition.result == redis_utils::StatusTransition::Result::Rejected) {
+        return;
+    }
+    utils::db::StatusBatcher::getInstance().Update(id, requests::VideoStatus::Failed);
+}
+
+/**
+ * Returns the status a video gets once the given stage has succeeded.
+ */
+requests::VideoStatus GetStageFinishedStatus(const Stage stage) {
+    switch (stage) {
+    case Stage::PreProcessing:
+        return requests::VideoStatus::PreProcessingFinished;
+    case Stage::FrameAnalytics:
+        return requests::VideoStatus::YoloFinished;
+    case Stage::PostProcessing:
+        return requests::VideoStatus::Finished;
+    }
+    throw std::runtime_error("Unknown Stage at GetStageFinishedStatus()");
+}
+
+/**
+ * Returns the stage that follows the given one, std::nullopt for the last stage.
+ */
+std::optional<Stage> GetNextStage(const Stage stage) {
+    switch (stage) {
+    case Stage::PreProcessing:
+        return Stage::FrameAnalytics;
+    case Stage::FrameAnalytics:
+        return Stage::PostProcessing;
+    case Stage::PostProcessing:
+        return std::nullopt;
+    }
+    return std::nullopt;
+}
+
+/**
+ * Returns the status a video gets when the given stage is started.
+ */
+requests::VideoStatus GetStageStartedStatus(const Stage stage) {
+    switch (stage) {
+    case Stage::PreProcessing:
+        return requests::VideoStatus::PreProcessingStarted;
+    case Stage::FrameAnalytics:
+        return requests::VideoStatus::YoloStarted;
+    case Stage::PostProcessing:
+        return requests::VideoStatus::PostProcessing;
+    }
+    throw std::runtime_error("Unknown Stage at GetStageStartedStatus()");
+}
+
+/**
+ * Sets the status of a video whose stage is being started, in Redis and, with the next batch, in the database.
+ *
+ * @param stage The stage being started.
+ * @param id The ID of the video.
+ */
+void MarkStageStarted(const Stage stage, const std::string& id) {
+    auto redis_conn = redis::RedisPool::getInstance().acquire();
+    if (!redis_conn) {
+        return;
+    }
+
+    const auto started_status = GetStageStartedStatus(stage);
+    if (redis_utils::RedisUpdateVideoStatus(redis_conn.get(), id, started_status).applied()) {
+        utils::db::StatusBatcher::getInstance().Update(id, started_status);
+    }
+}
+
+/**
+ * Records the outcome of a stage in the status of the video.
+ *
+ * @param stage The finished stage.
+ * @param id The ID of the video.
+ * @param code The HTTP status code the stage answered with.
+ * @param message The response body of the stage.
+ * @return The next stage to run, or std::nullopt if the video is finished, failed or stopped.
+ */
+std::optional<Stage> CompleteStage(const Stage stage, const std::string& id, const int code,
+                                   const std::string& message) {
+    auto pooled_conn = redis::RedisPool::getInstance().acquire();
+    if (!pooled_conn) {
+        return std::nullopt;
+    }
+    redisContext *redis_conn = pooled_conn.get();
+
+    if (code == requests::kStageSkippedCode) {
+        std::cout << "Stage " << StageToString(stage) << " skipped for video " << id
+                  << ", it has already moved past the stage" << std::endl;
+        return std::nullopt;
+    }
+
+    // A video with a final status, stopped in particular, is neither continued nor overwritten
+    // by the failure of its interrupted stage, the status transitions reject both
+    if (code != 200) {
+        std::cout << "Stage " << StageToString(stage) << " failed for video " << id
+                  << ". Response.body: " << message << std::endl;
+        MarkVideoFailed(redis_conn, id);
+        return std::nullopt;
+    }
+
+    const auto finished_status = GetStageFinishedStatus(stage);
+    const auto transition = redis_utils::RedisUpdateVideoStatus(redis_conn, id, finished_status);
+    if (transition.result == redis_utils::StatusTransition::Result::Rejected && transition.previous.has_value()) {
+        // A redelivered event of a stage the video has already moved past. The next stage is enqueued again
+        // only if the event was not acknowledged after the next stage had been marked started, which is when
+        // its job may have been lost; any later status means that the next stage has run or is running.
+        // The event of a stage whose finished status is still set is applied again and continued below.
+        const auto next_stage = GetNextStage(stage);
+        if (next_stage.has_value() && transition.previous.value() == GetStageStartedStatus(next_stage.value())) {
+            return next_stage;
+        }
+        return std::nullopt;
+    }
+    if (!transition.applied()) {
+        return std::nullopt;
+    }
+
+    if (stage == Stage::PostProcessing) {
+        std::cout << "Video analysis saved successfully\n";
+    }
+    utils::db::StatusBatcher::getInstance().Update(id, finished_status);
+    return GetNextStage(stage);
+}
+
+} // namespace
+
+/**
+ * Converts a Stage enum value to its string representation, which is also the name of the stage's
+ * service in the config and the consumer group of its stream.
+ *
+ * @param stage The Stage enum value to convert.
+ * @return The string representation of the Stage enum value.
+ */
+std::string StageToString(const Stage stage) {
+    switch (stage) {
+    case Stage::PreProcessing:
+        return "video-pre-processing";
+    case Stage::FrameAnalytics:
+        return "frame-analytics";
+    case Stage::PostProcessing:
+        return "video-post-processing";
+    }
+    throw std::runtime_error("Unknown Stage at StageToString()");
+}
+
+/**
+ * Converts a string representation of Stage to its enum value.
+ *
+ * @param stage_str The string representation of Stage to convert.
+ * @return The Stage enum value, or std::nullopt if the string is unknown.
+ */
+std::optional<Stage> StringToStage(const std::string& stage_str) {
+    if (stage_str == "video-pre-processing") {
+        return Stage::PreProcessing;
+    } else if (stage_str == "frame-analytics") {
+        return Stage::FrameAnalytics;
+    } else if (stage_str == "video-post-processing") {
+        return Stage::PostProcessing;
+    }
+    return std::nullopt;
+}
+
+Pipeline::Pipeline(utils::http::HttpClient& http_client, utils::http::HealthMonitor& health,
+                   utils::http::LoadBalancer& balancer)
+    : http_client_(http_client), health_(health), balancer_(balancer),
+      use_queue_(cfg::GlobalConfig::getInstance().getQueue().dispatch == cfg::GlobalConfig::DispatchMode::Queue) {}
+
+Pipeline::~Pipeline() {
+    Stop();
+}
+
+bool Pipeline::IsAcceptingVideos() {
+    if (use_queue_) {
+        return true;
+    }
+    return balancer_.HasHealthyInstance(StageToString(Stage::PreProcessing));
+}
+
+bool Pipeline::Start(const std::string& id, const std::string& video_path) {
+    crow::json::wvalue body;
+    body["redis_id"] = id;
+    body["video_path"] = video_path;
+
+    if (use_queue_) {
+        MarkStageStarted(Stage::PreProcessing, id);
+        return EnqueueStage(Stage::PreProcessing, id, body);
+    }
+
+    auto chain = std::make_shared<utils::http::RequestsChain>(http_client_, &health_);
+    return RunStageOverHttp(chain, Stage::PreProcessing, id, body);
+}
+
+void Pipeline::ReleaseDuplicates(const std::string& id) {
+    if (!cfg::GlobalConfig::getInstance().getDedup().enabled) {
+        return;
+    }
+    std::vector<std::pair<std::string, std::string>> to_start;
+    {
+        auto redis_conn = redis::RedisPool::getInstance().acquire();
+        if (!redis_conn) {
+            return;
+        }
+        for (const auto& duplicate_id : ReleaseSubmission(redis_conn.get(), id)) {
+            redisReply *reply = redis_utils::RedisGetByKey(redis_conn.get(), "HGET request:%s path",
+                                                           duplicate_id.c_str());
+            if (reply == nullptr) {
+                continue;
+            }
+            to_start.emplace_back(duplicate_id, std::string(reply->str, reply->len));
+            freeReplyObject(reply);
+        }
+    }
+
+    // Started without holding a connection, starting a video checks connections out itself
+    for (const auto& [duplicate_id, video_path] : to_start) {
+        std::cout << "Video " << id << " has been stopped, processing its duplicate " << duplicate_id << std::endl;
+        if (!Start(duplicate_id, video_path)) {
+            {
+                auto redis_conn = redis::RedisPool::getInstance().acquire();
+                MarkVideoFailed(redis_conn.get(), duplicate_id);
+            }
+            ReleaseDuplicates(duplicate_id);
+        }
+    }
+}
+
+void Pipeline::StartEventsConsumer() {
+    if (!use_queue_ || events_worker_) {
+        return;
+    }
+
+    const auto& queue = cfg::GlobalConfig::getInstance().getQueue();
+    redis::StreamWorker::Options options;
+    options.consumers = queue.consumers;
+    options.block_ms = queue.block_ms;
+    options.claim_idle_ms = queue.claim_idle_ms;
+    options.max_deliveries = queue.max_deliveries;
+
+    events_worker_ = std::make_unique<redis::StreamWorker>(redis_utils::kPipelineEventsStream, "orchestrator",
+        // Events are handled long before their claim could expire, the lease is not checked
+        [this](const redis_utils::StreamEntry& entry, const redis::StreamWorker::Lease&) {
+            return OnStageEvent(entry);
+        },
+        [this](const redis_utils::StreamEntry& entry, const redis::StreamWorker::Lease&) {
+            {
+                auto redis_conn = redis::RedisPool::getInstance().acquire();
+                MarkVideoFailed(redis_conn.get(), entry.Get("id"));
+            }
+            ReleaseDuplicates(entry.Get("id"));
+            return true;
+        },
+        options);
+    events_worker_->Start();
+}
+
+void Pipeline::Stop() {
+    if (events_worker_) {
+        events_worker_->Stop();
+        events_worker_.reset();
+    }
+}
+
+/**
+ * Runs a stage over HTTP on the least loaded instance of its service.
+ * The response handler records the outcome and starts the next stage on the same chain.
+ *
+ * @param chain The requests chain of the video.
+ * @param stage The stage to run.
+ * @param id The ID of the video.
+ * @param body The job body of the stage.
+ * @return True if the stage has been dispatched, false if no instance of its service is available.
+ */
+bool Pipeline::RunStageOverHttp(const ChainPtr& chain, const Stage stage, const std::string& id,
+                                const crow::json::wvalue& body) {
+    const std::string service = StageToString(stage);
+    const auto instance = balancer_.Acquire(service);
+    if (!instance.has_value()) {
+        std::cerr << "No healthy instance of " << service << " for video " << id << std::endl;
+        return false;
+    }
+
+    chain->AddRequest(instance->host, instance->port, GetStageTarget(stage), body,
+        [this, chain, stage, id, service, acquired = instance.value()](const crow::response& response) {
+            balancer_.Release(service, acquired);
+
+            const auto next_stage = CompleteStage(stage, id, response.code, response.body);
+            if (!next_stage.has_value()) {
+                ReleaseDuplicates(id);
+            } else if (!RunStageOverHttp(chain, next_stage.value(), id, MakeStageBody(next_stage.value(), id))) {
+                CompleteStage(next_stage.value(), id, 503, "No healthy instance of the service");
+                ReleaseDuplicates(id);
+            }
+        });
+
+    MarkStageStarted(stage, id);
+    chain->Execute();
+    return true;
+}
+
+/**
+ * Adds a stage job to the stage's stream.
+ *
+ * @param stage The stage to run.
+ * @param id The ID of the video.
+ * @param body The job body of the stage.
+ * @return True if the job was queued, false otherwise.
+ */
+bool Pipeline::EnqueueStage(const Stage stage, const std::string& id, const crow::json::wvalue& body) {
+    auto redis_conn = redis::RedisPool::getInstance().acquire();
+    if (!redis_conn) {
+        return false;
+    }
+
+    const auto entry_id = redis_utils::RedisEnqueueStageJob(redis_conn.get(), GetStageStream(stage), body.dump());
+    if (!entry_id.has_value()) {
+        std::cerr << "Failed to enqueue " << StageToString(stage) << " job for video " << id << std::endl;
+        return false;
+    }
+    return true;
+}
+
+/**
+ * Handles the outcome of a stage reported on the events stream and enqueues the next stage.
+ *
+ * @param entry The event.
+ * @return True if the event has been handled and can be acknowledged.
+ */
+bool Pipeline::OnStageEvent(const redis_utils::StreamEntry& entry) {
+    const std::string id = entry.Get("id");
+    const auto stage = StringToStage(entry.Get("stage"));
+    if (id.empty() || !stage.has_value()) {
+        std::cerr << "Dropping malformed pipeline event " << entry.id << std::endl;
+        return true;
+    }
+
+    int code = 500;
+    try {
+        code = std::stoi(entry.Get("code"));
+    } catch (const std::exception&) {
+        std::cerr << "Malformed code in pipeline event " << entry.id << std::endl;
+    }
+
+    const auto next_stage = CompleteStage(stage.value(), id, code, entry.Get("message"));
+    if (!next_stage.has_value()) {
+        ReleaseDuplicates(id);
+        return true;
+    }
+
+    MarkStageStarted(next_stage.value(), id);
+    // Not acknowledging the event makes it redelivered, so the next stage is enqueued later
+    return EnqueueStage(next_stage.value(), id, MakeStageBody(next_stage.value(), id));
+}
+
+} // namespace pipeline
@@ -0,0 +1,91 @@
+#pragma once
+
+#include <memory>
+#include <optional>
+#include <string>
+
+#include <crow.h>
+
+#include "../../utils/http/health_monitor.h"
+#include "../../utils/http/http_client.h"
+#include "../../utils/http/load_balancer.h"
+#include "../../utils/http/requests_chain.h"
+#include "../../utils/redis/redis_stream.h"
+#include "../../utils/redis/stream_worker.h"
+
+namespace pipeline {
+
+enum class Stage {
+    PreProcessing,
+    FrameAnalytics,
+    PostProcessing
+};
+
+std::string StageToString(Stage stage);
+std::optional<Stage> StringToStage(const std::string& stage_str);
+
+/**
+ * @brief Drives submitted videos through the processing stages.
+ *
+ * With the HTTP dispatch mode every stage is called through a RequestsChain and the next stage is started
+ * from the response handler of the previous one; each request goes to the least loaded healthy instance
+ * of the stage's service. With the queue dispatch mode every stage job is added to
+ * the stage's Redis Stream; the stages report their outcome on the events stream, which the pipeline
+ * consumes to start the next stage. The queue mode survives restarts of any service, because a job or an
+ * event is acknowledged only after it has been fully handled.
+ */
+class Pipeline {
+public:
+    Pipeline(utils::http::HttpClient& http_client, utils::http::HealthMonitor& health,
+             utils::http::LoadBalancer& balancer);
+    ~Pipeline();
+
+    Pipeline(const Pipeline&) = delete;
+    Pipeline& operator=(const Pipeline&) = delete;
+
+    /**
+     * @brief Tells whether new videos can be accepted right now.
+     * With the HTTP dispatch mode a video is rejected while every pre-processing instance is down;
+     * with the queue dispatch mode the job simply waits in the queue.
+     */
+    bool IsAcceptingVideos();
+
+    /**
+     * @brief Starts processing a video whose request has already been saved.
+     *
+     * @param id The ID of the video.
+     * @param video_path The path to the video file.
+     * @return True if the first stage has been dispatched, false otherwise.
+     */
+    bool Start(const std::string& id, const std::string& video_path);
+
+    /**
+     * @brief Hands the outcome of a video that reached a final status over to the identical videos
+     *        waiting for it, and starts processing one of them if the video has been stopped.
+     *
+     * @param id The ID of the video.
+     */
+    void ReleaseDuplicates(const std::string& id);
+
+    /**
+     * @brief Starts consuming the events stream when the queue dispatch mode is enabled.
+     */
+    void StartEventsConsumer();
+    void Stop();
+
+private:
+    using ChainPtr = std::shared_ptr<utils::http::RequestsChain>;
+
+    bool RunStageOverHttp(const ChainPtr& chain, Stage stage, const std::string& id,
+                          const crow::json::wvalue& body);
+    bool EnqueueStage(Stage stage, const std::string& id, const crow::json::wvalue& body);
+    bool OnStageEvent(const redis_utils::StreamEntry& entry);
+
+    utils::http::HttpClient& http_client_;
+    utils::http::HealthMonitor& health_;
+    utils::http::LoadBalancer& balancer_;
+    bool use_queue_;
+    std::unique_ptr<redis::StreamWorker> events_worker_;
+};
+
+} // namespace pipeline
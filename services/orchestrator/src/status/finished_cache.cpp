@@ -0,0 +1,86 @@
+#include "finished_cache.h"
+
+#include <utility>
+
+namespace status {
+
+FinishedCache::FinishedCache(Options options)
+    : options_(options) {
+}
+
+/**
+ * Returns the memory taken by an entry: the ID is stored twice, in the map and in the LRU list,
+ * next to the response and the bookkeeping of both containers.
+ */
+std::size_t FinishedCache::GetEntryBytes(const std::string& id, const std::string& response) {
+    return 2 * id.size() + response.size() + sizeof(Entry) + 2 * sizeof(std::string) + 4 * sizeof(void*);
+}
+
+std::optional<std::string> FinishedCache::Find(const std::string& id) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto entry = entries_.find(id);
+    if (entry == entries_.end()) {
+        ++misses_;
+        return std::nullopt;
+    }
+    ++hits_;
+    lru_.splice(lru_.begin(), lru_, entry->second.lru_position);
+    return entry->second.response;
+}
+
+void FinishedCache::Insert(const std::string& id, std::string response) {
+    const std::size_t entry_bytes = GetEntryBytes(id, response);
+    if (entry_bytes > options_.max_bytes) {
+        return;
+    }
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    auto existing = entries_.find(id);
+    if (existing != entries_.end()) {
+        Erase(existing);
+    }
+    while (!lru_.empty() && bytes_ + entry_bytes > options_.max_bytes) {
+        Erase(entries_.find(lru_.back()));
+        ++evictions_;
+    }
+    lru_.push_front(id);
+    entries_.emplace(id, Entry{std::move(response), lru_.begin()});
+    bytes_ += entry_bytes;
+}
+
+void FinishedCache::Invalidate(const std::string& id) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto entry = entries_.find(id);
+    if (entry != entries_.end()) {
+        Erase(entry);
+        ++invalidations_;
+    }
+}
+
+void FinishedCache::Clear() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    invalidations_ += entries_.size();
+    entries_.clear();
+    lru_.clear();
+    bytes_ = 0;
+}
+
+void FinishedCache::Erase(const std::unordered_map<std::string, Entry>::iterator entry) {
+    bytes_ -= GetEntryBytes(entry->first, entry->second.response);
+    lru_.erase(entry->second.lru_position);
+    entries_.erase(entry);
+}
+
+FinishedCache::Stats FinishedCache::GetStats() const {
+    Stats stats;
+    stats.hits = hits_;
+    stats.misses = misses_;
+    stats.evictions = evictions_;
+    stats.invalidations = invalidations_;
+    std::lock_guard<std::mutex> lock(mutex_);
+    stats.entries = entries_.size();
+    stats.bytes = bytes_;
+    return stats;
+}
+
+} // namespace status
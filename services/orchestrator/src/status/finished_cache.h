@@ -0,0 +1,86 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <list>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <unordered_map>
+
+namespace status {
+
+/**
+ * @brief Cache of the serialized status responses of finished videos, bounded by their size in bytes.
+ *
+ * The result of a finished video does not change, so once it has been read from the database its status
+ * response is answered from memory. The least recently read responses are evicted when the cached
+ * responses exceed the memory budget, and a response is invalidated as soon as a status change of its
+ * video is published.
+ *
+ * The cache is thread-safe.
+ */
+class FinishedCache {
+public:
+    struct Options {
+        std::size_t max_bytes = 64 * 1024 * 1024;
+    };
+
+    struct Stats {
+        std::uint64_t hits = 0;
+        std::uint64_t misses = 0;
+        std::uint64_t evictions = 0;
+        std::uint64_t invalidations = 0;
+        std::size_t entries = 0;
+        std::size_t bytes = 0;
+    };
+
+    explicit FinishedCache(Options options);
+
+    FinishedCache(const FinishedCache&) = delete;
+    FinishedCache& operator=(const FinishedCache&) = delete;
+
+    /**
+     * @brief Returns the cached response of a video, counting a hit or a miss.
+     */
+    std::optional<std::string> Find(const std::string& id);
+
+    /**
+     * @brief Caches the response of a finished video, unless it alone exceeds the memory budget.
+     */
+    void Insert(const std::string& id, std::string response);
+
+    void Invalidate(const std::string& id);
+
+    /**
+     * @brief Drops every response, when status changes may have been missed.
+     */
+    void Clear();
+
+    Stats GetStats() const;
+
+private:
+    struct Entry {
+        std::string response;
+        std::list<std::string>::iterator lru_position;
+    };
+
+    static std::size_t GetEntryBytes(const std::string& id, const std::string& response);
+    void Erase(std::unordered_map<std::string, Entry>::iterator entry);
+
+    Options options_;
+
+    mutable std::mutex mutex_;
+    std::unordered_map<std::string, Entry> entries_;
+    // Most recently read first
+    std::list<std::string> lru_;
+    std::size_t bytes_ = 0;
+
+    std::atomic<std::uint64_t> hits_{0};
+    std::atomic<std::uint64_t> misses_{0};
+    std::atomic<std::uint64_t> evictions_{0};
+    std::atomic<std::uint64_t> invalidations_{0};
+};
+
+} // namespace status
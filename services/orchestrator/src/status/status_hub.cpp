@@ -0,0 +1,156 @@
+#include "status_hub.h"
+
+#include <algorithm>
+#include <iostream>
+#include <sstream>
+
+#include "../../utils/redis/redis.h"
+
+namespace status {
+
+struct StatusHub::Waiter {
+    Waiter(asio::io_context& io_context, std::string id, const long long since, WaitHandler handler)
+        : id(std::move(id)), since(since), handler(std::move(handler)), timer(io_context) {}
+
+    std::string id;
+    long long since;
+    WaitHandler handler;
+    asio::steady_timer timer;
+    // Set by whoever answers the waiter first: a change, the timeout, a renewed subscription or Cancel
+    std::atomic<bool> done{false};
+};
+
+StatusHub::StatusHub(asio::io_context& io_context, redis::AsyncRedis& subscriber, const std::size_t max_waiters,
+                     FinishedCache* cache)
+    : io_context_(io_context), subscriber_(subscriber), max_waiters_(max_waiters), cache_(cache) {}
+
+void StatusHub::Start() {
+    subscriber_.Subscribe(redis_utils::kStatusChannel,
+        [this](const std::string& message) {
+            OnMessage(message);
+        },
+        [this] {
+            OnSubscribed();
+        });
+}
+
+StatusHub::WaiterPtr StatusHub::Wait(const std::string& id, const long long since,
+                                     const std::chrono::milliseconds timeout, WaitHandler handler) {
+    auto waiter = std::make_shared<Waiter>(io_context_, id, since, std::move(handler));
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (waiters_count_ >= max_waiters_) {
+            return nullptr;
+        }
+        ++waiters_count_;
+    }
+
+    // The timer is armed before the waiter can be seen by other threads, which only ever cancel it
+    waiter->timer.expires_after(timeout);
+    waiter->timer.async_wait([this, waiter](const asio::error_code& ec) {
+        if (ec || !Remove(waiter)) {
+            return;
+        }
+        waiter->handler(std::nullopt);
+    });
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    // Already answered by its timeout
+    if (!waiter->done) {
+        waiters_[id].push_back(waiter);
+    }
+    return waiter;
+}
+
+bool StatusHub::Cancel(const WaiterPtr& waiter) {
+    if (!Remove(waiter)) {
+        return false;
+    }
+    waiter->timer.cancel();
+    return true;
+}
+
+/**
+ * Takes a waiter out of the hub, unless it has already been answered.
+ *
+ * @return True if the caller is the one to answer the waiter.
+ */
+bool StatusHub::Remove(const WaiterPtr& waiter) {
+    if (waiter->done.exchange(true)) {
+        return false;
+    }
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = waiters_.find(waiter->id);
+    if (it != waiters_.end()) {
+        auto& video_waiters = it->second;
+        video_waiters.erase(std::remove(video_waiters.begin(), video_waiters.end(), waiter), video_waiters.end());
+        if (video_waiters.empty()) {
+            waiters_.erase(it);
+        }
+    }
+    --waiters_count_;
+    return true;
+}
+
+/**
+ * Answers the waiters of a video with a published change, "<id> <version> <status>".
+ */
+void StatusHub::OnMessage(const std::string& message) {
+    StatusUpdate update;
+    std::istringstream stream(message);
+    if (!(stream >> update.id >> update.version >> update.status)) {
+        std::cerr << "Malformed status change: " << message << std::endl;
+        return;
+    }
+    if (cache_ != nullptr) {
+        cache_->Invalidate(update.id);
+    }
+
+    std::vector<WaiterPtr> answered;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto it = waiters_.find(update.id);
+        if (it == waiters_.end()) {
+            return;
+        }
+        for (const auto& waiter : it->second) {
+            if (waiter->since < update.version) {
+                answered.push_back(waiter);
+            }
+        }
+    }
+
+    for (const auto& waiter : answered) {
+        if (Remove(waiter)) {
+            waiter->timer.cancel();
+            waiter->handler(update);
+        }
+    }
+}
+
+/**
+ * Answers every waiter and drops the cached responses after the subscription has been renewed,
+ * since changes may have been published while the hub was not subscribed.
+ */
+void StatusHub::OnSubscribed() {
+    if (cache_ != nullptr) {
+        cache_->Clear();
+    }
+
+    std::vector<WaiterPtr> answered;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        for (const auto& [id, video_waiters] : waiters_) {
+            answered.insert(answered.end(), video_waiters.begin(), video_waiters.end());
+        }
+    }
+
+    for (const auto& waiter : answered) {
+        if (Remove(waiter)) {
+            waiter->timer.cancel();
+            waiter->handler(std::nullopt);
+        }
+    }
+}
+
+} // namespace status
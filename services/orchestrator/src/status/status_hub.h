@@ -0,0 +1,95 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <asio.hpp>
+
+#include "../../utils/redis/async_redis.h"
+
+#include "finished_cache.h"
+
+namespace status {
+
+struct StatusUpdate {
+    std::string id;
+    long long version = 0;
+    std::string status;
+};
+
+/**
+ * @brief Delivers the status changes published by the stages to the clients waiting for them.
+ *
+ * The hub subscribes to the status channel once and keeps, per video, the clients long-polling its status.
+ * A client waits for the first change with a version above the one it already has; it is answered
+ * with that change, or with nothing when its timeout expires or when changes may have been missed
+ * because the subscription was renewed, in which case it reads the current status instead.
+ * Every change also invalidates the cached response of its video.
+ */
+class StatusHub {
+public:
+    // Called once, with the change or with std::nullopt when the current status has to be read instead
+    using WaitHandler = std::function<void(const std::optional<StatusUpdate>&)>;
+
+    struct Waiter;
+    using WaiterPtr = std::shared_ptr<Waiter>;
+
+    /**
+     * @param io_context The io_context running the timeouts of the waiters.
+     * @param subscriber The client subscribed to the status channel, used for nothing else.
+     * @param max_waiters The number of clients allowed to wait at once.
+     * @param cache The cache of finished responses to invalidate, nullptr if disabled.
+     */
+    StatusHub(asio::io_context& io_context, redis::AsyncRedis& subscriber, std::size_t max_waiters,
+              FinishedCache* cache = nullptr);
+
+    StatusHub(const StatusHub&) = delete;
+    StatusHub& operator=(const StatusHub&) = delete;
+
+    /**
+     * @brief Subscribes to the status channel.
+     */
+    void Start();
+
+    /**
+     * @brief Waits for the next status change of a video.
+     *
+     * @param id The ID of the video.
+     * @param since The version of the status the client already has.
+     * @param timeout How long to wait for a change.
+     * @param handler The handler called once with the change, or with std::nullopt.
+     * @return The waiter, or nullptr if too many clients are already waiting.
+     */
+    WaiterPtr Wait(const std::string& id, long long since, std::chrono::milliseconds timeout, WaitHandler handler);
+
+    /**
+     * @brief Stops waiting, e.g. because the current status is already newer than the client's.
+     *
+     * @param waiter The waiter returned by Wait.
+     * @return True if the handler of the waiter has not been and will not be called, false otherwise.
+     */
+    bool Cancel(const WaiterPtr& waiter);
+
+private:
+    bool Remove(const WaiterPtr& waiter);
+    void OnMessage(const std::string& message);
+    void OnSubscribed();
+
+    asio::io_context& io_context_;
+    redis::AsyncRedis& subscriber_;
+    std::size_t max_waiters_;
+    FinishedCache* cache_;
+
+    std::mutex mutex_;
+    std::unordered_map<std::string, std::vector<WaiterPtr>> waiters_;
+    std::size_t waiters_count_ = 0;
+};
+
+} // namespace status
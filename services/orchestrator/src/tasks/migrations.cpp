@@ -6,16 +6,18 @@
 namespace tasks {
 
 /**
- * Runs the database migrations.
+ * Runs the pending database migrations.
+ *
+ * @return True if the schema is up to date, false if a migration failed.
  */
-void RunMigrations() {
+bool RunMigrations() {
     const auto& config = cfg::GlobalConfig::getInstance();
     const auto& pg_db = config.getPgDatabaseConfig();
 
     const std::string connection_str = pg_db.getConnectionString();
     const std::string migrations_dir = "../../../migrations";
     
-    utils::db::ApplyMigrations(connection_str, migrations_dir);
+    return utils::db::ApplyMigrations(connection_str, migrations_dir);
 }
 
 }
\ No newline at end of file
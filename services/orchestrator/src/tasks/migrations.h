@@ -4,6 +4,6 @@
 
 namespace tasks {
 
-void RunMigrations();
+bool RunMigrations();
 
 }
\ No newline at end of file
@@ -3,53 +3,46 @@
 #include <iostream>
 
 #include "../../../../utils/redis/redis.h"
+#include "../../../../utils/redis/redis_pool.h"
+#include "../../../../utils/redis/redis_stream.h"
+#include "../../../../utils/redis/stage_jobs.h"
 #include "../../../../utils/db/pg.h"
 #include "../../../../utils/cfg/global_config.h"
+#include "../../../../utils/http/health.h"
 
 namespace handlers {
 
-namespace {
-
 /**
- * @brief Handles the request to save video data.
+ * @brief Saves the analysis result of a video.
  * 
- * This function is responsible for handling the request to save video data. It receives a JSON payload
- * containing the Redis ID of the video and the YOLO result. It connects to Redis, retrieves the YOLO result
- * using the Redis ID, parses the result, and saves it to PostgreSQL. Finally, it deletes the data from Redis
- * and sends a response indicating the success or failure of the operation.
+ * This function is responsible for saving the analysis result of a video. It receives the job body
+ * containing the Redis ID of the video. It checks a Redis connection out of the pool, retrieves the YOLO result
+ * using the Redis ID, parses the result, and bulk loads its frames and detections into PostgreSQL. Finally,
+ * it deletes the data from Redis and returns a response indicating the success or failure of the operation.
  * 
- * @param req The HTTP request object.
- * @param res The HTTP response object.
+ * @param body The job body with the redis_id of the video.
+ * @return The response describing the outcome of the operation.
  */
-void SaveVideoHandler(const crow::request& req, crow::response& res) {
-    auto body = crow::json::load(req.body);
-    if (!body) {
-        res.code = 400;
-        res.write("Invalid JSON");
-        res.end();
-        return;
-    }
-
+crow::response SaveVideo(const crow::json::rvalue& body) {
+    utils::http::InFlightGuard in_flight;
     std::string redis_id = body["redis_id"].s();
 
-    // Connect to Redis
-    const auto& config = cfg::GlobalConfig::getInstance();
-    const auto& redis = config.getRedis();
-    redisContext *redis_conn = redis_utils::RedisConnect(redis.host, redis.port);
-    if (redis_conn == nullptr) {
-        res.code = 500;
-        res.write("Redis connection error");
-        res.end();
-        return;
+    auto redis_conn = redis::RedisPool::getInstance().acquire();
+    if (!redis_conn) {
+        return crow::response(500, "Redis connection error");
+    }
+
+    // The result of a finished video has been saved and removed from Redis already
+    const auto status = redis_utils::RedisGetRequestVideoStatus(redis_conn.get(), redis_id);
+    if (status.has_value() && requests::IsVideoPastStatus(status.value(), requests::VideoStatus::PostProcessing)) {
+        std::cout << "Video " << redis_id << " has already been saved, skipping the job" << std::endl;
+        return crow::response(requests::kStageSkippedCode);
     }
 
     // Get YOLO result from Redis
-    redisReply *reply = redis_utils::RedisGetByKey(redis_conn, "GET yolo_response:%s", redis_id.c_str());
+    redisReply *reply = redis_utils::RedisGetByKey(redis_conn.get(), "GET yolo_response:%s", redis_id.c_str());
     if (reply == nullptr) {
-        res.code = 500;
-        res.write("Failed to get data from Redis");
-        res.end();
-        return;
+        return crow::response(500, "Failed to get data from Redis");
     }
 
     // Parse YOLO result
@@ -59,25 +52,39 @@ void SaveVideoHandler(const crow::request& req, crow::response& res) {
     // Save to PostgreSQL
     bool success = utils::db::SaveAnalysisResult(redis_id, yolo_result);
     if (!success) {
-        res.code = 500;
-        res.write("Failed to save data to PostgreSQL");
-        res.end();
-        return;
+        return crow::response(500, "Failed to save data to PostgreSQL");
     }
 
     // Delete data from Redis
-    redisCommand(redis_conn, "DEL yolo_response:%s", redis_id.c_str());
-    redisFree(redis_conn);
-
-    res.code = 200;
-    res.write("Data saved successfully");
-    res.end();
-}
+    redisReply *del_reply = static_cast<redisReply*>(redisCommand(redis_conn.get(), "DEL yolo_response:%s", redis_id.c_str()));
+    if (del_reply != nullptr) {
+        freeReplyObject(del_reply);
+    }
 
+    return crow::response(200, "Data saved successfully");
 }
 
+/**
+ * Binds the save_video handler to the specified Crow application.
+ * With the queue dispatch mode the handler only adds the job to the post-processing stream,
+ * otherwise it saves the result before answering.
+ *
+ * @param app The Crow application to bind the handler to.
+ */
 void BindSaveVideoHandler(crow::SimpleApp& app) {
-    CROW_ROUTE(app, "/save_video").methods(crow::HTTPMethod::POST)(SaveVideoHandler);
+    CROW_ROUTE(app, "/save_video").methods(crow::HTTPMethod::POST)
+    ([](const crow::request& req) {
+        auto body = crow::json::load(req.body);
+        if (!body) {
+            return crow::response(400, "Invalid JSON");
+        }
+
+        const auto& queue = cfg::GlobalConfig::getInstance().getQueue();
+        if (queue.dispatch == cfg::GlobalConfig::DispatchMode::Queue) {
+            return redis_utils::EnqueueStageJob(redis_utils::kPostProcessingStream, req.body);
+        }
+        return SaveVideo(body);
+    });
 }
 
 } // namespace handlers
@@ -4,6 +4,8 @@
 
 namespace handlers {
 
+crow::response SaveVideo(const crow::json::rvalue& body);
+
 void BindSaveVideoHandler(crow::SimpleApp& app);
 
-}
\ No newline at end of file
+}
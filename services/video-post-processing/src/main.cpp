@@ -1,17 +1,34 @@
+#include <memory>
+
 #include <crow.h>
 
 #include "../../../utils/cfg/global_config.h"
+#include "../../../utils/http/health.h"
+#include "../../../utils/redis/redis_stream.h"
+#include "../../../utils/redis/stage_jobs.h"
 
 #include "handlers/save_video.h"
 
-int main() {
+int main(int argc, char* argv[]) {
     crow::SimpleApp app;
 
     handlers::BindSaveVideoHandler(app);
+    utils::http::BindHealthHandler(app);
 
     const auto& config = cfg::GlobalConfig::getInstance();
+
+    std::unique_ptr<redis::StreamWorker> worker;
+    if (config.getQueue().dispatch == cfg::GlobalConfig::DispatchMode::Queue) {
+        worker = redis_utils::StartStageWorker(redis_utils::kPostProcessingStream, "video-post-processing",
+                                               handlers::SaveVideo);
+    }
+
     const auto& app_config = config.getVideoPostProcessing();
-    app.port(app_config.port).multithreaded().run();
+    app.port(cfg::GetListenPort(argc, argv, app_config.port)).multithreaded().run();
+
+    if (worker) {
+        worker->Stop();
+    }
 
     return 0;
 }
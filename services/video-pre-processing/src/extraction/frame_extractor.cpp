@@ -0,0 +1,607 @@
+#include "frame_extractor.h"
+#include "frame_gate.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <limits>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#ifdef WITH_LIBAV
+extern "C" {
+    #include <libavcodec/avcodec.h>
+    #include <libavformat/avformat.h>
+    #include <libavutil/imgutils.h>
+    #include <libswscale/swscale.h>
+}
+#endif
+
+#ifdef _WIN32
+    #define popen _popen
+    #define pclose _pclose
+    // Raw frames must not go through the text mode translation of line endings
+    #define POPEN_READ_BINARY "rb"
+#else
+    // glibc rejects the "b" mode flag, pipes are always binary on POSIX
+    #define POPEN_READ_BINARY "r"
+#endif
+
+namespace extraction {
+
+namespace fs = std::filesystem;
+
+std::string GetChunkDirectory(const std::string& output_path, const std::size_t sample_index,
+                              const ExtractionOptions& options) {
+    return output_path + "/dir_" + std::to_string(sample_index / options.frames_per_directory);
+}
+
+std::string GetFramePath(const std::string& output_path, const std::size_t sample_index,
+                         const ExtractionOptions& options) {
+    char name[32];
+    std::snprintf(name, sizeof(name), "/frame_%04zu.png", sample_index + 1);
+    return GetChunkDirectory(output_path, sample_index, options) + name;
+}
+
+namespace {
+
+constexpr std::size_t kNoSampleLimit = std::numeric_limits<std::size_t>::max();
+
+/**
+ * A part of the video decoded by one worker. It owns the samples [first_sample, end_sample)
+ * and starts decoding at seek_seconds, the time of the keyframe preceding its first sample.
+ */
+struct Segment {
+    double seek_seconds;
+    std::size_t first_sample;
+    std::size_t end_sample;
+};
+
+/**
+ * Returns the index of the first sample taken at or after the given time.
+ */
+std::size_t SampleAtOrAfter(const double seconds, const ExtractionOptions& options) {
+    return static_cast<std::size_t>(std::max(0.0, std::ceil(seconds * options.fps - 1e-6)));
+}
+
+/**
+ * Returns how many segments a video of the given duration is split into.
+ */
+std::size_t GetSegmentsCount(const double duration, const ExtractionOptions& options) {
+    if (!options.segmented || duration <= 0.0) {
+        return 1;
+    }
+    const std::size_t workers = options.segment_workers > 0
+        ? options.segment_workers : std::max(1u, std::thread::hardware_concurrency());
+    const auto by_length = static_cast<std::size_t>(duration / std::max(1.0, options.min_segment_seconds));
+    return std::max<std::size_t>(1, std::min(workers, by_length));
+}
+
+/**
+ * Splits the samples of a video into segments starting at the given times.
+ * Consecutive segments own adjacent sample ranges, so every sample is written by exactly one segment.
+ *
+ * @param starts The start times of the segments in increasing order, the first one being 0.
+ * @param options The extraction options.
+ */
+std::vector<Segment> MakeSegments(const std::vector<double>& starts, const ExtractionOptions& options) {
+    std::vector<Segment> segments;
+    for (std::size_t i = 0; i < starts.size(); ++i) {
+        const std::size_t first_sample = SampleAtOrAfter(starts[i], options);
+        const std::size_t end_sample = i + 1 < starts.size() ? SampleAtOrAfter(starts[i + 1], options) : kNoSampleLimit;
+        if (first_sample < end_sample) {
+            segments.push_back(Segment{starts[i], first_sample, end_sample});
+        }
+    }
+    return segments;
+}
+
+/**
+ * Runs the segments on parallel threads.
+ *
+ * @param segments The segments to decode.
+ * @param decode_segment Decodes one segment, returns false on failure.
+ * @return True if every segment has been decoded, false otherwise.
+ */
+template <typename DecodeSegment>
+bool DecodeSegmentsInParallel(const std::vector<Segment>& segments, DecodeSegment decode_segment) {
+    std::atomic<bool> failed{false};
+    std::vector<std::thread> threads;
+    threads.reserve(segments.size());
+    for (const auto& segment : segments) {
+        threads.emplace_back([&failed, &decode_segment, segment] {
+            try {
+                if (!decode_segment(segment)) {
+                    failed = true;
+                }
+            } catch (const std::exception& e) {
+                std::cerr << "Error: " << e.what() << std::endl;
+                failed = true;
+            }
+        });
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+    return !failed;
+}
+
+#ifdef WITH_LIBAV
+
+struct FormatContextDeleter {
+    void operator()(AVFormatContext* context) const {
+        avformat_close_input(&context);
+    }
+};
+
+struct CodecContextDeleter {
+    void operator()(AVCodecContext* context) const {
+        avcodec_free_context(&context);
+    }
+};
+
+struct FrameDeleter {
+    void operator()(AVFrame* frame) const {
+        av_frame_free(&frame);
+    }
+};
+
+struct PacketDeleter {
+    void operator()(AVPacket* packet) const {
+        av_packet_free(&packet);
+    }
+};
+
+struct SwsContextDeleter {
+    void operator()(SwsContext* context) const {
+        sws_freeContext(context);
+    }
+};
+
+using FormatContextPtr = std::unique_ptr<AVFormatContext, FormatContextDeleter>;
+
+std::string AvErrorToString(const int error) {
+    char buffer[AV_ERROR_MAX_STRING_SIZE] = {};
+    av_strerror(error, buffer, sizeof(buffer));
+    return buffer;
+}
+
+/**
+ * Opens a video and finds its video stream.
+ *
+ * @param video_path The path to the video file.
+ * @param stream_index Receives the index of the video stream.
+ * @param decoder Receives the decoder of the video stream.
+ * @return The opened video, or nullptr on failure.
+ */
+FormatContextPtr OpenVideo(const std::string& video_path, int& stream_index, const AVCodec*& decoder) {
+    AVFormatContext* raw_format = nullptr;
+    const int error = avformat_open_input(&raw_format, video_path.c_str(), nullptr, nullptr);
+    if (error < 0) {
+        std::cerr << "Error: Failed to open " << video_path << ": " << AvErrorToString(error) << std::endl;
+        return nullptr;
+    }
+    FormatContextPtr format(raw_format);
+    if (avformat_find_stream_info(format.get(), nullptr) < 0) {
+        std::cerr << "Error: Failed to read stream info of " << video_path << std::endl;
+        return nullptr;
+    }
+
+    decoder = nullptr;
+    stream_index = av_find_best_stream(format.get(), AVMEDIA_TYPE_VIDEO, -1, -1, &decoder, 0);
+    if (stream_index < 0 || decoder == nullptr) {
+        std::cerr << "Error: No video stream in " << video_path << std::endl;
+        return nullptr;
+    }
+
+    // Packets of other streams are dropped by the demuxer instead of being read and skipped
+    for (unsigned int i = 0; i < format->nb_streams; ++i) {
+        if (static_cast<int>(i) != stream_index) {
+            format->streams[i]->discard = AVDISCARD_ALL;
+        }
+    }
+    return format;
+}
+
+/**
+ * Scales decoded frames and encodes them as PNG files.
+ */
+class FrameWriter {
+public:
+    explicit FrameWriter(const ExtractionOptions& options) : options_(options) {}
+
+    bool Open() {
+        const AVCodec* encoder = avcodec_find_encoder(AV_CODEC_ID_PNG);
+        if (encoder == nullptr) {
+            std::cerr << "Error: PNG encoder is not available" << std::endl;
+            return false;
+        }
+        encoder_.reset(avcodec_alloc_context3(encoder));
+        encoder_->width = static_cast<int>(options_.width);
+        encoder_->height = static_cast<int>(options_.height);
+        encoder_->pix_fmt = AV_PIX_FMT_RGB24;
+        encoder_->time_base = AVRational{1, 1};
+        if (avcodec_open2(encoder_.get(), encoder, nullptr) < 0) {
+            std::cerr << "Error: Failed to open the PNG encoder" << std::endl;
+            return false;
+        }
+
+        scaled_.reset(av_frame_alloc());
+        packet_.reset(av_packet_alloc());
+        scaled_->format = AV_PIX_FMT_RGB24;
+        scaled_->width = encoder_->width;
+        scaled_->height = encoder_->height;
+        return av_frame_get_buffer(scaled_.get(), 0) >= 0;
+    }
+
+    /**
+     * Scales a decoded frame and writes it to the given path.
+     */
+    bool Write(const AVFrame* frame, const std::string& path) {
+        scaler_.reset(sws_getCachedContext(scaler_.release(), frame->width, frame->height,
+                                           static_cast<AVPixelFormat>(frame->format),
+                                           encoder_->width, encoder_->height, AV_PIX_FMT_RGB24,
+                                           SWS_BILINEAR, nullptr, nullptr, nullptr));
+        if (!scaler_ || av_frame_make_writable(scaled_.get()) < 0) {
+            return false;
+        }
+        sws_scale(scaler_.get(), frame->data, frame->linesize, 0, frame->height, scaled_->data, scaled_->linesize);
+
+        if (avcodec_send_frame(encoder_.get(), scaled_.get()) < 0) {
+            return false;
+        }
+        std::ofstream file(path, std::ios::binary | std::ios::trunc);
+        while (avcodec_receive_packet(encoder_.get(), packet_.get()) == 0) {
+            file.write(reinterpret_cast<const char*>(packet_->data), packet_->size);
+            av_packet_unref(packet_.get());
+        }
+        return static_cast<bool>(file);
+    }
+
+    /**
+     * Returns the thumbnail of the last written frame.
+     */
+    Thumbnail MakeLastThumbnail() const {
+        return MakeThumbnail(scaled_->data[0], static_cast<std::size_t>(scaled_->linesize[0]),
+                             options_.width, options_.height);
+    }
+
+private:
+    const ExtractionOptions& options_;
+    std::unique_ptr<AVCodecContext, CodecContextDeleter> encoder_;
+    std::unique_ptr<SwsContext, SwsContextDeleter> scaler_;
+    std::unique_ptr<AVFrame, FrameDeleter> scaled_;
+    std::unique_ptr<AVPacket, PacketDeleter> packet_;
+};
+
+/**
+ * Decodes a segment of the video in-process and writes every sample it owns once, already scaled.
+ * The k-th sample is the first frame whose presentation time is at least k / fps seconds.
+ *
+ * @param video_path The path to the video file.
+ * @param output_path The directory of the frames of the video.
+ * @param options The extraction options.
+ * @param segment The segment to decode, the whole video is a single segment starting at 0.
+ * @param thumbnails Receives the thumbnails of the written frames, may be nullptr.
+ * @return True if the segment has been decoded, false otherwise.
+ */
+bool DecodeSegmentWithLibav(const std::string& video_path, const std::string& output_path,
+                            const ExtractionOptions& options, const Segment& segment,
+                            FrameThumbnails* thumbnails) {
+    int stream_index = -1;
+    const AVCodec* decoder = nullptr;
+    auto format = OpenVideo(video_path, stream_index, decoder);
+    if (!format) {
+        return false;
+    }
+    const AVStream* stream = format->streams[stream_index];
+    const double time_base = av_q2d(stream->time_base);
+    const std::int64_t start_time = stream->start_time != AV_NOPTS_VALUE ? stream->start_time : 0;
+
+    if (segment.seek_seconds > 0.0) {
+        const auto seek_timestamp = start_time + static_cast<std::int64_t>(segment.seek_seconds / time_base);
+        if (av_seek_frame(format.get(), stream_index, seek_timestamp, AVSEEK_FLAG_BACKWARD) < 0) {
+            std::cerr << "Error: Failed to seek to " << segment.seek_seconds << "s in " << video_path << std::endl;
+            return false;
+        }
+    }
+
+    std::unique_ptr<AVCodecContext, CodecContextDeleter> codec(avcodec_alloc_context3(decoder));
+    avcodec_parameters_to_context(codec.get(), stream->codecpar);
+    // Segments already keep the cores busy, a segment's decoder gets a single thread then
+    codec->thread_count = options.segmented ? 1 : 0;
+    if (avcodec_open2(codec.get(), decoder, nullptr) < 0) {
+        std::cerr << "Error: Failed to open the decoder of " << video_path << std::endl;
+        return false;
+    }
+
+    FrameWriter writer(options);
+    if (!writer.Open()) {
+        return false;
+    }
+
+    std::size_t next_sample = segment.first_sample;
+    std::size_t next_directory = segment.first_sample / options.frames_per_directory;
+    bool write_failed = false;
+    bool done = false;
+
+    std::unique_ptr<AVPacket, PacketDeleter> packet(av_packet_alloc());
+    std::unique_ptr<AVFrame, FrameDeleter> frame(av_frame_alloc());
+
+    const auto receive_frames = [&]() {
+        while (avcodec_receive_frame(codec.get(), frame.get()) == 0) {
+            const std::int64_t timestamp = frame->best_effort_timestamp;
+            if (!done && timestamp != AV_NOPTS_VALUE) {
+                const double samples = (timestamp - start_time) * time_base * options.fps;
+                if (samples + 1e-6 >= static_cast<double>(next_sample)) {
+                    const std::size_t sample = std::max(next_sample,
+                        static_cast<std::size_t>(std::max(0.0, std::floor(samples + 1e-6))));
+                    if (sample >= segment.end_sample) {
+                        // The next segment writes this sample
+                        done = true;
+                    } else {
+                        const std::size_t directory = sample / options.frames_per_directory;
+                        while (next_directory <= directory) {
+                            fs::create_directories(output_path + "/dir_" + std::to_string(next_directory++));
+                        }
+                        if (!writer.Write(frame.get(), GetFramePath(output_path, sample, options))) {
+                            write_failed = true;
+                        } else if (thumbnails != nullptr) {
+                            thumbnails->Add(sample, writer.MakeLastThumbnail());
+                        }
+                        next_sample = sample + 1;
+                    }
+                }
+            }
+            av_frame_unref(frame.get());
+        }
+    };
+
+    while (!done && !write_failed && av_read_frame(format.get(), packet.get()) >= 0) {
+        if (packet->stream_index == stream_index && avcodec_send_packet(codec.get(), packet.get()) >= 0) {
+            receive_frames();
+        }
+        av_packet_unref(packet.get());
+    }
+    if (!done) {
+        // Drain the frames buffered by the decoder
+        avcodec_send_packet(codec.get(), nullptr);
+        receive_frames();
+    }
+
+    if (write_failed) {
+        std::cerr << "Error: Failed to write the frames of " << video_path << std::endl;
+        return false;
+    }
+    return true;
+}
+
+/**
+ * Plans the segments of a video. Their boundaries are spread evenly over the duration and then moved
+ * back to the preceding keyframe, so that no segment decodes frames another segment decodes too.
+ */
+std::vector<Segment> PlanSegmentsWithLibav(const std::string& video_path, const ExtractionOptions& options) {
+    int stream_index = -1;
+    const AVCodec* decoder = nullptr;
+    auto format = OpenVideo(video_path, stream_index, decoder);
+    const Segment whole_video{0.0, 0, kNoSampleLimit};
+    if (!format) {
+        return {whole_video};
+    }
+
+    const AVStream* stream = format->streams[stream_index];
+    const double duration = format->duration != AV_NOPTS_VALUE
+        ? static_cast<double>(format->duration) / AV_TIME_BASE : -1.0;
+    const std::size_t segments_count = GetSegmentsCount(duration, options);
+    if (segments_count <= 1) {
+        return {whole_video};
+    }
+
+    // Keyframe times from the index of the container
+    const double time_base = av_q2d(stream->time_base);
+    const std::int64_t start_time = stream->start_time != AV_NOPTS_VALUE ? stream->start_time : 0;
+    std::vector<double> keyframes;
+    const int entries_count = avformat_index_get_entries_count(stream);
+    for (int i = 0; i < entries_count; ++i) {
+        const AVIndexEntry* entry = avformat_index_get_entry(const_cast<AVStream*>(stream), i);
+        if (entry != nullptr && (entry->flags & AVINDEX_KEYFRAME)) {
+            keyframes.push_back((entry->timestamp - start_time) * time_base);
+        }
+    }
+    std::sort(keyframes.begin(), keyframes.end());
+
+    std::vector<double> starts{0.0};
+    for (std::size_t i = 1; i < segments_count; ++i) {
+        double start = duration * i / segments_count;
+        const auto keyframe = std::upper_bound(keyframes.begin(), keyframes.end(), start);
+        if (keyframe != keyframes.begin()) {
+            start = *std::prev(keyframe);
+        }
+        if (start > starts.back()) {
+            starts.push_back(start);
+        }
+    }
+    return MakeSegments(starts, options);
+}
+
+bool ExtractFramesWithLibav(const std::string& video_path, const std::string& output_path,
+                            const ExtractionOptions& options, FrameThumbnails* thumbnails) {
+    const auto segments = PlanSegmentsWithLibav(video_path, options);
+    if (segments.size() <= 1) {
+        return DecodeSegmentWithLibav(video_path, output_path, options, segments.front(), thumbnails);
+    }
+
+    std::cout << "Decoding " << video_path << " in " << segments.size() << " segments" << std::endl;
+    return DecodeSegmentsInParallel(segments, [&](const Segment& segment) {
+        return DecodeSegmentWithLibav(video_path, output_path, options, segment, thumbnails);
+    });
+}
+
+#else
+
+/**
+ * Returns the duration of a video file.
+ * 
+ * @param video_path The path to the video file.
+ * @return The duration of the video in seconds, or -1 if an error occurred.
+ */
+double GetVideoDuration(const std::string& video_path) {
+    const fs::path ffmpeg_path(FFMPEG_EXECUTABLE);
+    const fs::path ffprobe_path = ffmpeg_path.parent_path() / ("ffprobe" + ffmpeg_path.extension().string());
+    const std::string command = "\"" + ffprobe_path.string() +
+        "\" -v error -show_entries format=duration -of default=noprint_wrappers=1:nokey=1 \"" + video_path + "\"";
+    FILE* pipe = popen(command.c_str(), "r");
+    if (!pipe) {
+        std::cerr << "Error: Failed to execute ffprobe command" << std::endl;
+        return -1;
+    }
+
+    char buffer[128];
+    std::string result = "";
+    while (fgets(buffer, sizeof(buffer), pipe) != nullptr) {
+        result += buffer;
+    }
+    pclose(pipe);
+
+    try {
+        return std::stod(result);
+    } catch (const std::exception&) {
+        std::cerr << "Error: Failed to parse video duration" << std::endl;
+        return -1;
+    }
+}
+
+/**
+ * Moves the frames written by ffmpeg into their chunk directories.
+ * The frames are numbered from 1, so frame_N.png is the sample N - 1.
+ */
+void SplitFramesIntoDirectories(const std::string& output_path, const ExtractionOptions& options) {
+    for (const auto& entry : fs::directory_iterator(output_path)) {
+        const std::string name = entry.path().filename().string();
+        std::size_t frame_number = 0;
+        if (!entry.is_regular_file() || std::sscanf(name.c_str(), "frame_%zu.png", &frame_number) != 1 ||
+            frame_number == 0) {
+            continue;
+        }
+        const std::string directory = GetChunkDirectory(output_path, frame_number - 1, options);
+        fs::create_directories(directory);
+        fs::rename(entry.path(), directory + "/" + name);
+    }
+}
+
+/**
+ * Samples and scales the frames of a segment with a single ffmpeg command, each frame is written once.
+ * Seeking before the input makes ffmpeg start decoding at the preceding keyframe and restart the
+ * timestamps at the segment start, so the segment's samples are numbered from its first sample.
+ * When thumbnails are requested the same command also writes them as raw gray frames to its stdout.
+ */
+bool DecodeSegmentWithCli(const std::string& video_path, const std::string& output_path,
+                          const ExtractionOptions& options, const Segment& segment,
+                          FrameThumbnails* thumbnails) {
+    const std::string sample_filter = "fps=" + std::to_string(options.fps) + ",scale=" +
+                                      std::to_string(options.width) + ":" + std::to_string(options.height);
+    const std::string frames_limit = segment.end_sample != kNoSampleLimit
+        ? " -frames:v " + std::to_string(segment.end_sample - segment.first_sample) : "";
+
+    std::string command = std::string(FFMPEG_EXECUTABLE) + " -y -hide_banner -loglevel error";
+    if (segment.first_sample > 0) {
+        command += " -ss " + std::to_string(segment.first_sample / options.fps);
+    }
+    command += " -i \"" + video_path + "\"";
+    if (thumbnails != nullptr) {
+        command += " -filter_complex \"[0:v]" + sample_filter + ",split=2[frames][small];[small]scale=" +
+                   std::to_string(kThumbnailWidth) + ":" + std::to_string(kThumbnailHeight) +
+                   ":flags=area,format=gray[thumbnails]\" -map \"[frames]\"";
+    } else {
+        command += " -vf " + sample_filter;
+    }
+    command += frames_limit + " -start_number " + std::to_string(segment.first_sample + 1) +
+               " \"" + output_path + "/frame_%04d.png\"";
+
+    if (thumbnails == nullptr) {
+        const int result = std::system(command.c_str());
+        if (result != 0) {
+            std::cerr << "Error: FFmpeg command failed with code " << result << std::endl;
+            return false;
+        }
+        return true;
+    }
+
+    command += " -map \"[thumbnails]\"" + frames_limit + " -f rawvideo -pix_fmt gray pipe:1";
+    FILE* pipe = popen(command.c_str(), POPEN_READ_BINARY);
+    if (!pipe) {
+        std::cerr << "Error: Failed to execute FFmpeg command" << std::endl;
+        return false;
+    }
+    Thumbnail thumbnail(kThumbnailSize);
+    for (std::size_t sample = segment.first_sample;
+         std::fread(thumbnail.data(), 1, thumbnail.size(), pipe) == thumbnail.size(); ++sample) {
+        thumbnails->Add(sample, thumbnail);
+    }
+    const int result = pclose(pipe);
+    if (result != 0) {
+        std::cerr << "Error: FFmpeg command failed with code " << result << std::endl;
+        return false;
+    }
+    return true;
+}
+
+bool ExtractFramesWithCli(const std::string& video_path, const std::string& output_path,
+                          const ExtractionOptions& options, FrameThumbnails* thumbnails) {
+    std::vector<Segment> segments{Segment{0.0, 0, kNoSampleLimit}};
+    if (options.segmented) {
+        const double duration = GetVideoDuration(video_path);
+        const std::size_t segments_count = GetSegmentsCount(duration, options);
+        if (segments_count > 1) {
+            // ffmpeg finds the keyframes itself, the segments start at whole samples
+            std::vector<double> starts;
+            for (std::size_t i = 0; i < segments_count; ++i) {
+                starts.push_back(std::floor(duration * i / segments_count * options.fps) / options.fps);
+            }
+            segments = MakeSegments(starts, options);
+        }
+    }
+
+    bool success = false;
+    if (segments.size() <= 1) {
+        success = DecodeSegmentWithCli(video_path, output_path, options, segments.front(), thumbnails);
+    } else {
+        std::cout << "Decoding " << video_path << " in " << segments.size() << " segments" << std::endl;
+        success = DecodeSegmentsInParallel(segments, [&](const Segment& segment) {
+            return DecodeSegmentWithCli(video_path, output_path, options, segment, thumbnails);
+        });
+    }
+    if (!success) {
+        return false;
+    }
+
+    SplitFramesIntoDirectories(output_path, options);
+    return true;
+}
+
+#endif
+
+} // namespace
+
+bool ExtractFrames(const std::string& video_path, const std::string& output_path, const ExtractionOptions& options,
+                   FrameThumbnails* thumbnails) {
+    try {
+#ifdef WITH_LIBAV
+        return ExtractFramesWithLibav(video_path, output_path, options, thumbnails);
+#else
+        return ExtractFramesWithCli(video_path, output_path, options, thumbnails);
+#endif
+    } catch (const fs::filesystem_error& e) {
+        std::cerr << "Error: " << e.what() << std::endl;
+        return false;
+    }
+}
+
+} // namespace extraction
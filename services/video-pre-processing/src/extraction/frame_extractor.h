@@ -0,0 +1,62 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+
+namespace extraction {
+
+class FrameThumbnails;
+
+struct ExtractionOptions {
+    // Frames sampled per second of video
+    double fps = 1.0;
+    std::size_t width = 600;
+    std::size_t height = 400;
+    // Frames per dir_N chunk directory analyzed by frame-analysis
+    std::size_t frames_per_directory = 60;
+    // Decode segments of the video starting at keyframes on parallel workers
+    bool segmented = false;
+    // Upper bound of parallel segments, 0 uses the number of cores
+    std::size_t segment_workers = 0;
+    // Videos are not split into segments shorter than this
+    double min_segment_seconds = 120.0;
+};
+
+/**
+ * @brief Returns the chunk directory of a sampled frame, output_path/dir_N.
+ *
+ * @param output_path The directory of the frames of the video.
+ * @param sample_index The zero-based index of the sample, i.e. the frame's time multiplied by the fps.
+ * @param options The extraction options.
+ */
+std::string GetChunkDirectory(const std::string& output_path, std::size_t sample_index,
+                              const ExtractionOptions& options);
+
+/**
+ * @brief Returns the path of a sampled frame, output_path/dir_N/frame_XXXX.png.
+ * Frames are numbered from 1 like ffmpeg does, so the frame number encodes the frame's time.
+ */
+std::string GetFramePath(const std::string& output_path, std::size_t sample_index,
+                         const ExtractionOptions& options);
+
+/**
+ * @brief Samples, scales and writes the frames of a video into its chunk directories.
+ *
+ * Built with libav the video is decoded, sampled and scaled in-process in a single pass and every sampled
+ * frame is encoded straight to its final path. Otherwise the ffmpeg executable does the same with one
+ * command, and the frames are moved into the chunk directories afterwards.
+ *
+ * In segmented mode the video is split into time segments starting at keyframes, which are decoded
+ * in parallel. Every segment writes the samples falling into its time range under the same names the
+ * serial mode gives them, so the output is identical.
+ *
+ * @param video_path The path to the video file.
+ * @param output_path The directory of the frames of the video, it must exist.
+ * @param options The extraction options.
+ * @param thumbnails Receives the thumbnail of every written frame when not nullptr.
+ * @return True if the frames have been extracted, false otherwise.
+ */
+bool ExtractFrames(const std::string& video_path, const std::string& output_path, const ExtractionOptions& options,
+                   FrameThumbnails* thumbnails = nullptr);
+
+} // namespace extraction
@@ -0,0 +1,182 @@
+#include "frame_gate.h"
+
+#include <crow.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <utility>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+    #include <emmintrin.h>
+    #define FRAME_GATE_SSE2
+#endif
+
+namespace extraction {
+
+namespace fs = std::filesystem;
+
+void FrameThumbnails::Add(const std::size_t sample_index, Thumbnail thumbnail) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (thumbnails_.size() <= sample_index) {
+        thumbnails_.resize(sample_index + 1);
+    }
+    thumbnails_[sample_index] = std::move(thumbnail);
+}
+
+Thumbnail MakeThumbnail(const std::uint8_t* rgb, const std::size_t stride, const std::size_t width,
+                        const std::size_t height) {
+    Thumbnail thumbnail(kThumbnailSize);
+    for (std::size_t ty = 0; ty < kThumbnailHeight; ++ty) {
+        const std::size_t y_begin = ty * height / kThumbnailHeight;
+        const std::size_t y_end = (ty + 1) * height / kThumbnailHeight;
+        for (std::size_t tx = 0; tx < kThumbnailWidth; ++tx) {
+            const std::size_t x_begin = tx * width / kThumbnailWidth;
+            const std::size_t x_end = (tx + 1) * width / kThumbnailWidth;
+            std::uint32_t sum = 0;
+            for (std::size_t y = y_begin; y < y_end; ++y) {
+                const std::uint8_t* pixel = rgb + y * stride + x_begin * 3;
+                for (std::size_t x = x_begin; x < x_end; ++x, pixel += 3) {
+                    // Integer BT.601 luma
+                    sum += (77 * pixel[0] + 150 * pixel[1] + 29 * pixel[2]) >> 8;
+                }
+            }
+            const std::size_t count = (y_end - y_begin) * (x_end - x_begin);
+            thumbnail[ty * kThumbnailWidth + tx] = static_cast<std::uint8_t>(count > 0 ? sum / count : 0);
+        }
+    }
+    return thumbnail;
+}
+
+double GetFrameDifference(const Thumbnail& a, const Thumbnail& b) {
+    const std::size_t size = std::min(a.size(), b.size());
+    if (size == 0) {
+        return 255.0;
+    }
+
+    std::uint64_t sum = 0;
+    std::size_t i = 0;
+#ifdef FRAME_GATE_SSE2
+    // PSADBW sums the absolute differences of 16 bytes into two 64-bit lanes
+    __m128i accumulator = _mm_setzero_si128();
+    for (; i + 16 <= size; i += 16) {
+        const __m128i va = _mm_loadu_si128(reinterpret_cast<const __m128i*>(a.data() + i));
+        const __m128i vb = _mm_loadu_si128(reinterpret_cast<const __m128i*>(b.data() + i));
+        accumulator = _mm_add_epi64(accumulator, _mm_sad_epu8(va, vb));
+    }
+    alignas(16) std::uint64_t lanes[2];
+    _mm_store_si128(reinterpret_cast<__m128i*>(lanes), accumulator);
+    sum = lanes[0] + lanes[1];
+#endif
+    for (; i < size; ++i) {
+        sum += static_cast<std::uint64_t>(std::abs(static_cast<int>(a[i]) - static_cast<int>(b[i])));
+    }
+    return static_cast<double>(sum) / static_cast<double>(size);
+}
+
+std::uint64_t GetDifferenceHash(const Thumbnail& thumbnail) {
+    constexpr std::size_t kHashWidth = 9;
+    constexpr std::size_t kHashHeight = 8;
+    if (thumbnail.size() != kThumbnailSize) {
+        return 0;
+    }
+
+    std::uint32_t pixels[kHashHeight][kHashWidth];
+    for (std::size_t hy = 0; hy < kHashHeight; ++hy) {
+        const std::size_t y_begin = hy * kThumbnailHeight / kHashHeight;
+        const std::size_t y_end = (hy + 1) * kThumbnailHeight / kHashHeight;
+        for (std::size_t hx = 0; hx < kHashWidth; ++hx) {
+            const std::size_t x_begin = hx * kThumbnailWidth / kHashWidth;
+            const std::size_t x_end = (hx + 1) * kThumbnailWidth / kHashWidth;
+            std::uint32_t sum = 0;
+            for (std::size_t y = y_begin; y < y_end; ++y) {
+                for (std::size_t x = x_begin; x < x_end; ++x) {
+                    sum += thumbnail[y * kThumbnailWidth + x];
+                }
+            }
+            // The blocks have equal sizes, the sums compare like the averages
+            pixels[hy][hx] = sum;
+        }
+    }
+
+    std::uint64_t hash = 0;
+    for (std::size_t hy = 0; hy < kHashHeight; ++hy) {
+        for (std::size_t hx = 0; hx + 1 < kHashWidth; ++hx) {
+            hash = (hash << 1) | (pixels[hy][hx] > pixels[hy][hx + 1] ? 1 : 0);
+        }
+    }
+    return hash;
+}
+
+FrameSelection SelectFrames(const std::vector<Thumbnail>& thumbnails, const GatingOptions& options) {
+    FrameSelection selection;
+    selection.frames_count = thumbnails.size();
+
+    const Thumbnail* reference = nullptr;
+    std::size_t reference_sample = 0;
+    for (std::size_t sample = 0; sample < thumbnails.size(); ++sample) {
+        const Thumbnail& thumbnail = thumbnails[sample];
+        // A frame without a thumbnail is always analyzed
+        const bool analyze = !options.enabled || reference == nullptr || thumbnail.empty() ||
+                             sample - reference_sample > options.max_inherited ||
+                             GetFrameDifference(*reference, thumbnail) > options.threshold;
+        if (analyze) {
+            ++selection.analyzed_count;
+            reference = thumbnail.empty() ? nullptr : &thumbnail;
+            reference_sample = sample;
+        } else {
+            selection.inherited.emplace(sample, reference_sample);
+        }
+    }
+    return selection;
+}
+
+void AddFrameHashes(const std::vector<Thumbnail>& thumbnails, FrameSelection& selection) {
+    for (std::size_t sample = 0; sample < thumbnails.size(); ++sample) {
+        if (!thumbnails[sample].empty() && selection.inherited.count(sample) == 0) {
+            selection.hashes.emplace(sample, GetDifferenceHash(thumbnails[sample]));
+        }
+    }
+}
+
+bool ApplyFrameSelection(const std::string& output_path, const ExtractionOptions& options,
+                         const FrameSelection& selection) {
+    crow::json::wvalue manifest;
+    manifest["frames"] = selection.frames_count;
+    manifest["analyzed"] = selection.analyzed_count;
+    manifest["inherited"] = crow::json::wvalue::object();
+
+    for (const auto& [sample, source] : selection.inherited) {
+        const fs::path frame_path = GetFramePath(output_path, sample, options);
+        std::error_code ec;
+        fs::remove(frame_path, ec);
+        if (ec) {
+            std::cerr << "Error: Failed to remove " << frame_path << ": " << ec.message() << std::endl;
+            return false;
+        }
+        const std::string source_name = fs::path(GetFramePath(output_path, source, options)).filename().string();
+        manifest["inherited"][frame_path.filename().string()] = source_name;
+    }
+
+    if (!selection.hashes.empty()) {
+        manifest["hashes"] = crow::json::wvalue::object();
+        for (const auto& [sample, hash] : selection.hashes) {
+            char hex[17];
+            std::snprintf(hex, sizeof(hex), "%016llx", static_cast<unsigned long long>(hash));
+            manifest["hashes"][fs::path(GetFramePath(output_path, sample, options)).filename().string()] = hex;
+        }
+    }
+
+    std::ofstream file(output_path + "/" + kFramesManifest, std::ios::trunc);
+    file << manifest.dump();
+    if (!file) {
+        std::cerr << "Error: Failed to write the frames manifest of " << output_path << std::endl;
+        return false;
+    }
+    return true;
+}
+
+} // namespace extraction
@@ -0,0 +1,108 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "frame_extractor.h"
+
+namespace extraction {
+
+// Sampled frames are compared on small grayscale copies, which keeps the comparison cheap
+constexpr std::size_t kThumbnailWidth = 48;
+constexpr std::size_t kThumbnailHeight = 32;
+constexpr std::size_t kThumbnailSize = kThumbnailWidth * kThumbnailHeight;
+
+// Written next to the chunk directories, tells frame-analysis which frames were skipped
+constexpr const char* kFramesManifest = "manifest.json";
+
+using Thumbnail = std::vector<std::uint8_t>;
+
+/**
+ * @brief Collects the thumbnails of the sampled frames of a video, indexed by sample.
+ * Segments decoded in parallel add their thumbnails concurrently.
+ */
+class FrameThumbnails {
+public:
+    void Add(std::size_t sample_index, Thumbnail thumbnail);
+
+    /**
+     * @brief Returns the thumbnails by sample, the thumbnail of a sample that has none is empty.
+     * Must not be called while thumbnails are being added.
+     */
+    const std::vector<Thumbnail>& Get() const {
+        return thumbnails_;
+    }
+
+private:
+    std::mutex mutex_;
+    std::vector<Thumbnail> thumbnails_;
+};
+
+struct GatingOptions {
+    // When disabled every frame is analyzed
+    bool enabled = true;
+    // Mean absolute difference of gray levels (0-255) from the last analyzed frame above which a frame is analyzed
+    double threshold = 3.0;
+    // A frame is analyzed at least once per this many samples, however static the video is
+    std::size_t max_inherited = 30;
+};
+
+struct FrameSelection {
+    std::size_t frames_count = 0;
+    std::size_t analyzed_count = 0;
+    // Skipped sample -> the analyzed sample whose detections it inherits
+    std::map<std::size_t, std::size_t> inherited;
+    // Analyzed sample -> the perceptual hash of the frame, frame-analysis caches results by it
+    std::map<std::size_t, std::uint64_t> hashes;
+};
+
+/**
+ * @brief Makes the grayscale thumbnail of an RGB24 image by averaging blocks of pixels.
+ *
+ * @param rgb The pixels of the image.
+ * @param stride The size of a row of the image in bytes.
+ * @param width The width of the image, at least kThumbnailWidth.
+ * @param height The height of the image, at least kThumbnailHeight.
+ */
+Thumbnail MakeThumbnail(const std::uint8_t* rgb, std::size_t stride, std::size_t width, std::size_t height);
+
+/**
+ * @brief Returns the mean absolute difference of two thumbnails, 0 for identical frames and 255 at most.
+ */
+double GetFrameDifference(const Thumbnail& a, const Thumbnail& b);
+
+/**
+ * @brief Returns the 64-bit difference hash (dHash) of a thumbnail: the thumbnail is shrunk to 9x8
+ * and every bit tells whether a pixel is brighter than its right neighbour. Near-identical frames
+ * have hashes which differ in a few bits only.
+ */
+std::uint64_t GetDifferenceHash(const Thumbnail& thumbnail);
+
+/**
+ * @brief Selects the frames to analyze: the first frame and every frame that differs enough from
+ * the last analyzed one. Every other frame inherits the detections of the last analyzed frame.
+ */
+FrameSelection SelectFrames(const std::vector<Thumbnail>& thumbnails, const GatingOptions& options);
+
+/**
+ * @brief Adds the perceptual hashes of the analyzed frames which have a thumbnail to the selection.
+ */
+void AddFrameHashes(const std::vector<Thumbnail>& thumbnails, FrameSelection& selection);
+
+/**
+ * @brief Removes the skipped frames from the chunk directories and writes the manifest which maps
+ * every skipped frame to the frame it inherits its detections from, and every hashed frame to its hash.
+ *
+ * @param output_path The directory of the frames of the video.
+ * @param options The extraction options the frames were extracted with.
+ * @param selection The frames to analyze.
+ * @return True if the selection has been applied, false otherwise.
+ */
+bool ApplyFrameSelection(const std::string& output_path, const ExtractionOptions& options,
+                         const FrameSelection& selection);
+
+} // namespace extraction
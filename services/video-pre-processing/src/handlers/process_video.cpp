@@ -6,178 +6,97 @@
 #include <string>
 
 #include "../../../../utils/redis/redis.h"
+#include "../../../../utils/redis/redis_pool.h"
+#include "../../../../utils/redis/redis_stream.h"
+#include "../../../../utils/redis/stage_jobs.h"
 #include "../../../../utils/cfg/global_config.h"
+#include "../../../../utils/http/health.h"
 
-
-#ifdef _WIN32
-    #define popen _popen
-    #define pclose _pclose
-#endif
-
+#include "../extraction/frame_extractor.h"
+#include "../extraction/frame_gate.h"
 
 namespace handlers {
 
 namespace fs = std::filesystem;
 
-namespace {
-
 /**
- * Returns the duration of a video file.
- * 
- * @param video_path The path to the video file.
- * @return The duration of the video in seconds, or -1 if an error occurred.
+ * Processes a video by extracting frames from it and saving them to a directory.
+ *
+ * @param body The job body with the redis_id and the video_path of the video.
+ * @return The response describing the outcome of the processing.
  */
-int GetVideoDuration(const std::string& video_path) {
-    std::string command = "ffprobe -v error -show_entries format=duration -of default=noprint_wrappers=1:nokey=1 " + video_path;
-    FILE* pipe = popen(command.c_str(), "r");
-    if (!pipe) {
-        std::cerr << "Error: Failed to execute ffprobe command" << std::endl;
-        return -1;
+crow::response ProcessVideo(const crow::json::rvalue& body) {
+    utils::http::InFlightGuard in_flight;
+    const std::string video_path = body["video_path"].s();
+    const std::string redis_id = body["redis_id"].s();
+    const std::string output_path = "../../../tmp/frames/frames-" + redis_id;
+
+    const auto& config = cfg::GlobalConfig::getInstance();
+    const auto status_opt = [&redis_id]() {
+        auto redis_conn = redis::RedisPool::getInstance().acquire();
+        return redis_utils::RedisGetRequestVideoStatus(redis_conn.get(), redis_id);
+    }();
+    if (!status_opt.has_value()) {
+        return crow::response(500, "Failed to get video status from Redis");
     }
-
-    char buffer[128];
-    std::string result = "";
-    while (!feof(pipe)) {
-        if (fgets(buffer, 128, pipe) != NULL) {
-            result += buffer;
-        }
+    const auto& status = status_opt.value();
+    if (status == requests::VideoStatus::Failed || status == requests::VideoStatus::Stopped) {
+        return crow::response(400, "Pipe broken by video status = " + requests::VideoStatusToString(status));
     }
-    pclose(pipe);
-
-    try {
-        double duration = std::stod(result);
-        return static_cast<int>(duration) + 1;
-    } catch (const std::exception& e) {
-        std::cerr << "Error: Failed to parse video duration" << std::endl;
-        return -1;
+    // The frames of a video whose pre-processing has finished may be in use by the next stages
+    if (requests::IsVideoPastStatus(status, requests::VideoStatus::PreProcessingStarted)) {
+        std::cout << "Video " << redis_id << " has already been pre-processed, skipping the job" << std::endl;
+        return crow::response(requests::kStageSkippedCode);
     }
-}
-
-/**
- * @brief Splits the frames in the specified directory into multiple subdirectories.
- * 
- * This function takes a directory path as input and splits the frames in that directory
- * into multiple subdirectories. Each subdirectory contains a specified number of frames.
- * The frames are moved from the original directory to the subdirectories based on the
- * specified number of frames per directory.
- * 
- * @param frames_path The path of the directory containing the frames.
- */
-void SplitFramesIntoDirectories(const std::string& frames_path) {
-    std::size_t frame_count = 0;
-    std::size_t dir_count = 0;
-    const int frames_per_directory = 60;
-    std::string current_dir = frames_path + "/../dir_" + std::to_string(dir_count);
-    fs::create_directory(current_dir);
-
-    for (const auto& entry : fs::directory_iterator(frames_path)) {
-        if (entry.is_regular_file()) {
-            std::string frame_path = entry.path().string();
-            std::string new_frame_path = current_dir + "/" + entry.path().filename().string();
-            fs::rename(frame_path, new_frame_path);
-            frame_count++;
 
-            if (frame_count >= frames_per_directory) {
-                frame_count = 0;
-                dir_count++;
-                current_dir = frames_path + "/dir_" + std::to_string(dir_count);
-                fs::create_directory(current_dir);
-            }
-        }
-    }
-}
-
-/**
- * @brief Deletes all the original frames in the specified directory.
- * 
- * This function iterates over all the files in the given directory and deletes
- * any regular files found. It does not delete directories or other types of files.
- * 
- * @param frames_path The path to the directory containing the original frames.
- */
-void DeleteOriginalFrames(const std::string& frames_path) {
-    for (const auto& entry : fs::directory_iterator(frames_path)) {
-        if (entry.is_regular_file()) {
-            fs::remove(entry.path());
-        }
+    // Start from an empty dir, a redelivered job must not mix its frames with those of an interrupted run
+    std::error_code ec;
+    fs::remove_all(output_path, ec);
+    fs::create_directories(output_path, ec);
+    if (ec) {
+        return crow::response(500, "Failed to create the frames directory: " + ec.message());
     }
-}
-
-/**
- * Process the frames of a video.
- *
- * This function splits the frames into directories and deletes the original frames.
- *
- * @param frames_path The path to the directory containing the frames.
- */
-void ProcessFrames(const std::string& frames_path) {
-    SplitFramesIntoDirectories(frames_path);
-    DeleteOriginalFrames(frames_path);
-}
 
-/**
- * Extracts frames from a video file and saves them as individual images.
- * 
- * @param video_path The path to the video file.
- * @param output_path The path to the directory where the extracted frames will be saved.
- */
-bool ExtractFrames(const std::string& video_path, const std::string& output_path) {
-    const std::string command = std::string(FFMPEG_EXECUTABLE) + " -i " + video_path + " -vf fps=1 " + output_path + "/frame_%04d.png";
-    int result = std::system(command.c_str());
-    if (result != 0) {
-        std::cerr << "Error: FFmpeg command failed with code " << result << std::endl;
-        return false;
+    // Sample, resize and split the frames into chunk directories in one pass
+    const auto& extraction_config = config.getExtraction();
+    extraction::ExtractionOptions extraction_options{};
+    extraction_options.segmented = extraction_config.segmented;
+    extraction_options.segment_workers = extraction_config.segment_workers;
+    extraction_options.min_segment_seconds = static_cast<double>(extraction_config.min_segment_seconds);
+    // Thumbnails of the frames are needed to skip unchanged frames and to hash them for the result cache
+    const bool hash_frames = config.getResultCache().enabled;
+    const bool make_thumbnails = extraction_config.gating || hash_frames;
+    extraction::FrameThumbnails thumbnails;
+    const bool extraction_success = extraction::ExtractFrames(video_path, output_path, extraction_options,
+                                                              make_thumbnails ? &thumbnails : nullptr);
+    if (!extraction_success) {
+        return crow::response(500, "Failed to extract frames from video");
     }
-    return true;
-}
 
-/**
- * Copies all .png files from one directory to another.
- * 
- * @param source_dir The path to the source directory.
- * @param destination_dir The path to the destination directory.
- */
-void CopyPngFiles(const std::string& source_dir, const std::string& destination_dir) {
-    for (const auto& entry : fs::directory_iterator(source_dir)) {
-        if (entry.is_regular_file() && entry.path().extension() == ".png") {
-            fs::copy_file(entry.path(), destination_dir + "/" + entry.path().filename().string());
+    // Drop the frames that did not change since the last analyzed one, they inherit its detections
+    if (make_thumbnails) {
+        extraction::GatingOptions gating_options{};
+        gating_options.enabled = extraction_config.gating;
+        gating_options.threshold = extraction_config.gating_threshold;
+        gating_options.max_inherited = extraction_config.max_inherited_frames;
+        auto selection = extraction::SelectFrames(thumbnails.Get(), gating_options);
+        if (hash_frames) {
+            extraction::AddFrameHashes(thumbnails.Get(), selection);
         }
-    }
-}
-
-/**
- * Resizes all images in a folder using ffmpeg.
- * 
- * @param folder_path The path to the folder containing the images.
- * @param width The width of the resized images.
- * @param height The height of the resized images.
- * @return true if the images were resized successfully, false otherwise.
- */
-bool ResizeImagesInFolder(const std::string& folder_path, const std::size_t width, const std::size_t height, 
-                          std::function<void(const std::string&, const std::string&)> fallback = nullptr){
-    fs::create_directory(folder_path + "/resized");
-    const std::string command = std::string(FFMPEG_EXECUTABLE) + " -y -hide_banner -loglevel panic -r 1 -f image2 -i \"" + 
-                           folder_path + "/%*.png\" -vf scale=" + std::to_string(width) + ":" 
-                           + std::to_string(height) + " \"" + folder_path + "/resized_%*.png\"";
-    std::cout << "Resizing images using command: " << command << std::endl;
-    int result = std::system(command.c_str());
-    if (result != 0) {
-        std::cerr << "Error: Failed to resize images using ffmpeg." << std::endl;
-        if (fallback) {
-            std::cout << "Using fallback" << std::endl;
-            fallback(folder_path, folder_path + "/resized");
-            return true;
+        if (!extraction::ApplyFrameSelection(output_path, extraction_options, selection)) {
+            return crow::response(500, "Failed to apply the frame selection");
         }
-        return false;
+        std::cout << "Kept " << selection.analyzed_count << " of " << selection.frames_count
+                  << " frames of " << redis_id << " for analysis" << std::endl;
     }
-    return true;
-}
 
-} // namespace
+    return crow::response(200, "Processing finished.");
+}
 
 /**
  * Binds the process_video handler to the specified Crow application.
- * This handler processes a video by extracting frames from it and saving them to a directory.
+ * With the queue dispatch mode the handler only adds the job to the pre-processing stream,
+ * otherwise it processes the video before answering.
  * 
  * @param app The Crow application to bind the handler to.
  */
@@ -189,52 +108,11 @@ void BindProcessVideoHandler(crow::SimpleApp& app) {
             return crow::response(401, "Invalid JSON");
         }
 
-        const std::string video_path = body["video_path"].s();
-        const std::string redis_id = body["redis_id"].s();
-        const std::string output_path = "../../../tmp/frames/frames-" + redis_id;
-        
-        const auto& config = cfg::GlobalConfig::getInstance();
-        const auto& redis = config.getRedis();
-        auto redis_conn = redis_utils::RedisConnect(redis.host, redis.port);
-
-        const auto status_opt = redis_utils::RedisGetRequestVideoStatus(redis_conn, redis_id);
-        if (!status_opt.has_value()) {
-            return crow::response(500, "Failed to get video status from Redis");
-        }
-        const auto& status = status_opt.value();
-        if (status == requests::VideoStatus::Failed || status == requests::VideoStatus::Stopped) {
-            return crow::response(400, "Pipe broken by video status = " + requests::VideoStatusToString(status));
-        }
-
-        // const int video_duration = GetVideoDuration(video_path);
-        // if (video_duration == -1) {
-        //    return crow::response(500, "Failed to get video duration");
-        // }
-
-        // Create initial dir for frames
-        fs::create_directory(output_path);
-
-        const bool extraction_success = ExtractFrames(video_path, output_path);
-        if (!extraction_success) {
-            return crow::response(500, "Failed to extract frames from video");
-        }
-
-        // Resize images
-        constexpr std::size_t resize_width = 600;
-        constexpr std::size_t resize_height = 400;
-        const bool resize_success = ResizeImagesInFolder(output_path, resize_width, resize_height, CopyPngFiles);
-        if (!resize_success) {
-            return crow::response(500, "Failed to resize images");
+        const auto& queue = cfg::GlobalConfig::getInstance().getQueue();
+        if (queue.dispatch == cfg::GlobalConfig::DispatchMode::Queue) {
+            return redis_utils::EnqueueStageJob(redis_utils::kPreProcessingStream, req.body);
         }
-
-        if (status == requests::VideoStatus::Failed || status == requests::VideoStatus::Stopped) {
-            return crow::response(400, "Pipe broken by video status = " + requests::VideoStatusToString(status));
-        }
-
-        // Process the frames
-        ProcessFrames(output_path + "/resized");
-
-        return crow::response(200, "Processing finished.");
+        return ProcessVideo(body);
     });
 }
 
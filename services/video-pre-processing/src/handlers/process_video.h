@@ -4,6 +4,8 @@
 
 namespace handlers {
 
+crow::response ProcessVideo(const crow::json::rvalue& body);
+
 void BindProcessVideoHandler(crow::SimpleApp& app);
 
-} // namespace handlers
\ No newline at end of file
+} // namespace handlers
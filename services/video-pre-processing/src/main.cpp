@@ -1,17 +1,34 @@
+#include <memory>
+
 #include <crow.h>
 
 #include "../../../utils/cfg/global_config.h"
+#include "../../../utils/http/health.h"
+#include "../../../utils/redis/redis_stream.h"
+#include "../../../utils/redis/stage_jobs.h"
 
 #include "handlers/handlers_frw.h"
 
-int main() {
+int main(int argc, char* argv[]) {
     crow::SimpleApp app;
 
     handlers::BindProcessVideoHandler(app);
+    utils::http::BindHealthHandler(app);
 
     const auto& config = cfg::GlobalConfig::getInstance();
+
+    std::unique_ptr<redis::StreamWorker> worker;
+    if (config.getQueue().dispatch == cfg::GlobalConfig::DispatchMode::Queue) {
+        worker = redis_utils::StartStageWorker(redis_utils::kPreProcessingStream, "video-pre-processing",
+                                               handlers::ProcessVideo);
+    }
+
     const auto& app_config = config.getVideoPreProcessing();
-    app.port(app_config.port).multithreaded().run();
+    app.port(cfg::GetListenPort(argc, argv, app_config.port)).multithreaded().run();
+
+    if (worker) {
+        worker->Stop();
+    }
 
     return 0;
 }
@@ -9,6 +9,46 @@
 
 namespace cfg {
 
+namespace {
+
+/**
+ * Parses the optional "instances" list of a service.
+ * Without the list the service has a single instance, the one given by its host and port.
+ *
+ * @param serviceData The JSON object of the service.
+ * @param service The service's own host and port.
+ * @return All the instances of the service.
+ */
+std::vector<GlobalConfig::ServiceData> ParseServiceInstances(const crow::json::rvalue& serviceData,
+                                                             const GlobalConfig::ServiceData& service) {
+    std::vector<GlobalConfig::ServiceData> instances;
+    instances.push_back(service);
+    if (serviceData.has("instances")) {
+        for (const auto& instanceData : serviceData["instances"]) {
+            GlobalConfig::ServiceData instance;
+            instance.host = instanceData["host"].s();
+            instance.port = instanceData["port"].i();
+            if (instance.host != service.host || instance.port != service.port) {
+                instances.push_back(instance);
+            }
+        }
+    }
+    return instances;
+}
+
+/**
+ * Prints the instances of a service.
+ */
+void LogServiceInstances(const std::vector<GlobalConfig::ServiceData>& instances) {
+    std::cout << "Instances:";
+    for (const auto& instance : instances) {
+        std::cout << " " << instance.host << ":" << instance.port;
+    }
+    std::cout << "\n";
+}
+
+} // namespace
+
 std::string GlobalConfig::DatabaseConfig::getConnectionString() const {
     return "dbname=" + dbname + " user=" + user + " password=" + password + 
            " hostaddr=" + hostaddr + " port=" + std::to_string(port);
@@ -43,31 +83,37 @@ void GlobalConfig::loadConfig(const std::string& configFile, const bool log_pars
             auto frameAnalyticsData = configData["frame-analytics"];
             frame_analytics.host = frameAnalyticsData["host"].s();
             frame_analytics.port = frameAnalyticsData["port"].i();
+            frame_analytics_instances = ParseServiceInstances(frameAnalyticsData, frame_analytics);
 
             if (log_parsing) {
                 std::cout << "Parsed frame-analytics data\n";
                 std::cout << "Host: " << frame_analytics.host << "\n";
                 std::cout << "Port: " << frame_analytics.port << "\n";
+                LogServiceInstances(frame_analytics_instances);
             }
 
             auto videoPreProcessingData = configData["video-pre-processing"];
             video_pre_processing.host = videoPreProcessingData["host"].s();
             video_pre_processing.port = videoPreProcessingData["port"].i();
+            video_pre_processing_instances = ParseServiceInstances(videoPreProcessingData, video_pre_processing);
 
             if (log_parsing) {
                 std::cout << "Parsed video pre-processing data\n";
                 std::cout << "Host: " << video_pre_processing.host << "\n";
                 std::cout << "Port: " << video_pre_processing.port << "\n";
+                LogServiceInstances(video_pre_processing_instances);
             }
 
             auto videoPostProcessingData = configData["video-post-processing"];
             video_post_processing.host = videoPostProcessingData["host"].s();
             video_post_processing.port = videoPostProcessingData["port"].i();
+            video_post_processing_instances = ParseServiceInstances(videoPostProcessingData, video_post_processing);
 
             if (log_parsing) {
                 std::cout << "Parsed video post-processing data\n";
                 std::cout << "Host: " << video_post_processing.host << "\n";
                 std::cout << "Port: " << video_post_processing.port << "\n";
+                LogServiceInstances(video_post_processing_instances);
             }
 
             auto redisData = configData["redis"];
@@ -80,6 +126,25 @@ void GlobalConfig::loadConfig(const std::string& configFile, const bool log_pars
                 std::cout << "Port: " << redis.port << "\n";
             }
 
+            // The redis_pool section is optional, defaults are used when it is missing
+            if (configData.has("redis_pool")) {
+                auto redisPoolData = configData["redis_pool"];
+                redis_pool.size = redisPoolData["size"].i();
+                if (redisPoolData.has("checkout_timeout_ms")) {
+                    redis_pool.checkout_timeout_ms = redisPoolData["checkout_timeout_ms"].i();
+                }
+                if (redisPoolData.has("validate_after_ms")) {
+                    redis_pool.validate_after_ms = redisPoolData["validate_after_ms"].i();
+                }
+            }
+
+            if (log_parsing) {
+                std::cout << "Parsed redis pool data\n";
+                std::cout << "Size: " << redis_pool.size << "\n";
+                std::cout << "Checkout timeout: " << redis_pool.checkout_timeout_ms << " ms\n";
+                std::cout << "Validate after: " << redis_pool.validate_after_ms << " ms\n";
+            }
+
             auto pgDbData = configData["pg"];
             pg_db.dbname = pgDbData["database"].s();
             pg_db.user = pgDbData["user"].s();
@@ -95,6 +160,249 @@ void GlobalConfig::loadConfig(const std::string& configFile, const bool log_pars
                 std::cout << "Host: " << pg_db.hostaddr << "\n";
                 std::cout << "Port: " << pg_db.port << "\n";
             }
+
+            // The pg_pool section is optional, defaults are used when it is missing
+            if (configData.has("pg_pool")) {
+                auto pgPoolData = configData["pg_pool"];
+                pg_pool.size = pgPoolData["size"].i();
+                if (pgPoolData.has("checkout_timeout_ms")) {
+                    pg_pool.checkout_timeout_ms = pgPoolData["checkout_timeout_ms"].i();
+                }
+                if (pgPoolData.has("validate_after_ms")) {
+                    pg_pool.validate_after_ms = pgPoolData["validate_after_ms"].i();
+                }
+            }
+
+            if (log_parsing) {
+                std::cout << "Parsed PostgreSQL pool data\n";
+                std::cout << "Size: " << pg_pool.size << "\n";
+                std::cout << "Checkout timeout: " << pg_pool.checkout_timeout_ms << " ms\n";
+                std::cout << "Validate after: " << pg_pool.validate_after_ms << " ms\n";
+            }
+
+            // The status_writes section is optional, defaults are used when it is missing
+            if (configData.has("status_writes")) {
+                auto statusWritesData = configData["status_writes"];
+                if (statusWritesData.has("max_batch")) {
+                    status_writes.max_batch = statusWritesData["max_batch"].i();
+                }
+                if (statusWritesData.has("flush_interval_ms")) {
+                    status_writes.flush_interval_ms = statusWritesData["flush_interval_ms"].i();
+                }
+                if (statusWritesData.has("sync_terminal")) {
+                    status_writes.sync_terminal = statusWritesData["sync_terminal"].b();
+                }
+            }
+
+            if (log_parsing) {
+                std::cout << "Parsed status writes data\n";
+                std::cout << "Max batch: " << status_writes.max_batch << "\n";
+                std::cout << "Flush interval: " << status_writes.flush_interval_ms << " ms\n";
+                std::cout << "Sync terminal: " << (status_writes.sync_terminal ? "true" : "false") << "\n";
+            }
+
+            // The health section is optional, defaults are used when it is missing
+            if (configData.has("health")) {
+                auto healthData = configData["health"];
+                // Every key is optional, the missing ones keep their defaults
+                if (healthData.has("probe_interval_ms")) {
+                    health.probe_interval_ms = healthData["probe_interval_ms"].i();
+                }
+                if (healthData.has("probe_timeout_ms")) {
+                    health.probe_timeout_ms = healthData["probe_timeout_ms"].i();
+                }
+                if (healthData.has("failure_threshold")) {
+                    health.failure_threshold = healthData["failure_threshold"].i();
+                }
+                if (healthData.has("open_duration_ms")) {
+                    health.open_duration_ms = healthData["open_duration_ms"].i();
+                }
+            }
+
+            if (log_parsing) {
+                std::cout << "Parsed health data\n";
+                std::cout << "Probe interval: " << health.probe_interval_ms << " ms\n";
+                std::cout << "Probe timeout: " << health.probe_timeout_ms << " ms\n";
+                std::cout << "Failure threshold: " << health.failure_threshold << "\n";
+                std::cout << "Open duration: " << health.open_duration_ms << " ms\n";
+            }
+
+            // The queue section is optional, without it the stages are called over HTTP
+            if (configData.has("queue")) {
+                auto queueData = configData["queue"];
+                const std::string dispatch = queueData["dispatch"].s();
+                if (dispatch == "queue") {
+                    queue.dispatch = DispatchMode::Queue;
+                } else if (dispatch == "http") {
+                    queue.dispatch = DispatchMode::Http;
+                } else {
+                    throw std::runtime_error("Unknown queue dispatch mode: " + dispatch);
+                }
+                queue.consumers = queueData["consumers"].i();
+                queue.block_ms = queueData["block_ms"].i();
+                queue.claim_idle_ms = queueData["claim_idle_ms"].i();
+                queue.max_deliveries = queueData["max_deliveries"].i();
+            }
+
+            if (log_parsing) {
+                std::cout << "Parsed queue data\n";
+                std::cout << "Dispatch: " << (queue.dispatch == DispatchMode::Queue ? "queue" : "http") << "\n";
+                std::cout << "Consumers: " << queue.consumers << "\n";
+                std::cout << "Block: " << queue.block_ms << " ms\n";
+                std::cout << "Claim idle: " << queue.claim_idle_ms << " ms\n";
+                std::cout << "Max deliveries: " << queue.max_deliveries << "\n";
+            }
+
+            // The inference section is optional, defaults are used when it is missing
+            if (configData.has("inference")) {
+                auto inferenceData = configData["inference"];
+                if (inferenceData.has("backend")) {
+                    const std::string backend = inferenceData["backend"].s();
+                    if (backend == "python") {
+                        inference.backend = InferenceBackend::Python;
+                    } else if (backend == "onnx") {
+                        inference.backend = InferenceBackend::Onnx;
+                    } else {
+                        throw std::runtime_error("Unknown inference backend: " + backend);
+                    }
+                }
+                inference.workers = inferenceData["workers"].i();
+                inference.python = inferenceData["python"].s();
+                inference.worker_script = inferenceData["worker_script"].s();
+                if (inferenceData.has("worker_startup_timeout_ms")) {
+                    inference.worker_startup_timeout_ms = inferenceData["worker_startup_timeout_ms"].i();
+                }
+                if (inferenceData.has("worker_request_timeout_ms")) {
+                    inference.worker_request_timeout_ms = inferenceData["worker_request_timeout_ms"].i();
+                }
+                if (inferenceData.has("onnx_model")) {
+                    inference.onnx_model = inferenceData["onnx_model"].s();
+                }
+                if (inferenceData.has("onnx_threads")) {
+                    inference.onnx_threads = inferenceData["onnx_threads"].i();
+                }
+                if (inferenceData.has("chunk_concurrency")) {
+                    inference.chunk_concurrency = inferenceData["chunk_concurrency"].i();
+                }
+                if (inferenceData.has("batch_size")) {
+                    inference.batch_size = inferenceData["batch_size"].i();
+                }
+                if (inferenceData.has("batch_max_wait_ms")) {
+                    inference.batch_max_wait_ms = inferenceData["batch_max_wait_ms"].i();
+                }
+            }
+
+            if (log_parsing) {
+                std::cout << "Parsed inference data\n";
+                std::cout << "Backend: " << (inference.backend == InferenceBackend::Onnx ? "onnx" : "python") << "\n";
+                std::cout << "Workers: " << inference.workers << "\n";
+                std::cout << "Python: " << inference.python << "\n";
+                std::cout << "Worker script: " << inference.worker_script << "\n";
+                std::cout << "Worker startup timeout: " << inference.worker_startup_timeout_ms << " ms\n";
+                std::cout << "Worker request timeout: " << inference.worker_request_timeout_ms << " ms\n";
+                std::cout << "ONNX model: " << inference.onnx_model << "\n";
+                std::cout << "ONNX threads: " << inference.onnx_threads << "\n";
+                std::cout << "Chunk concurrency: " << inference.chunk_concurrency << "\n";
+                std::cout << "Batch size: " << inference.batch_size << "\n";
+                std::cout << "Batch max wait: " << inference.batch_max_wait_ms << " ms\n";
+            }
+
+            // The extraction section is optional, defaults are used when it is missing
+            if (configData.has("extraction")) {
+                auto extractionData = configData["extraction"];
+                extraction.segmented = extractionData["segmented"].b();
+                if (extractionData.has("segment_workers")) {
+                    extraction.segment_workers = extractionData["segment_workers"].i();
+                }
+                if (extractionData.has("min_segment_seconds")) {
+                    extraction.min_segment_seconds = extractionData["min_segment_seconds"].i();
+                }
+                if (extractionData.has("gating")) {
+                    extraction.gating = extractionData["gating"].b();
+                }
+                if (extractionData.has("gating_threshold")) {
+                    extraction.gating_threshold = extractionData["gating_threshold"].d();
+                }
+                if (extractionData.has("max_inherited_frames")) {
+                    extraction.max_inherited_frames = extractionData["max_inherited_frames"].i();
+                }
+            }
+
+            if (log_parsing) {
+                std::cout << "Parsed extraction data\n";
+                std::cout << "Segmented: " << (extraction.segmented ? "true" : "false") << "\n";
+                std::cout << "Segment workers: " << extraction.segment_workers << "\n";
+                std::cout << "Min segment: " << extraction.min_segment_seconds << " s\n";
+                std::cout << "Gating: " << (extraction.gating ? "true" : "false") << "\n";
+                std::cout << "Gating threshold: " << extraction.gating_threshold << "\n";
+                std::cout << "Max inherited frames: " << extraction.max_inherited_frames << "\n";
+            }
+
+            // The result cache section is optional, the cache is disabled when it is missing
+            if (configData.has("result_cache")) {
+                auto resultCacheData = configData["result_cache"];
+                result_cache.enabled = resultCacheData["enabled"].b();
+                if (resultCacheData.has("max_distance")) {
+                    result_cache.max_distance = resultCacheData["max_distance"].i();
+                }
+                if (resultCacheData.has("capacity")) {
+                    result_cache.capacity = resultCacheData["capacity"].i();
+                }
+            }
+
+            if (log_parsing) {
+                std::cout << "Parsed result cache data\n";
+                std::cout << "Enabled: " << (result_cache.enabled ? "true" : "false") << "\n";
+                std::cout << "Max distance: " << result_cache.max_distance << "\n";
+                std::cout << "Capacity: " << result_cache.capacity << "\n";
+            }
+
+            // The dedup section is optional, defaults are used when it is missing
+            if (configData.has("dedup")) {
+                auto dedupData = configData["dedup"];
+                dedup.enabled = dedupData["enabled"].b();
+                if (dedupData.has("in_flight_ttl_s")) {
+                    dedup.in_flight_ttl_s = dedupData["in_flight_ttl_s"].i();
+                }
+            }
+
+            if (log_parsing) {
+                std::cout << "Parsed dedup data\n";
+                std::cout << "Enabled: " << (dedup.enabled ? "true" : "false") << "\n";
+                std::cout << "In-flight TTL: " << dedup.in_flight_ttl_s << " s\n";
+            }
+
+            // The status_updates section is optional, defaults are used when it is missing
+            if (configData.has("status_updates")) {
+                auto statusUpdatesData = configData["status_updates"];
+                if (statusUpdatesData.has("long_poll_timeout_ms")) {
+                    status_updates.long_poll_timeout_ms = statusUpdatesData["long_poll_timeout_ms"].i();
+                }
+                if (statusUpdatesData.has("max_waiters")) {
+                    status_updates.max_waiters = statusUpdatesData["max_waiters"].i();
+                }
+            }
+
+            if (log_parsing) {
+                std::cout << "Parsed status updates data\n";
+                std::cout << "Long-poll timeout: " << status_updates.long_poll_timeout_ms << " ms\n";
+                std::cout << "Max waiters: " << status_updates.max_waiters << "\n";
+            }
+
+            // The finished_cache section is optional, defaults are used when it is missing
+            if (configData.has("finished_cache")) {
+                auto finishedCacheData = configData["finished_cache"];
+                finished_cache.enabled = finishedCacheData["enabled"].b();
+                if (finishedCacheData.has("max_bytes")) {
+                    finished_cache.max_bytes = finishedCacheData["max_bytes"].i();
+                }
+            }
+
+            if (log_parsing) {
+                std::cout << "Parsed finished cache data\n";
+                std::cout << "Enabled: " << (finished_cache.enabled ? "true" : "false") << "\n";
+                std::cout << "Max bytes: " << finished_cache.max_bytes << "\n";
+            }
         } catch (const std::exception& e) {
             std::cerr << "Error parsing config file: " << e.what() << std::endl;
         }
@@ -130,12 +438,83 @@ const GlobalConfig::ServiceData& GlobalConfig::getVideoPostProcessing() const {
     return video_post_processing;
 }
 
+const std::vector<GlobalConfig::ServiceData>& GlobalConfig::getFrameAnalyticsInstances() const {
+    return frame_analytics_instances;
+}
+
+const std::vector<GlobalConfig::ServiceData>& GlobalConfig::getVideoPreProcessingInstances() const {
+    return video_pre_processing_instances;
+}
+
+const std::vector<GlobalConfig::ServiceData>& GlobalConfig::getVideoPostProcessingInstances() const {
+    return video_post_processing_instances;
+}
+
 const GlobalConfig::ServiceData& GlobalConfig::getRedis() const {
     return redis;
 }
 
+const GlobalConfig::RedisPoolConfig& GlobalConfig::getRedisPool() const {
+    return redis_pool;
+}
+
 const GlobalConfig::DatabaseConfig& GlobalConfig::getPgDatabaseConfig() const {
     return pg_db;
 }
 
+const GlobalConfig::PgPoolConfig& GlobalConfig::getPgPool() const {
+    return pg_pool;
+}
+
+const GlobalConfig::StatusWritesConfig& GlobalConfig::getStatusWrites() const {
+    return status_writes;
+}
+
+const GlobalConfig::HealthConfig& GlobalConfig::getHealth() const {
+    return health;
+}
+
+const GlobalConfig::QueueConfig& GlobalConfig::getQueue() const {
+    return queue;
+}
+
+const GlobalConfig::InferenceConfig& GlobalConfig::getInference() const {
+    return inference;
+}
+
+const GlobalConfig::ExtractionConfig& GlobalConfig::getExtraction() const {
+    return extraction;
+}
+
+const GlobalConfig::ResultCacheConfig& GlobalConfig::getResultCache() const {
+    return result_cache;
+}
+
+const GlobalConfig::DedupConfig& GlobalConfig::getDedup() const {
+    return dedup;
+}
+
+const GlobalConfig::StatusUpdatesConfig& GlobalConfig::getStatusUpdates() const {
+    return status_updates;
+}
+
+const GlobalConfig::FinishedCacheConfig& GlobalConfig::getFinishedCache() const {
+    return finished_cache;
+}
+
+std::size_t GetListenPort(int argc, char* argv[], const std::size_t default_port) {
+    const std::string prefix = "--port=";
+    for (int i = 1; i < argc; ++i) {
+        const std::string arg = argv[i];
+        if (arg.rfind(prefix, 0) == 0) {
+            try {
+                return std::stoul(arg.substr(prefix.size()));
+            } catch (const std::exception&) {
+                std::cerr << "Invalid port argument: " << arg << std::endl;
+            }
+        }
+    }
+    return default_port;
+}
+
 } // namespace cfg
\ No newline at end of file
@@ -1,6 +1,7 @@
 #pragma once
 
 #include <string>
+#include <vector>
 
 namespace cfg {
 
@@ -23,6 +24,119 @@ public:
         std::string getConnectionString() const;
     };
 
+    struct PgPoolConfig {
+        std::size_t size = 8;
+        std::size_t checkout_timeout_ms = 2000;
+        // Connections idle for longer than this are validated with a SELECT 1 on checkout
+        std::size_t validate_after_ms = 1000;
+    };
+
+    enum class DispatchMode {
+        // The orchestrator calls every stage over HTTP and waits for its response
+        Http,
+        // The stages consume their jobs from Redis Streams and report back on an events stream
+        Queue
+    };
+
+    struct QueueConfig {
+        DispatchMode dispatch = DispatchMode::Http;
+        std::size_t consumers = 1;
+        std::size_t block_ms = 2000;
+        std::size_t claim_idle_ms = 600000;
+        std::size_t max_deliveries = 3;
+    };
+
+    struct RedisPoolConfig {
+        std::size_t size = 16;
+        std::size_t checkout_timeout_ms = 2000;
+        // Connections idle for longer than this are validated with a PING on checkout
+        std::size_t validate_after_ms = 1000;
+    };
+
+    struct StatusWritesConfig {
+        // In-progress statuses are written to the database in batches, the latest one per video
+        std::size_t max_batch = 500;
+        std::size_t flush_interval_ms = 200;
+        // Final statuses are written right away instead of with the next batch
+        bool sync_terminal = true;
+    };
+
+    struct HealthConfig {
+        std::size_t probe_interval_ms = 1000;
+        std::size_t probe_timeout_ms = 500;
+        std::size_t failure_threshold = 3;
+        std::size_t open_duration_ms = 5000;
+    };
+
+    enum class InferenceBackend {
+        // Long-lived Python workers running ultralytics
+        Python,
+        // The exported ONNX model run in-process by ONNX Runtime
+        Onnx
+    };
+
+    struct InferenceConfig {
+        InferenceBackend backend = InferenceBackend::Python;
+        // Number of long-lived inference worker processes of the frame-analysis service
+        std::size_t workers = 2;
+        std::string python = "python3";
+        std::string worker_script = "../yolo/yolo_worker.py";
+        // A worker that does not send its ready frame or answer a request in time is killed and restarted
+        std::size_t worker_startup_timeout_ms = 120000;
+        std::size_t worker_request_timeout_ms = 60000;
+        std::string onnx_model = "../yolo/yolov8n.onnx";
+        // Threads ONNX Runtime uses for one frame, 0 lets it decide
+        std::size_t onnx_threads = 0;
+        // Number of frame chunks of one video analyzed concurrently
+        std::size_t chunk_concurrency = 4;
+        // Frames of all videos are analyzed by the Python workers in batches of up to batch_size, 1 disables batching
+        std::size_t batch_size = 16;
+        std::size_t batch_max_wait_ms = 20;
+    };
+
+    struct ExtractionConfig {
+        // Long videos are split into segments starting at keyframes which are decoded in parallel
+        bool segmented = false;
+        // Upper bound of parallel segments of one video, 0 uses the number of cores
+        std::size_t segment_workers = 0;
+        std::size_t min_segment_seconds = 120;
+        // Frames that barely differ from the last analyzed frame are not analyzed and inherit its detections
+        bool gating = false;
+        // Mean absolute difference of gray levels (0-255) above which a frame counts as changed
+        double gating_threshold = 3.0;
+        // A frame is analyzed at least once per this many sampled frames
+        std::size_t max_inherited_frames = 30;
+    };
+
+    struct ResultCacheConfig {
+        // Frames get a perceptual hash and frame-analysis reuses the results of near-identical frames
+        bool enabled = false;
+        // Maximum number of differing bits between the 64-bit hashes of two frames sharing a result
+        std::size_t max_distance = 4;
+        std::size_t capacity = 100000;
+    };
+
+    struct DedupConfig {
+        // Submissions of already analyzed or in-flight video content reuse that analysis
+        bool enabled = true;
+        // How long a fingerprint stays claimed by the video processing it, should it never finish
+        std::size_t in_flight_ttl_s = 86400;
+    };
+
+    struct StatusUpdatesConfig {
+        // How long a status long-poll is held open when the status does not change
+        std::size_t long_poll_timeout_ms = 25000;
+        // Long-polls held open at once, further ones are refused
+        std::size_t max_waiters = 10000;
+    };
+
+    struct FinishedCacheConfig {
+        // The orchestrator keeps the status responses of finished videos in memory
+        bool enabled = true;
+        // Memory budget of the cached responses, the least recently read are evicted above it
+        std::size_t max_bytes = 64 * 1024 * 1024;
+    };
+
     static GlobalConfig& getInstance();
     void loadConfig(const std::string& configFile, const bool log_parsing = false);
 
@@ -30,8 +144,22 @@ public:
     const ServiceData& getFrameAnalytics() const;
     const ServiceData& getVideoPreProcessing() const;
     const ServiceData& getVideoPostProcessing() const;
+    const std::vector<ServiceData>& getFrameAnalyticsInstances() const;
+    const std::vector<ServiceData>& getVideoPreProcessingInstances() const;
+    const std::vector<ServiceData>& getVideoPostProcessingInstances() const;
     const ServiceData& getRedis() const;
+    const RedisPoolConfig& getRedisPool() const;
     const DatabaseConfig& getPgDatabaseConfig() const;
+    const PgPoolConfig& getPgPool() const;
+    const StatusWritesConfig& getStatusWrites() const;
+    const HealthConfig& getHealth() const;
+    const QueueConfig& getQueue() const;
+    const InferenceConfig& getInference() const;
+    const ExtractionConfig& getExtraction() const;
+    const ResultCacheConfig& getResultCache() const;
+    const DedupConfig& getDedup() const;
+    const StatusUpdatesConfig& getStatusUpdates() const;
+    const FinishedCacheConfig& getFinishedCache() const;
 
 private:
     GlobalConfig() = default;
@@ -44,9 +172,32 @@ private:
     ServiceData video_pre_processing;
     ServiceData video_post_processing;
 
+    // All the instances of a scaled out service, the first one is the service's own host and port
+    std::vector<ServiceData> frame_analytics_instances;
+    std::vector<ServiceData> video_pre_processing_instances;
+    std::vector<ServiceData> video_post_processing_instances;
+
     ServiceData redis;
+    RedisPoolConfig redis_pool;
 
     DatabaseConfig pg_db;
+    PgPoolConfig pg_pool;
+    StatusWritesConfig status_writes;
+
+    HealthConfig health;
+    QueueConfig queue;
+    InferenceConfig inference;
+    ExtractionConfig extraction;
+    ResultCacheConfig result_cache;
+    DedupConfig dedup;
+    StatusUpdatesConfig status_updates;
+    FinishedCacheConfig finished_cache;
 };
 
+/**
+ * @brief Returns the port a service should listen on: the value of a "--port=N" argument
+ *        if one is given, so several instances can run from the same config, or the configured port.
+ */
+std::size_t GetListenPort(int argc, char* argv[], std::size_t default_port);
+
 } // namespace cfg
\ No newline at end of file
@@ -1,43 +1,155 @@
 #include "pg.h"
 
+#include <algorithm>
 #include <filesystem>
 #include <fstream>
 #include <iostream>
+#include <unordered_set>
+#include <vector>
 
 #include <pqxx/pqxx>
 #include <crow/returnable.h>
 
 #include "../cfg/global_config.h"
+#include "pg_pool.h"
 
 
 namespace utils {
 namespace db {
 
+namespace {
+
+// Key of the advisory lock serializing the migration runners of the services
+constexpr long long kMigrationsLockKey = 7231849104625120325LL;
+
+constexpr const char* kSaveAnalysisResult = "save_analysis_result";
+constexpr const char* kDeleteFrames = "delete_frames";
+constexpr const char* kSaveRequestOnReceive = "save_request_on_receive";
+constexpr const char* kReuseFinishedResult = "reuse_finished_result";
+constexpr const char* kUpdateVideoStatus = "update_video_status";
+constexpr const char* kUpdateVideoStatuses = "update_video_statuses";
+constexpr const char* kGetVideoStatus = "get_video_status";
+constexpr const char* kGetAnalysisResult = "get_analysis_result";
+constexpr const char* kGetVideoStatuses = "get_video_statuses";
+constexpr const char* kGetVideoStatusesWithResult = "get_video_statuses_with_result";
+
+// The result of a finished video: the JSONB value of the results saved before the frames and detections
+// tables, otherwise the JSON rebuilt from the rows of the video
+const std::string kStoredResult = "COALESCE(analysis_results.result,"
+    " (SELECT video_results.result FROM video_results WHERE video_results.id = analysis_results.id))";
+
+/**
+ * Returns the value of a numeric JSON field, std::nullopt if it is missing or not a number.
+ */
+std::optional<double> GetNumber(const crow::json::rvalue& value, const char* key) {
+    if (!value.has(key) || value[key].t() != crow::json::type::Number) {
+        return std::nullopt;
+    }
+    return value[key].d();
+}
+
+} // namespace
+
+/**
+ * Returns the statements prepared on every pooled connection, which the functions below execute.
+ */
+const std::vector<PreparedStatement>& GetPreparedStatements() {
+    static const std::vector<PreparedStatement> statements = {
+        // The result itself is in the frames and detections tables
+        {kSaveAnalysisResult,
+         "UPDATE analysis_results SET result = NULL, video_status = 'Finished' WHERE id = $1"},
+        {kDeleteFrames,
+         "DELETE FROM frames WHERE video_id = $1"},
+        {kSaveRequestOnReceive,
+         "INSERT INTO analysis_results (id, result, video_status, fingerprint) VALUES ($1, '{}', 'Received', $2)"},
+        {kReuseFinishedResult,
+         "UPDATE analysis_results SET result = source.result, video_status = 'Finished'"
+         " FROM (SELECT " + kStoredResult + " AS result FROM analysis_results WHERE fingerprint = $2"
+         " AND video_status = 'Finished' AND id <> $1 LIMIT 1) AS source WHERE analysis_results.id = $1"},
+        {kUpdateVideoStatus,
+         "UPDATE analysis_results SET video_status = $2 WHERE id = $1"},
+        // Batched statuses may lag behind a final status written directly, which they must not overwrite
+        {kUpdateVideoStatuses,
+         "UPDATE analysis_results SET video_status = batch.video_status"
+         " FROM unnest($1::varchar[], $2::varchar[]) AS batch(id, video_status)"
+         " WHERE analysis_results.id = batch.id"
+         " AND analysis_results.video_status NOT IN ('Finished', 'Failed', 'Stopped')"},
+        {kGetVideoStatus,
+         "SELECT video_status FROM analysis_results WHERE id = $1"},
+        {kGetAnalysisResult,
+         "SELECT " + kStoredResult + " FROM analysis_results WHERE id = $1"},
+        // The result is only read when asked for, it is by far the largest column
+        {kGetVideoStatuses,
+         "SELECT id, video_status, NULL FROM analysis_results WHERE id = ANY($1)"},
+        {kGetVideoStatusesWithResult,
+         "SELECT id, video_status, CASE WHEN video_status = 'Finished' THEN " + kStoredResult + " END"
+         " FROM analysis_results WHERE id = ANY($1)"},
+    };
+    return statements;
+}
+
 /**
- * Saves the analysis result to the database.
+ * Saves the analysis result to the database, one row per frame and per detection streamed with COPY,
+ * and marks the video as finished. Rows saved before for the video, by an earlier delivery, are replaced.
  * 
  * @param id The ID of the analysis result.
- * @param analysis_result The analysis result to be saved.
+ * @param analysis_result The analysis result to be saved, the list of the results of the frames.
  * @return True if the analysis result is successfully saved, false otherwise.
  */
-bool SaveAnalysisResult(const std::string& id, const crow::json::wvalue& analysis_result) {
+bool SaveAnalysisResult(const std::string& id, const crow::json::rvalue& analysis_result) {
     try {
-        const auto& config = cfg::GlobalConfig::getInstance();
-        const auto& pg_db = config.getPgDatabaseConfig();
-        pqxx::connection C(pg_db.getConnectionString());
-        if (!C.is_open()) {
+        if (!analysis_result || analysis_result.t() != crow::json::type::List) {
+            std::cerr << "Analysis result of " << id << " is not a list of frames" << std::endl;
+            return false;
+        }
+
+        auto C = PgPool::getInstance().acquire();
+        if (!C) {
             std::cerr << "Can't open database" << std::endl;
             return false;
         }
 
-        pqxx::work W(C);
-        std::string query = "UPDATE analysis_results SET result = " +
-                    W.quote(analysis_result.dump()) + ", video_status = " + W.quote("Finished") +
-                    " WHERE id = " + W.quote(id) + ";";
+        pqxx::work W(*C);
+        W.exec_prepared(kDeleteFrames, id);
+
+        // Frames first, the detections reference them
+        auto frames = pqxx::stream_to::table(W, {"frames"}, {"video_id", "frame_index", "file", "inherited_from"});
+        int frame_index = 0;
+        for (const auto& frame : analysis_result) {
+            const std::string file = frame.has("file") ? std::string(frame["file"].s()) : std::string();
+            const std::optional<std::string> inherited_from = frame.has("inherited_from")
+                ? std::optional<std::string>(frame["inherited_from"].s())
+                : std::nullopt;
+            frames.write_values(id, frame_index++, file, inherited_from);
+        }
+        frames.complete();
+
+        auto detections = pqxx::stream_to::table(W, {"detections"},
+            {"video_id", "frame_index", "detection_index", "class_name", "x_min", "y_min", "x_max", "y_max", "confidence"});
+        frame_index = 0;
+        for (const auto& frame : analysis_result) {
+            if (frame.has("boxes") && frame["boxes"].t() == crow::json::type::List) {
+                int detection_index = 0;
+                for (const auto& box : frame["boxes"]) {
+                    if (!box.has("box") || box["box"].t() != crow::json::type::List || box["box"].size() != 4) {
+                        continue;
+                    }
+                    double coordinates[4];
+                    for (std::size_t i = 0; i < 4; ++i) {
+                        coordinates[i] = box["box"][i].d();
+                    }
+                    const std::string class_name = box.has("class") ? std::string(box["class"].s()) : std::string();
+                    detections.write_values(id, frame_index, detection_index++, class_name,
+                                            coordinates[0], coordinates[1], coordinates[2], coordinates[3],
+                                            GetNumber(box, "confidence"));
+                }
+            }
+            ++frame_index;
+        }
+        detections.complete();
 
-        W.exec(query);
+        W.exec_prepared(kSaveAnalysisResult, id);
         W.commit();
-        C.close();
         return true;
     } catch (const std::exception &e) {
         std::cerr << e.what() << std::endl;
@@ -49,25 +161,22 @@ bool SaveAnalysisResult(const std::string& id, const crow::json::wvalue& analysi
  * Saves a new request to the database.
  * 
  * @param id The ID of the request.
+ * @param fingerprint The content fingerprint of the video, empty if unknown.
  * @return True if the request is successfully saved, false otherwise.
  */
-bool SaveRequestOnReceive(const std::string& id) {
+bool SaveRequestOnReceive(const std::string& id, const std::string& fingerprint) {
     try {
-        const auto& config = cfg::GlobalConfig::getInstance();
-        const auto& pg_db = config.getPgDatabaseConfig();
-        pqxx::connection C(pg_db.getConnectionString());
-        if (!C.is_open()) {
+        auto C = PgPool::getInstance().acquire();
+        if (!C) {
             std::cerr << "Can't open database" << std::endl;
             return false;
         }
 
-        pqxx::work W(C);
-        std::string query = "INSERT INTO analysis_results (id, result, video_status) VALUES (" +
-                            W.quote(id) + ", " + W.quote("{}") + ", " + W.quote("Received") + ");";
-
-        W.exec(query);
+        pqxx::work W(*C);
+        const std::optional<std::string> fingerprint_value =
+            fingerprint.empty() ? std::nullopt : std::optional<std::string>(fingerprint);
+        W.exec_prepared(kSaveRequestOnReceive, id, fingerprint_value);
         W.commit();
-        C.close();
         return true;
     } catch (const std::exception &e) {
         std::cerr << e.what() << std::endl;
@@ -75,6 +184,31 @@ bool SaveRequestOnReceive(const std::string& id) {
     }
 }
 
+/**
+ * Finishes a request with the result of an already finished request for the same video content.
+ * 
+ * @param id The ID of the request.
+ * @param fingerprint The content fingerprint of the video.
+ * @return True if a finished result has been copied, false if there is none or an error occurred.
+ */
+bool ReuseFinishedResult(const std::string& id, const std::string& fingerprint) {
+    try {
+        auto C = PgPool::getInstance().acquire();
+        if (!C) {
+            std::cerr << "Can't open database" << std::endl;
+            return false;
+        }
+
+        pqxx::work W(*C);
+        const pqxx::result result = W.exec_prepared(kReuseFinishedResult, id, fingerprint);
+        W.commit();
+        return result.affected_rows() > 0;
+    } catch (const std::exception &e) {
+        std::cerr << e.what() << std::endl;
+        return false;
+    }
+}
+
 /**
  * Updates the video_status for the given ID in the PostgreSQL database.
  * 
@@ -84,23 +218,44 @@ bool SaveRequestOnReceive(const std::string& id) {
  */
 bool UpdateVideoStatus(const std::string& id, const std::string& video_status) {
     try {
-        const auto& config = cfg::GlobalConfig::getInstance();
-        const auto& pg_db = config.getPgDatabaseConfig();
-        pqxx::connection C(pg_db.getConnectionString());
-        if (!C.is_open()) {
+        auto C = PgPool::getInstance().acquire();
+        if (!C) {
             std::cerr << "Can't open database" << std::endl;
             return false;
         }
 
-        pqxx::work W(C);
+        pqxx::work W(*C);
+        W.exec_prepared(kUpdateVideoStatus, id, video_status);
+        W.commit();
+        return true;
+    } catch (const std::exception &e) {
+        std::cerr << e.what() << std::endl;
+        return false;
+    }
+}
+
+/**
+ * Updates the video_status of several videos in one statement, leaving the videos with a final status as they are.
+ * 
+ * @param ids The IDs of the videos.
+ * @param video_statuses The new video statuses, in the order of the IDs.
+ * @return True if the video statuses are successfully updated, false otherwise.
+ */
+bool UpdateVideoStatuses(const std::vector<std::string>& ids, const std::vector<std::string>& video_statuses) {
+    try {
+        if (ids.empty()) {
+            return true;
+        }
 
-        std::string query = "UPDATE analysis_results SET video_status = " +
-                            W.quote(video_status) + " WHERE id = " + W.quote(id) + ";";
-        std::cout << "Query: " << query << std::endl;
+        auto C = PgPool::getInstance().acquire();
+        if (!C) {
+            std::cerr << "Can't open database" << std::endl;
+            return false;
+        }
 
-        W.exec(query);
+        pqxx::work W(*C);
+        W.exec_prepared(kUpdateVideoStatuses, ids, video_statuses);
         W.commit();
-        C.close();
         return true;
     } catch (const std::exception &e) {
         std::cerr << e.what() << std::endl;
@@ -116,27 +271,19 @@ bool UpdateVideoStatus(const std::string& id, const std::string& video_status) {
  */
 std::optional<std::string> GetVideoStatus(const std::string& id) {
     try {
-        const auto& config = cfg::GlobalConfig::getInstance();
-        const auto& pg_db = config.getPgDatabaseConfig();
-        pqxx::connection C(pg_db.getConnectionString());
-        if (!C.is_open()) {
+        auto C = PgPool::getInstance().acquire();
+        if (!C) {
             std::cerr << "Can't open database" << std::endl;
             return std::nullopt;
         }
 
-        pqxx::work W(C);
-
-        std::string query = "SELECT video_status FROM analysis_results WHERE id = " + W.quote(id) + ";";
-
-        pqxx::result result = W.exec(query);
+        pqxx::work W(*C);
+        pqxx::result result = W.exec_prepared(kGetVideoStatus, id);
+        W.commit();
         if (result.empty()) {
             return std::nullopt;
         }
-
-        std::string video_status = result[0][0].as<std::string>();
-        W.commit();
-        C.close();
-        return video_status;
+        return result[0][0].as<std::string>();
     } catch (const std::exception &e) {
         std::cerr << e.what() << std::endl;
         return std::nullopt;
@@ -151,27 +298,21 @@ std::optional<std::string> GetVideoStatus(const std::string& id) {
  */
 std::optional<crow::json::wvalue> GetAnalysisResult(const std::string& id) {
     try {
-        const auto& config = cfg::GlobalConfig::getInstance();
-        const auto& pg_db = config.getPgDatabaseConfig();
-        pqxx::connection C(pg_db.getConnectionString());
-        if (!C.is_open()) {
+        auto C = PgPool::getInstance().acquire();
+        if (!C) {
             std::cerr << "Can't open database" << std::endl;
             return std::nullopt;
         }
 
-        pqxx::work W(C);
-
-        std::string query = "SELECT result FROM analysis_results WHERE id = " + W.quote(id) + ";";
-
-        pqxx::result result = W.exec(query);
+        pqxx::work W(*C);
+        pqxx::result result = W.exec_prepared(kGetAnalysisResult, id);
+        W.commit();
         if (result.empty()) {
             return std::nullopt;
         }
 
         crow::json::wvalue analysis_result;
         analysis_result = crow::json::load(result[0][0].as<std::string>());
-        W.commit();
-        C.close();
         return analysis_result;
     } catch (const std::exception &e) {
         std::cerr << e.what() << std::endl;
@@ -180,40 +321,219 @@ std::optional<crow::json::wvalue> GetAnalysisResult(const std::string& id) {
 }
 
 /**
- * Applies database migrations to the specified PostgreSQL database.
+ * Retrieves the video_status of several videos from the PostgreSQL database in one query.
+ * 
+ * @param ids The IDs of the videos.
+ * @param with_result Whether to also retrieve the analysis result of the finished videos.
+ * @return The records of the videos that were found, keyed by ID, std::nullopt if an error occurred.
+ */
+std::optional<std::unordered_map<std::string, VideoStatusRecord>> GetVideoStatuses(const std::vector<std::string>& ids,
+                                                                                   const bool with_result) {
+    try {
+        std::unordered_map<std::string, VideoStatusRecord> records;
+        if (ids.empty()) {
+            return records;
+        }
+
+        auto C = PgPool::getInstance().acquire();
+        if (!C) {
+            std::cerr << "Can't open database" << std::endl;
+            return std::nullopt;
+        }
+
+        pqxx::work W(*C);
+        const pqxx::result result = W.exec_prepared(with_result ? kGetVideoStatusesWithResult : kGetVideoStatuses, ids);
+        W.commit();
+        for (const auto& row : result) {
+            VideoStatusRecord record;
+            record.status = row[1].as<std::string>();
+            if (!row[2].is_null()) {
+                record.result = crow::json::wvalue(crow::json::load(row[2].as<std::string>()));
+            }
+            records.emplace(row[0].as<std::string>(), std::move(record));
+        }
+        return records;
+    } catch (const std::exception &e) {
+        std::cerr << e.what() << std::endl;
+        return std::nullopt;
+    }
+}
+
+/**
+ * Searches the detections of all the videos, in time order and then in the order of their keys.
+ * The filters are only added to the query when they are set, so that the planner picks the index
+ * of the filters actually used; the indexes on (detected_at, key) and (class_name, detected_at, key)
+ * serve both the time window and the order, so a page reads only its own rows. The next page starts
+ * right after the time and the key of the last detection.
+ * 
+ * @param query The filters, the position to start from and the maximum number of detections.
+ * @return The detections found, std::nullopt if an error occurred.
+ */
+std::optional<std::vector<Detection>> SearchDetections(const DetectionQuery& query) {
+    try {
+        auto C = PgPool::getInstance().acquire();
+        if (!C) {
+            std::cerr << "Can't open database" << std::endl;
+            return std::nullopt;
+        }
+
+        pqxx::params params;
+        std::size_t params_count = 0;
+        const auto next_param = [&params_count]() {
+            return "$" + std::to_string(++params_count);
+        };
+
+        std::string sql = "SELECT video_id, frame_index, detection_index, class_name, x_min, y_min, x_max, y_max,"
+                          " confidence, detected_at,"
+                          " (EXTRACT(EPOCH FROM detected_at) * 1000000)::bigint FROM detections WHERE TRUE";
+        if (query.class_name.has_value()) {
+            sql += " AND class_name = " + next_param();
+            params.append(query.class_name.value());
+        }
+        if (!query.video_ids.empty()) {
+            sql += " AND video_id = ANY(" + next_param() + "::varchar[])";
+            params.append(query.video_ids);
+        }
+        if (query.from.has_value()) {
+            sql += " AND detected_at >= " + next_param() + "::timestamptz";
+            params.append(query.from.value());
+        }
+        if (query.to.has_value()) {
+            sql += " AND detected_at < " + next_param() + "::timestamptz";
+            params.append(query.to.value());
+        }
+        if (query.min_area.has_value()) {
+            sql += " AND box_area >= " + next_param();
+            params.append(query.min_area.value());
+        }
+        if (query.after.has_value()) {
+            const std::string detected_at_param = next_param();
+            const std::string video_id_param = next_param();
+            const std::string frame_index_param = next_param();
+            const std::string detection_index_param = next_param();
+            // The time of the cursor is rebuilt with integer arithmetic, so that it is exactly the stored one
+            sql += " AND (detected_at, video_id, frame_index, detection_index) > ('epoch'::timestamptz + " +
+                   detected_at_param + "::bigint * interval '1 microsecond', " + video_id_param + ", " +
+                   frame_index_param + "::integer, " + detection_index_param + "::integer)";
+            params.append(query.after->detected_at_us);
+            params.append(query.after->video_id);
+            params.append(query.after->frame_index);
+            params.append(query.after->detection_index);
+        }
+        sql += " ORDER BY detected_at, video_id, frame_index, detection_index LIMIT " + next_param();
+        params.append(static_cast<long long>(query.limit));
+
+        pqxx::work W(*C);
+        const pqxx::result result = W.exec_params(sql, params);
+        W.commit();
+
+        std::vector<Detection> detections;
+        detections.reserve(result.size());
+        for (const auto& row : result) {
+            Detection detection;
+            detection.key.video_id = row[0].as<std::string>();
+            detection.key.frame_index = row[1].as<long long>();
+            detection.key.detection_index = row[2].as<long long>();
+            detection.class_name = row[3].as<std::string>();
+            detection.x_min = row[4].as<double>();
+            detection.y_min = row[5].as<double>();
+            detection.x_max = row[6].as<double>();
+            detection.y_max = row[7].as<double>();
+            if (!row[8].is_null()) {
+                detection.confidence = row[8].as<double>();
+            }
+            detection.detected_at = row[9].as<std::string>();
+            detection.key.detected_at_us = row[10].as<long long>();
+            detections.push_back(std::move(detection));
+        }
+        return detections;
+    } catch (const std::exception &e) {
+        std::cerr << e.what() << std::endl;
+        return std::nullopt;
+    }
+}
+
+/**
+ * Applies the pending database migrations to the specified PostgreSQL database.
+ * The migrations are the .sql files of the directory, applied in the lexical order of their names, each
+ * in its own transaction together with its version, the file name without extension, in schema_migrations.
+ * The migrations already recorded there are skipped. An advisory lock is held meanwhile, so that services
+ * starting at the same time apply each migration once.
  *
  * @param connection_str The connection string for the PostgreSQL database.
  * @param migrations_dir The directory containing the migration files.
+ * @return True if all the migrations are applied, false if one failed, leaving it and the next ones pending.
  */
-void ApplyMigrations(const std::string& connection_str, const std::string& migrations_dir) {
+bool ApplyMigrations(const std::string& connection_str, const std::string& migrations_dir) {
     try {
         pqxx::connection C(connection_str);
         if (!C.is_open()) {
             std::cerr << "Can't open database" << std::endl;
-            return;
+            return false;
         }
 
-        pqxx::work txn(C);
+        // Held by the session, it is released when the connection closes should the runner fail
+        {
+            pqxx::nontransaction N(C);
+            N.exec_params("SELECT pg_advisory_lock($1)", kMigrationsLockKey);
+            N.exec("CREATE TABLE IF NOT EXISTS schema_migrations ("
+                   " version VARCHAR(255) PRIMARY KEY,"
+                   " applied_at TIMESTAMPTZ NOT NULL DEFAULT now())");
+        }
+
+        std::unordered_set<std::string> applied;
+        {
+            pqxx::nontransaction N(C);
+            for (const auto& row : N.exec("SELECT version FROM schema_migrations")) {
+                applied.insert(row[0].as<std::string>());
+            }
+        }
 
+        // Migrations build on each other, they are applied in the order of their numbered names
+        std::vector<std::filesystem::path> migration_files;
         for (const auto& entry : std::filesystem::directory_iterator(migrations_dir)) {
-            std::ifstream file(entry.path());
-            if (!file.is_open()) {
-                std::cerr << "Cannot open migration file: " << entry.path() << std::endl;
+            if (entry.is_regular_file() && entry.path().extension() == ".sql") {
+                migration_files.push_back(entry.path());
+            }
+        }
+        std::sort(migration_files.begin(), migration_files.end(), [](const auto& a, const auto& b) {
+            return a.filename().string() < b.filename().string();
+        });
+
+        bool success = true;
+        for (const auto& path : migration_files) {
+            const std::string version = path.stem().string();
+            if (applied.count(version) > 0) {
                 continue;
             }
 
+            std::ifstream file(path);
+            if (!file.is_open()) {
+                std::cerr << "Cannot open migration file: " << path << std::endl;
+                success = false;
+                break;
+            }
+
             std::string sql((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
             try {
+                pqxx::work txn(C);
                 txn.exec(sql);
-                std::cout << "Successfully applied migration: " << entry.path() << std::endl;
+                txn.exec_params("INSERT INTO schema_migrations (version) VALUES ($1)", version);
+                txn.commit();
+                std::cout << "Successfully applied migration: " << path << std::endl;
             } catch (const std::exception &e) {
-                std::cerr << "Failed to apply migration: " << entry.path() << ". Error: " << e.what() << std::endl;
+                std::cerr << "Failed to apply migration: " << path << ". Error: " << e.what() << std::endl;
+                success = false;
+                break;
             }
         }
 
-        txn.commit();
+        pqxx::nontransaction N(C);
+        N.exec_params("SELECT pg_advisory_unlock($1)", kMigrationsLockKey);
+        return success;
     } catch (const std::exception &e) {
         std::cerr << e.what() << std::endl;
+        return false;
     }
 }
 
@@ -2,18 +2,75 @@
 
 #include <string>
 #include <optional>
+#include <unordered_map>
+#include <vector>
 
 #include <crow/json.h>
 
+#include "pg_pool.h"
+
 namespace utils {
 namespace db {
 
-bool SaveAnalysisResult(const std::string& id, const crow::json::wvalue& analysis_result);
-bool SaveRequestOnReceive(const std::string& id);
+/**
+ * @brief The status of a video as stored in the database, with its result when it has been asked for
+ * and the video is finished.
+ */
+struct VideoStatusRecord {
+    std::string status;
+    std::optional<crow::json::wvalue> result;
+};
+
+/**
+ * @brief The position of a detection in the order of the search results, also used as pagination cursor.
+ */
+// The position of a detection in the order of the search, which is time first
+struct DetectionKey {
+    // detected_at in microseconds since the Unix epoch, exact unlike its text form
+    long long detected_at_us = 0;
+    std::string video_id;
+    long long frame_index = 0;
+    long long detection_index = 0;
+};
+
+struct Detection {
+    DetectionKey key;
+    std::string class_name;
+    double x_min = 0;
+    double y_min = 0;
+    double x_max = 0;
+    double y_max = 0;
+    std::optional<double> confidence;
+    std::string detected_at;
+};
+
+/**
+ * @brief The filters of a detection search, the unset ones match every detection.
+ */
+struct DetectionQuery {
+    std::optional<std::string> class_name;
+    std::vector<std::string> video_ids;
+    // Time window [from, to) of the detections, as PostgreSQL timestamps
+    std::optional<std::string> from;
+    std::optional<std::string> to;
+    std::optional<double> min_area;
+    // The last detection of the previous page
+    std::optional<DetectionKey> after;
+    std::size_t limit = 100;
+};
+
+const std::vector<PreparedStatement>& GetPreparedStatements();
+bool SaveAnalysisResult(const std::string& id, const crow::json::rvalue& analysis_result);
+bool SaveRequestOnReceive(const std::string& id, const std::string& fingerprint = "");
+bool ReuseFinishedResult(const std::string& id, const std::string& fingerprint);
 bool UpdateVideoStatus(const std::string& id, const std::string& video_status);
+bool UpdateVideoStatuses(const std::vector<std::string>& ids, const std::vector<std::string>& video_statuses);
 std::optional<std::string> GetVideoStatus(const std::string& id);
 std::optional<crow::json::wvalue> GetAnalysisResult(const std::string& id);
-void ApplyMigrations(const std::string& connection_str, const std::string& migrations_dir);
+std::optional<std::unordered_map<std::string, VideoStatusRecord>> GetVideoStatuses(const std::vector<std::string>& ids,
+                                                                                   bool with_result);
+std::optional<std::vector<Detection>> SearchDetections(const DetectionQuery& query);
+bool ApplyMigrations(const std::string& connection_str, const std::string& migrations_dir);
 
 } // namespace db
 } // namespace utils
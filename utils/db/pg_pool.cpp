@@ -1,17 +1,53 @@
 #include "pg_pool.h"
+#include "pg.h"
 #include "../cfg/global_config.h"
 #include <iostream>
+#include <utility>
 
 namespace utils {
 namespace db {
 
+PooledPgConnection::~PooledPgConnection() {
+    release();
+}
+
+PooledPgConnection::PooledPgConnection(PooledPgConnection&& other) noexcept
+    : pool_(std::exchange(other.pool_, nullptr)), connection_(std::exchange(other.connection_, nullptr)) {
+}
+
+PooledPgConnection& PooledPgConnection::operator=(PooledPgConnection&& other) noexcept {
+    if (this != &other) {
+        release();
+        pool_ = std::exchange(other.pool_, nullptr);
+        connection_ = std::exchange(other.connection_, nullptr);
+    }
+    return *this;
+}
+
+void PooledPgConnection::release() {
+    if (pool_ != nullptr && connection_ != nullptr) {
+        pool_->releaseConnection(connection_);
+    }
+    pool_ = nullptr;
+    connection_ = nullptr;
+}
+
 PgPool& PgPool::getInstance() {
-    static PgPool instance;
+    const auto& config = cfg::GlobalConfig::getInstance();
+    const auto& poolConfig = config.getPgPool();
+    Options options;
+    options.size = poolConfig.size;
+    options.checkout_timeout = std::chrono::milliseconds(poolConfig.checkout_timeout_ms);
+    options.validate_after = std::chrono::milliseconds(poolConfig.validate_after_ms);
+    static PgPool instance(config.getPgDatabaseConfig().getConnectionString(), GetPreparedStatements(), options);
     return instance;
 }
 
-PgPool::PgPool() {
-    connect();
+PgPool::PgPool(std::string connection_string, std::vector<PreparedStatement> statements, Options options)
+    : connection_string_(std::move(connection_string)), statements_(std::move(statements)), options_(options) {
+    if (options_.size == 0) {
+        options_.size = 1;
+    }
 }
 
 PgPool::~PgPool() {
@@ -19,7 +55,7 @@ PgPool::~PgPool() {
 }
 
 void PgPool::operate(const char* query) {
-    pqxx::connection* conn = getConnection();
+    PooledPgConnection conn = acquire();
     if (conn) {
         try {
             pqxx::work txn(*conn);
@@ -28,61 +64,114 @@ void PgPool::operate(const char* query) {
         } catch (const std::exception& e) {
             std::cerr << "Failed to execute query: " << e.what() << std::endl;
         }
-        releaseConnection(conn);
     } else {
         std::cerr << "Not connected to PostgreSQL" << std::endl;
     }
 }
 
-pqxx::connection* PgPool::getConnection() {
-    std::lock_guard<std::mutex> lock(mutex_);
-    if (!connections_.empty()) {
-        pqxx::connection* conn = connections_.front();
-        connections_.pop();
-        return conn;
-    } else {
-        std::cerr << "No available connections in the pool" << std::endl;
-        return nullptr;
-    }
-}
+PooledPgConnection PgPool::acquire() {
+    const auto deadline = std::chrono::steady_clock::now() + options_.checkout_timeout;
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (true) {
+        if (!idle_.empty()) {
+            const IdleConnection idle = idle_.back();
+            idle_.pop_back();
 
-void PgPool::connect() {
-    std::lock_guard<std::mutex> lock(mutex_);
-    const auto& pg_db = cfg::GlobalConfig::getInstance().getPgDatabaseConfig();
-    for (int i = 0; i < poolSize_; i++) {
-        try {
-            pqxx::connection* conn = new pqxx::connection(pg_db.getConnectionString());
-            if (conn->is_open()) {
-                connections_.push(conn);
-                std::cout << "Connected to PostgreSQL" << std::endl;
-            } else {
-                std::cerr << "Failed to open PostgreSQL connection" << std::endl;
-                delete conn;
+            const bool needs_validation = std::chrono::steady_clock::now() - idle.since >= options_.validate_after;
+            if (!needs_validation) {
+                return PooledPgConnection(this, idle.connection);
             }
-        } catch (const std::exception& e) {
-            std::cerr << "Failed to connect to PostgreSQL: " << e.what() << std::endl;
+            lock.unlock();
+            if (validate(idle.connection)) {
+                return PooledPgConnection(this, idle.connection);
+            }
+            // Replace the broken connection
+            delete idle.connection;
+            pqxx::connection* connection = connect();
+            lock.lock();
+            if (connection != nullptr) {
+                return PooledPgConnection(this, connection);
+            }
+            --open_;
+            cv_.notify_one();
+            return PooledPgConnection();
+        }
+
+        if (open_ < options_.size) {
+            ++open_;
+            lock.unlock();
+            pqxx::connection* connection = connect();
+            lock.lock();
+            if (connection != nullptr) {
+                return PooledPgConnection(this, connection);
+            }
+            --open_;
+            cv_.notify_one();
+            return PooledPgConnection();
+        }
+
+        if (cv_.wait_until(lock, deadline) == std::cv_status::timeout && idle_.empty() && open_ >= options_.size) {
+            std::cerr << "Timed out waiting for a PostgreSQL connection from the pool" << std::endl;
+            return PooledPgConnection();
         }
     }
 }
 
-void PgPool::disconnect() {
-    std::lock_guard<std::mutex> lock(mutex_);
-    while (!connections_.empty()) {
-        pqxx::connection* conn = connections_.front();
-        connections_.pop();
-        if (conn) {
-            conn->close();
-            delete conn;
-            std::cout << "Disconnected from PostgreSQL" << std::endl;
+/**
+ * Opens a connection and prepares the statements on it.
+ *
+ * @return The connection, nullptr if it could not be opened or a statement could not be prepared.
+ */
+pqxx::connection* PgPool::connect() {
+    try {
+        auto connection = std::make_unique<pqxx::connection>(connection_string_);
+        if (!connection->is_open()) {
+            std::cerr << "Failed to open PostgreSQL connection" << std::endl;
+            return nullptr;
+        }
+        for (const auto& statement : statements_) {
+            connection->prepare(statement.name, statement.sql);
         }
+        return connection.release();
+    } catch (const std::exception& e) {
+        std::cerr << "Failed to connect to PostgreSQL: " << e.what() << std::endl;
+        return nullptr;
     }
 }
 
-void PgPool::releaseConnection(pqxx::connection* conn) {
-    std::lock_guard<std::mutex> lock(mutex_);
-    if (conn) {
-        connections_.push(conn);
+bool PgPool::validate(pqxx::connection* connection) {
+    if (!connection->is_open()) {
+        return false;
+    }
+    try {
+        pqxx::nontransaction txn(*connection);
+        txn.exec("SELECT 1");
+        return true;
+    } catch (const std::exception&) {
+        return false;
+    }
+}
+
+void PgPool::releaseConnection(pqxx::connection* connection) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    if (!connection->is_open()) {
+        // A connection that broke is dropped, the next checkout opens a new one
+        delete connection;
+        --open_;
+    } else {
+        idle_.push_back(IdleConnection{connection, std::chrono::steady_clock::now()});
+    }
+    cv_.notify_one();
+}
+
+void PgPool::disconnect() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    for (const auto& idle : idle_) {
+        idle.connection->close();
+        delete idle.connection;
     }
+    open_ -= idle_.size();
+    idle_.clear();
 }
 
 } // namespace db
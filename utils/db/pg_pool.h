@@ -1,40 +1,121 @@
 #pragma once
 
-#include <iostream>
-#include <vector>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <memory>
 #include <mutex>
-#include <queue>
+#include <string>
+#include <vector>
 
 #include <pqxx/pqxx>
 
-#include "../cfg/global_config.h"
-
 namespace utils {
 namespace db {
 
+class PgPool;
+
+/**
+ * @brief A statement prepared on every connection of the pool, executed with exec_prepared(name, ...).
+ */
+struct PreparedStatement {
+    std::string name;
+    std::string sql;
+};
+
+/**
+ * @brief A PostgreSQL connection checked out of the pool, returned to it when the handle goes out of scope.
+ *
+ * A handle may be empty when no connection could be checked out in time, which is tested with
+ * operator bool. A connection that has been closed, e.g. after a broken_connection error, is dropped
+ * instead of being returned.
+ */
+class PooledPgConnection {
+public:
+    PooledPgConnection() = default;
+    PooledPgConnection(PgPool* pool, pqxx::connection* connection) : pool_(pool), connection_(connection) {}
+    ~PooledPgConnection();
+
+    PooledPgConnection(const PooledPgConnection&) = delete;
+    PooledPgConnection& operator=(const PooledPgConnection&) = delete;
+    PooledPgConnection(PooledPgConnection&& other) noexcept;
+    PooledPgConnection& operator=(PooledPgConnection&& other) noexcept;
+
+    pqxx::connection& operator*() const {
+        return *connection_;
+    }
+
+    pqxx::connection* get() const {
+        return connection_;
+    }
+
+    explicit operator bool() const {
+        return connection_ != nullptr;
+    }
+
+private:
+    void release();
+
+    PgPool* pool_ = nullptr;
+    pqxx::connection* connection_ = nullptr;
+};
+
+/**
+ * @brief Bounded pool of PostgreSQL connections shared by all the threads of a service.
+ *
+ * Connections are opened lazily up to the pool size and reused afterwards, and the statements of
+ * utils::db are prepared once on each of them when it is opened. A connection that has been idle for
+ * a while is validated with a SELECT 1 when it is checked out, and a broken connection is replaced by
+ * a new one. A checkout waits at most checkout_timeout for a connection to be returned.
+ */
 class PgPool {
 public:
+    struct Options {
+        std::size_t size = 8;
+        std::chrono::milliseconds checkout_timeout{2000};
+        // Idle connections older than this are validated before being handed out
+        std::chrono::milliseconds validate_after{1000};
+    };
+
     static PgPool& getInstance();
 
+    PgPool(const PgPool&) = delete;
+    PgPool& operator=(const PgPool&) = delete;
+
+    /**
+     * @brief Checks a connection out of the pool.
+     *
+     * @return The connection, or an empty handle if none could be opened or returned in time.
+     */
+    PooledPgConnection acquire();
+
     void operate(const char* query);
 
 private:
-    PgPool();
-    ~PgPool();
+    friend class PooledPgConnection;
 
-    PgPool(const PgPool&) = delete;
-    PgPool& operator=(const PgPool&) = delete;
+    struct IdleConnection {
+        pqxx::connection* connection;
+        std::chrono::steady_clock::time_point since;
+    };
 
-    pqxx::connection* getConnection();
-    void connect();
+    PgPool(std::string connection_string, std::vector<PreparedStatement> statements, Options options);
+    ~PgPool();
+
+    pqxx::connection* connect();
+    bool validate(pqxx::connection* connection);
+    void releaseConnection(pqxx::connection* connection);
     void disconnect();
-    void releaseConnection(pqxx::connection* conn);
 
-    std::queue<pqxx::connection*> connections_;
+    std::string connection_string_;
+    std::vector<PreparedStatement> statements_;
+    Options options_;
+    // Connections currently open, idle or checked out
+    std::size_t open_ = 0;
+    std::vector<IdleConnection> idle_;
     std::mutex mutex_;
-    int poolSize_ = 5;
+    std::condition_variable cv_;
 };
 
 } // namespace db
 } // namespace utils
-
@@ -0,0 +1,134 @@
+#include "status_batcher.h"
+#include "pg.h"
+#include "../cfg/global_config.h"
+#include <algorithm>
+#include <iostream>
+#include <utility>
+#include <vector>
+
+namespace utils {
+namespace db {
+
+StatusBatcher& StatusBatcher::getInstance() {
+    const auto& writesConfig = cfg::GlobalConfig::getInstance().getStatusWrites();
+    Options options;
+    options.max_batch = writesConfig.max_batch;
+    options.flush_interval = std::chrono::milliseconds(writesConfig.flush_interval_ms);
+    options.sync_terminal = writesConfig.sync_terminal;
+    static StatusBatcher instance(options);
+    return instance;
+}
+
+StatusBatcher::StatusBatcher(Options options)
+    : options_(options) {
+    if (options_.max_batch == 0) {
+        options_.max_batch = 1;
+    }
+}
+
+StatusBatcher::~StatusBatcher() {
+    Stop();
+}
+
+void StatusBatcher::Start() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (thread_.joinable()) {
+        return;
+    }
+    stopping_ = false;
+    thread_ = std::thread([this] {
+        Run();
+    });
+}
+
+void StatusBatcher::Stop() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stopping_ = true;
+    }
+    cv_.notify_all();
+    if (thread_.joinable()) {
+        thread_.join();
+    }
+
+    std::unique_lock<std::mutex> lock(mutex_);
+    Flush(lock);
+}
+
+bool StatusBatcher::Update(const std::string& id, const requests::VideoStatus status) {
+    const std::string video_status = requests::VideoStatusToString(status);
+    if (options_.sync_terminal && requests::IsFinalVideoStatus(status)) {
+        {
+            // An earlier status still waiting is superseded, and could not overwrite the final one anyway
+            std::lock_guard<std::mutex> lock(mutex_);
+            pending_.erase(id);
+        }
+        return UpdateVideoStatus(id, video_status);
+    }
+
+    std::size_t pending_count;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        pending_[id] = video_status;
+        pending_count = pending_.size();
+    }
+    if (pending_count >= options_.max_batch) {
+        cv_.notify_one();
+    }
+    return true;
+}
+
+void StatusBatcher::Run() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (!stopping_) {
+        cv_.wait_for(lock, options_.flush_interval, [this] {
+            return stopping_ || pending_.size() >= options_.max_batch;
+        });
+        if (stopping_) {
+            break;
+        }
+        Flush(lock);
+    }
+}
+
+/**
+ * Writes the statuses waiting, max_batch videos per statement. The statuses of a failed statement are
+ * kept for the next flush, unless a newer status of their video has arrived in the meantime.
+ *
+ * @param lock The held lock of the batcher, released while writing.
+ */
+void StatusBatcher::Flush(std::unique_lock<std::mutex>& lock) {
+    if (pending_.empty()) {
+        return;
+    }
+    std::unordered_map<std::string, std::string> batch;
+    batch.swap(pending_);
+    lock.unlock();
+
+    std::vector<std::pair<std::string, std::string>> failed;
+    std::vector<std::string> ids;
+    std::vector<std::string> video_statuses;
+    ids.reserve(std::min(batch.size(), options_.max_batch));
+    video_statuses.reserve(std::min(batch.size(), options_.max_batch));
+    for (auto it = batch.begin(); it != batch.end();) {
+        ids.clear();
+        video_statuses.clear();
+        const auto chunk_begin = it;
+        for (; it != batch.end() && ids.size() < options_.max_batch; ++it) {
+            ids.push_back(it->first);
+            video_statuses.push_back(it->second);
+        }
+        if (!UpdateVideoStatuses(ids, video_statuses)) {
+            std::cerr << "Failed to write " << ids.size() << " video statuses, retrying with the next flush" << std::endl;
+            failed.insert(failed.end(), chunk_begin, it);
+        }
+    }
+
+    lock.lock();
+    for (auto& [id, video_status] : failed) {
+        pending_.emplace(std::move(id), std::move(video_status));
+    }
+}
+
+} // namespace db
+} // namespace utils
@@ -0,0 +1,76 @@
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+
+#include "../http/requests.h"
+
+namespace utils {
+namespace db {
+
+/**
+ * @brief Writes the video statuses to the database behind the request path, in batches.
+ *
+ * Statuses are gathered from all the videos and only the latest one of each video is kept until the
+ * next flush, which writes them with a single statement. A flush happens every flush_interval, or as
+ * soon as max_batch videos are waiting, and once more when the batcher is stopped. Final statuses are
+ * written right away when sync_terminal is set, so that they are durable once Update returns.
+ *
+ * The batcher is thread-safe.
+ */
+class StatusBatcher {
+public:
+    struct Options {
+        std::size_t max_batch = 500;
+        std::chrono::milliseconds flush_interval{200};
+        bool sync_terminal = true;
+    };
+
+    static StatusBatcher& getInstance();
+
+    StatusBatcher(const StatusBatcher&) = delete;
+    StatusBatcher& operator=(const StatusBatcher&) = delete;
+
+    /**
+     * @brief Starts the background flushes, statuses are only written when flushed until then.
+     */
+    void Start();
+
+    /**
+     * @brief Stops the background flushes and writes the statuses still waiting.
+     */
+    void Stop();
+
+    /**
+     * @brief Records the new status of a video.
+     *
+     * @param id The ID of the video.
+     * @param status The new status.
+     * @return False if the status was written right away and could not be, true otherwise.
+     */
+    bool Update(const std::string& id, requests::VideoStatus status);
+
+private:
+    explicit StatusBatcher(Options options);
+    ~StatusBatcher();
+
+    void Run();
+    void Flush(std::unique_lock<std::mutex>& lock);
+
+    Options options_;
+
+    std::mutex mutex_;
+    std::condition_variable cv_;
+    // The latest status waiting to be written, by video ID
+    std::unordered_map<std::string, std::string> pending_;
+    bool stopping_ = false;
+    std::thread thread_;
+};
+
+} // namespace db
+} // namespace utils
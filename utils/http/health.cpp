@@ -0,0 +1,43 @@
+#include "health.h"
+
+#include <atomic>
+
+namespace utils {
+namespace http {
+
+namespace {
+
+std::atomic<std::size_t> in_flight_count{0};
+
+} // namespace
+
+InFlightGuard::InFlightGuard() {
+    ++in_flight_count;
+}
+
+InFlightGuard::~InFlightGuard() {
+    --in_flight_count;
+}
+
+std::size_t InFlightGuard::GetInFlightCount() {
+    return in_flight_count.load();
+}
+
+/**
+ * Binds the health handler probed by the orchestrator's HealthMonitor.
+ * The response also reports how many jobs the instance is processing.
+ *
+ * @param app The Crow application to bind the health handler to.
+ */
+void BindHealthHandler(crow::SimpleApp& app) {
+    CROW_ROUTE(app, "/health").methods(crow::HTTPMethod::GET)
+    ([]() {
+        crow::json::wvalue body;
+        body["status"] = "OK";
+        body["in_flight"] = InFlightGuard::GetInFlightCount();
+        return crow::response(200, body);
+    });
+}
+
+} // namespace http
+} // namespace utils
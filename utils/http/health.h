@@ -0,0 +1,30 @@
+#pragma once
+
+#include <crow.h>
+
+#include <cstddef>
+
+namespace utils {
+namespace http {
+
+/**
+ * @brief Counts a job of the service as in flight for as long as it lives.
+ *
+ * The number of jobs in flight is reported by the health handler, so the orchestrator can route
+ * new jobs to the least loaded instance of a service.
+ */
+class InFlightGuard {
+public:
+    InFlightGuard();
+    ~InFlightGuard();
+
+    InFlightGuard(const InFlightGuard&) = delete;
+    InFlightGuard& operator=(const InFlightGuard&) = delete;
+
+    static std::size_t GetInFlightCount();
+};
+
+void BindHealthHandler(crow::SimpleApp& app);
+
+} // namespace http
+} // namespace utils
@@ -0,0 +1,232 @@
+#include "health_monitor.h"
+
+#include <iostream>
+#include <vector>
+
+namespace utils {
+namespace http {
+
+namespace {
+
+/**
+ * Parses the number of jobs in flight from the body of a health probe response.
+ * Services answering a plain "OK" are considered idle.
+ *
+ * @param body The body of the response.
+ * @return The number of jobs in flight.
+ */
+std::size_t ParseReportedLoad(const std::string& body) {
+    const auto json = crow::json::load(body);
+    if (!json || json.t() != crow::json::type::Object || !json.has("in_flight")) {
+        return 0;
+    }
+    const auto& in_flight = json["in_flight"];
+    if (in_flight.t() != crow::json::type::Number) {
+        return 0;
+    }
+    return static_cast<std::size_t>(in_flight.u());
+}
+
+} // namespace
+
+bool CircuitBreaker::AllowRequest() {
+    if (state_ == State::Open && std::chrono::steady_clock::now() >= open_until_) {
+        state_ = State::HalfOpen;
+    }
+    // A half-open circuit waits for its trial, the next health probe, a stage call could hold it for an hour
+    return state_ == State::Closed;
+}
+
+void CircuitBreaker::RecordSuccess() {
+    state_ = State::Closed;
+    failures_ = 0;
+}
+
+/**
+ * Records a successful health probe, which closes the circuit once its open duration has elapsed.
+ */
+void CircuitBreaker::RecordProbeSuccess() {
+    if (state_ == State::Open && std::chrono::steady_clock::now() < open_until_) {
+        return;
+    }
+    RecordSuccess();
+}
+
+void CircuitBreaker::RecordFailure() {
+    if (state_ == State::HalfOpen) {
+        Open();
+        return;
+    }
+    ++failures_;
+    if (state_ == State::Closed && failures_ >= failure_threshold_) {
+        Open();
+    }
+}
+
+void CircuitBreaker::Open() {
+    state_ = State::Open;
+    open_until_ = std::chrono::steady_clock::now() + open_duration_;
+}
+
+/**
+ * Converts a circuit breaker state to its string representation.
+ *
+ * @param state The state to convert.
+ * @return The string representation of the state.
+ */
+std::string CircuitStateToString(const CircuitBreaker::State state) {
+    switch (state) {
+    case CircuitBreaker::State::Closed:
+        return "Closed";
+    case CircuitBreaker::State::Open:
+        return "Open";
+    case CircuitBreaker::State::HalfOpen:
+        return "HalfOpen";
+    }
+    return "Unknown";
+}
+
+HealthMonitor::HealthMonitor(HttpClient& client, Options options)
+    : client_(client), options_(options), timer_(client.GetIoContext()) {}
+
+void HealthMonitor::AddService(const std::string& host, const std::size_t port) {
+    const std::string port_str = std::to_string(port);
+    std::lock_guard<std::mutex> lock(mutex_);
+    services_.emplace(MakeKey(host, port_str),
+                      ServiceHealth{host, port_str, CircuitBreaker(options_.failure_threshold, options_.open_duration)});
+}
+
+/**
+ * Starts probing the registered services in the background.
+ */
+void HealthMonitor::Start() {
+    if (running_.exchange(true)) {
+        return;
+    }
+    asio::post(timer_.get_executor(), [this] {
+        ScheduleProbes();
+    });
+}
+
+void HealthMonitor::Stop() {
+    running_ = false;
+    asio::post(timer_.get_executor(), [this] {
+        timer_.cancel();
+    });
+}
+
+void HealthMonitor::ScheduleProbes() {
+    if (!running_) {
+        return;
+    }
+
+    std::vector<std::string> keys;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        keys.reserve(services_.size());
+        for (const auto& [key, service] : services_) {
+            keys.push_back(key);
+        }
+    }
+    for (const auto& key : keys) {
+        Probe(key);
+    }
+
+    timer_.expires_after(options_.probe_interval);
+    timer_.async_wait([this](const asio::error_code& ec) {
+        if (!ec) {
+            ScheduleProbes();
+        }
+    });
+}
+
+void HealthMonitor::Probe(const std::string& key) {
+    std::string host;
+    std::string port;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        const auto it = services_.find(key);
+        if (it == services_.end()) {
+            return;
+        }
+        host = it->second.host;
+        port = it->second.port;
+    }
+
+    client_.Get(host, port, "/health", options_.probe_timeout, [this, key](const crow::response& response) {
+        const bool healthy = response.code == 200;
+
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto it = services_.find(key);
+        if (it == services_.end()) {
+            return;
+        }
+        auto& service = it->second;
+        if (service.healthy != healthy) {
+            std::cout << "Service " << key << " is " << (healthy ? "up" : "down") << std::endl;
+        }
+        service.healthy = healthy;
+        service.last_probe = std::chrono::steady_clock::now();
+        if (healthy) {
+            service.reported_load = ParseReportedLoad(response.body);
+        }
+
+        // Probes are the trial requests of an open circuit whose open duration has elapsed
+        if (healthy) {
+            service.breaker.RecordProbeSuccess();
+        } else {
+            service.breaker.RecordFailure();
+        }
+    });
+}
+
+bool HealthMonitor::AllowRequest(const std::string& host, const std::string& port) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    const auto it = services_.find(MakeKey(host, port));
+    if (it == services_.end()) {
+        return true;
+    }
+    return it->second.breaker.AllowRequest();
+}
+
+void HealthMonitor::RecordSuccess(const std::string& host, const std::string& port) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    const auto it = services_.find(MakeKey(host, port));
+    if (it != services_.end()) {
+        it->second.breaker.RecordSuccess();
+    }
+}
+
+void HealthMonitor::RecordFailure(const std::string& host, const std::string& port) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    const auto it = services_.find(MakeKey(host, port));
+    if (it != services_.end()) {
+        it->second.breaker.RecordFailure();
+    }
+}
+
+bool HealthMonitor::IsHealthy(const std::string& host, const std::string& port) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    const auto it = services_.find(MakeKey(host, port));
+    if (it == services_.end()) {
+        return true;
+    }
+    return it->second.healthy && it->second.breaker.GetState() != CircuitBreaker::State::Open;
+}
+
+std::size_t HealthMonitor::GetReportedLoad(const std::string& host, const std::string& port) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    const auto it = services_.find(MakeKey(host, port));
+    if (it == services_.end()) {
+        return 0;
+    }
+    return it->second.reported_load;
+}
+
+bool HealthMonitor::IsUnavailableResponse(const crow::response& response) {
+    // The services answer 4xx/500 when a request itself fails; gateway codes mean the service is unreachable
+    return response.code == 502 || response.code == 503 || response.code == 504;
+}
+
+} // namespace http
+} // namespace utils
@@ -0,0 +1,147 @@
+#ifndef HEALTH_MONITOR_H
+#define HEALTH_MONITOR_H
+
+#include <asio.hpp>
+
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+#include "http_client.h"
+
+namespace utils {
+namespace http {
+
+/**
+ * @brief Circuit breaker guarding the calls to one service.
+ *
+ * Closed: requests pass, consecutive failures are counted.
+ * Open: requests fail fast until the open duration has elapsed.
+ * HalfOpen: the open duration has elapsed, requests still fail fast until the next health probe,
+ *           whose outcome closes or reopens the circuit.
+ *
+ * The class is not thread-safe, HealthMonitor serializes access to it.
+ */
+class CircuitBreaker {
+public:
+    enum class State {
+        Closed,
+        Open,
+        HalfOpen
+    };
+
+    CircuitBreaker(std::size_t failure_threshold, std::chrono::milliseconds open_duration)
+        : failure_threshold_(failure_threshold), open_duration_(open_duration) {}
+
+    bool AllowRequest();
+    void RecordSuccess();
+    void RecordProbeSuccess();
+    void RecordFailure();
+
+    State GetState() const {
+        return state_;
+    }
+
+private:
+    void Open();
+
+    std::size_t failure_threshold_;
+    std::chrono::milliseconds open_duration_;
+
+    State state_ = State::Closed;
+    std::size_t failures_ = 0;
+    std::chrono::steady_clock::time_point open_until_;
+};
+
+std::string CircuitStateToString(CircuitBreaker::State state);
+
+/**
+ * @brief Tracks the liveness of the pipeline services.
+ *
+ * Every registered service is probed in the background with GET /health. The results are cached and
+ * fed into a per-service circuit breaker together with the outcome of real requests, so callers can
+ * fail fast instead of waiting for a request to a dead service to time out. The number of jobs in flight
+ * reported by the probes is cached as well and used to balance the load between service instances.
+ */
+class HealthMonitor {
+public:
+    struct Options {
+        std::chrono::milliseconds probe_interval{1000};
+        std::chrono::milliseconds probe_timeout{500};
+        std::size_t failure_threshold = 3;
+        std::chrono::milliseconds open_duration{5000};
+    };
+
+    HealthMonitor(HttpClient& client, Options options);
+
+    HealthMonitor(const HealthMonitor&) = delete;
+    HealthMonitor& operator=(const HealthMonitor&) = delete;
+
+    /**
+     * @brief Registers a service to be probed.
+     *
+     * @param host The host of the service.
+     * @param port The port of the service.
+     */
+    void AddService(const std::string& host, std::size_t port);
+
+    void Start();
+    void Stop();
+
+    /**
+     * @brief Checks whether a request to the service may be sent now.
+     * Unknown services are always allowed.
+     */
+    bool AllowRequest(const std::string& host, const std::string& port);
+
+    void RecordSuccess(const std::string& host, const std::string& port);
+    void RecordFailure(const std::string& host, const std::string& port);
+
+    /**
+     * @brief Returns the cached result of the last health probe of the service.
+     */
+    bool IsHealthy(const std::string& host, const std::string& port);
+
+    /**
+     * @brief Returns the number of jobs the service reported as in flight in its last health probe.
+     */
+    std::size_t GetReportedLoad(const std::string& host, const std::string& port);
+
+    /**
+     * @brief Tells whether a response means that the service itself is unavailable,
+     *        as opposed to the request having failed.
+     */
+    static bool IsUnavailableResponse(const crow::response& response);
+
+private:
+    struct ServiceHealth {
+        std::string host;
+        std::string port;
+        CircuitBreaker breaker;
+        bool healthy = true;
+        std::size_t reported_load = 0;
+        std::chrono::steady_clock::time_point last_probe;
+    };
+
+    void ScheduleProbes();
+    void Probe(const std::string& key);
+
+    static std::string MakeKey(const std::string& host, const std::string& port) {
+        return host + ":" + port;
+    }
+
+    HttpClient& client_;
+    Options options_;
+    asio::steady_timer timer_;
+    std::atomic<bool> running_{false};
+
+    std::mutex mutex_;
+    std::unordered_map<std::string, ServiceHealth> services_;
+};
+
+} // namespace http
+} // namespace utils
+
+#endif // HEALTH_MONITOR_H
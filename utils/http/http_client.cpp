@@ -0,0 +1,521 @@
+#include "http_client.h"
+
+#include <algorithm>
+#include <cctype>
+#include <iostream>
+#include <optional>
+#include <sstream>
+
+namespace utils {
+namespace http {
+
+namespace {
+
+/**
+ * Removes the first n bytes from the buffer and returns them as a string.
+ *
+ * @param buffer The buffer to take the bytes from.
+ * @param n The number of bytes to take.
+ * @return The bytes taken from the buffer.
+ */
+std::string TakeFromBuffer(asio::streambuf& buffer, const std::size_t n) {
+    const auto begin = asio::buffers_begin(buffer.data());
+    std::string data(begin, begin + n);
+    buffer.consume(n);
+    return data;
+}
+
+std::string ToLower(std::string value) {
+    std::transform(value.begin(), value.end(), value.begin(),
+                   [](unsigned char c) { return static_cast<char>(std::tolower(c)); });
+    return value;
+}
+
+std::string Trim(const std::string& value) {
+    const auto begin = value.find_first_not_of(" \t\r\n");
+    if (begin == std::string::npos) {
+        return "";
+    }
+    const auto end = value.find_last_not_of(" \t\r\n");
+    return value.substr(begin, end - begin + 1);
+}
+
+} // namespace
+
+/**
+ * A pooled TCP connection. Every operation on the socket and on the timer runs on the strand,
+ * so a connection can be driven from a multi-threaded io_context.
+ */
+struct HttpClient::Connection {
+    explicit Connection(asio::io_context& io_context)
+        : strand(asio::make_strand(io_context)), socket(strand), timer(strand) {}
+
+    /**
+     * Tells whether an idle connection can carry a new request. A server closing an idle keep-alive
+     * connection goes unnoticed until the connection is read: a request written to it would still succeed
+     * and only the response would fail. The socket is therefore peeked without blocking, which reports
+     * EOF or a reset for a closed connection. Must run on the strand.
+     */
+    bool IsAlive() {
+        if (!socket.is_open()) {
+            return false;
+        }
+        asio::error_code ec;
+        socket.non_blocking(true, ec);
+        if (ec) {
+            return false;
+        }
+        char byte;
+        socket.receive(asio::buffer(&byte, 1), asio::socket_base::message_peek, ec);
+        // Nothing to read is the only healthy state, unsolicited bytes would break the framing of the response
+        return ec == asio::error::would_block;
+    }
+
+    asio::strand<asio::io_context::executor_type> strand;
+    asio::ip::tcp::socket socket;
+    asio::steady_timer timer;
+    asio::streambuf buffer;
+    std::chrono::steady_clock::time_point last_used;
+};
+
+/**
+ * State of one request/response exchange.
+ */
+struct HttpClient::Exchange {
+    std::string host;
+    std::string port;
+    std::string key;
+    std::string target;
+    bool head_request = false;
+    std::string request_data;
+    std::chrono::steady_clock::time_point deadline;
+    ResponseHandler handler;
+
+    ConnectionPtr conn;
+    bool reused = false;
+    bool retried = false;
+    bool timed_out = false;
+    bool done = false;
+    // Set once any byte of the request has been written, the service may then be running it
+    bool written = false;
+
+    unsigned int status_code = 0;
+    bool keep_alive = true;
+    std::unordered_map<std::string, std::string> headers;
+    std::string body;
+};
+
+HttpClient::HttpClient(asio::io_context& io_context)
+    : HttpClient(io_context, Options{}) {}
+
+HttpClient::HttpClient(asio::io_context& io_context, Options options)
+    : io_context_(io_context), options_(options) {}
+
+void HttpClient::Request(const std::string& method, const std::string& host, const std::string& port,
+                         const std::string& target, const std::string& body,
+                         std::chrono::milliseconds timeout, ResponseHandler handler) {
+    auto exchange = std::make_shared<Exchange>();
+    exchange->host = host;
+    exchange->port = port;
+    exchange->key = host + ":" + port;
+    exchange->target = target;
+    exchange->head_request = method == "HEAD";
+    exchange->deadline = std::chrono::steady_clock::now() + timeout;
+    exchange->handler = std::move(handler);
+
+    std::ostringstream request_stream;
+    request_stream << method << " " << target << " HTTP/1.1\r\n";
+    request_stream << "Host: " << exchange->key << "\r\n";
+    if (!body.empty() || method == "POST" || method == "PUT") {
+        request_stream << "Content-Type: application/json\r\n";
+        request_stream << "Content-Length: " << body.length() << "\r\n";
+    }
+    request_stream << "Connection: keep-alive\r\n\r\n";
+    request_stream << body;
+    exchange->request_data = request_stream.str();
+
+    Start(exchange, true);
+}
+
+void HttpClient::Post(const std::string& host, const std::string& port, const std::string& target,
+                      const std::string& body, std::chrono::milliseconds timeout, ResponseHandler handler) {
+    Request("POST", host, port, target, body, timeout, std::move(handler));
+}
+
+void HttpClient::Get(const std::string& host, const std::string& port, const std::string& target,
+                     std::chrono::milliseconds timeout, ResponseHandler handler) {
+    Request("GET", host, port, target, "", timeout, std::move(handler));
+}
+
+/**
+ * Starts the exchange on an idle pooled connection when one is available, otherwise on a new connection.
+ *
+ * @param exchange The exchange to start.
+ * @param allow_idle Whether an idle pooled connection may be used.
+ */
+void HttpClient::Start(ExchangePtr exchange, const bool allow_idle) {
+    ConnectionPtr conn = allow_idle ? TakeIdle(exchange->key) : nullptr;
+    exchange->reused = conn != nullptr;
+    if (!conn) {
+        conn = std::make_shared<Connection>(io_context_);
+    }
+    exchange->conn = conn;
+
+    asio::post(conn->strand, [this, exchange] {
+        auto& conn = *exchange->conn;
+        if (exchange->reused && !conn.IsAlive()) {
+            // Closed by the server while idle, nothing has been sent yet so another connection is taken
+            asio::error_code ignored;
+            conn.socket.close(ignored);
+            Start(exchange, true);
+            return;
+        }
+
+        conn.timer.expires_at(exchange->deadline);
+        conn.timer.async_wait([exchange, conn_ptr = exchange->conn](const asio::error_code& ec) {
+            // The exchange may have moved on to a fresh connection after a retry
+            if (ec || exchange->done || exchange->conn != conn_ptr) {
+                return;
+            }
+            exchange->timed_out = true;
+            asio::error_code ignored;
+            conn_ptr->socket.close(ignored);
+        });
+
+        if (exchange->reused) {
+            Send(exchange);
+        } else {
+            Resolve(exchange);
+        }
+    });
+}
+
+void HttpClient::Resolve(ExchangePtr exchange) {
+    std::optional<asio::ip::tcp::resolver::results_type> cached;
+    {
+        std::lock_guard<std::mutex> lock(resolve_mutex_);
+        const auto it = resolve_cache_.find(exchange->key);
+        if (it != resolve_cache_.end() && it->second.expires_at > std::chrono::steady_clock::now()) {
+            cached = it->second.endpoints;
+        }
+    }
+    if (cached.has_value()) {
+        Connect(exchange, cached.value());
+        return;
+    }
+
+    auto resolver = std::make_shared<asio::ip::tcp::resolver>(io_context_);
+    resolver->async_resolve(exchange->host, exchange->port,
+        asio::bind_executor(exchange->conn->strand,
+            [this, exchange, resolver](const asio::error_code& ec,
+                                       asio::ip::tcp::resolver::results_type endpoints) {
+                if (ec) {
+                    Fail(exchange, ec, "resolve");
+                    return;
+                }
+                {
+                    std::lock_guard<std::mutex> lock(resolve_mutex_);
+                    resolve_cache_[exchange->key] =
+                        CachedEndpoints{endpoints, std::chrono::steady_clock::now() + options_.resolve_ttl};
+                }
+                Connect(exchange, endpoints);
+            }));
+}
+
+void HttpClient::Connect(ExchangePtr exchange, const asio::ip::tcp::resolver::results_type& endpoints) {
+    asio::async_connect(exchange->conn->socket, endpoints,
+        [this, exchange](const asio::error_code& ec, const asio::ip::tcp::endpoint&) {
+            if (ec) {
+                // The cached endpoints may be stale, resolve again next time
+                {
+                    std::lock_guard<std::mutex> lock(resolve_mutex_);
+                    resolve_cache_.erase(exchange->key);
+                }
+                Fail(exchange, ec, "connect");
+                return;
+            }
+            asio::error_code ignored;
+            exchange->conn->socket.set_option(asio::ip::tcp::no_delay(true), ignored);
+            Send(exchange);
+        });
+}
+
+void HttpClient::Send(ExchangePtr exchange) {
+    asio::async_write(exchange->conn->socket, asio::buffer(exchange->request_data),
+        [this, exchange](const asio::error_code& ec, const std::size_t n) {
+            if (n > 0) {
+                exchange->written = true;
+            }
+            if (ec) {
+                Fail(exchange, ec, "write");
+                return;
+            }
+            ReadHeaders(exchange);
+        });
+}
+
+void HttpClient::ReadHeaders(ExchangePtr exchange) {
+    asio::async_read_until(exchange->conn->socket, exchange->conn->buffer, "\r\n\r\n",
+        [this, exchange](const asio::error_code& ec, const std::size_t n) {
+            if (ec) {
+                Fail(exchange, ec, "read headers");
+                return;
+            }
+
+            std::istringstream header_stream(TakeFromBuffer(exchange->conn->buffer, n));
+            std::string http_version;
+            header_stream >> http_version >> exchange->status_code;
+            if (!header_stream || http_version.rfind("HTTP/", 0) != 0) {
+                Fail(exchange, asio::error::invalid_argument, "parse status line");
+                return;
+            }
+            exchange->keep_alive = http_version != "HTTP/1.0";
+
+            std::string line;
+            std::getline(header_stream, line);
+            while (std::getline(header_stream, line) && line != "\r") {
+                const auto colon = line.find(':');
+                if (colon == std::string::npos) {
+                    continue;
+                }
+                exchange->headers[ToLower(Trim(line.substr(0, colon)))] = Trim(line.substr(colon + 1));
+            }
+
+            const auto connection = exchange->headers.find("connection");
+            if (connection != exchange->headers.end()) {
+                const auto value = ToLower(connection->second);
+                if (value == "close") {
+                    exchange->keep_alive = false;
+                } else if (value == "keep-alive") {
+                    exchange->keep_alive = true;
+                }
+            }
+
+            const auto code = exchange->status_code;
+            if (exchange->head_request || (code >= 100 && code < 200) || code == 204 || code == 304) {
+                Finish(exchange);
+                return;
+            }
+
+            const auto transfer_encoding = exchange->headers.find("transfer-encoding");
+            if (transfer_encoding != exchange->headers.end() &&
+                ToLower(transfer_encoding->second).find("chunked") != std::string::npos) {
+                ReadChunkSize(exchange);
+                return;
+            }
+
+            const auto content_length = exchange->headers.find("content-length");
+            if (content_length != exchange->headers.end()) {
+                try {
+                    ReadContent(exchange, std::stoull(content_length->second));
+                } catch (const std::exception&) {
+                    Fail(exchange, asio::error::invalid_argument, "parse Content-Length");
+                }
+                return;
+            }
+
+            // Neither Content-Length nor chunked: the body ends when the server closes the connection
+            exchange->keep_alive = false;
+            ReadUntilEof(exchange);
+        });
+}
+
+void HttpClient::ReadContent(ExchangePtr exchange, const std::size_t length) {
+    auto& buffer = exchange->conn->buffer;
+    if (buffer.size() >= length) {
+        exchange->body = TakeFromBuffer(buffer, length);
+        Finish(exchange);
+        return;
+    }
+
+    asio::async_read(exchange->conn->socket, buffer, asio::transfer_exactly(length - buffer.size()),
+        [this, exchange, length](const asio::error_code& ec, std::size_t) {
+            if (ec) {
+                Fail(exchange, ec, "read body");
+                return;
+            }
+            exchange->body = TakeFromBuffer(exchange->conn->buffer, length);
+            Finish(exchange);
+        });
+}
+
+void HttpClient::ReadChunkSize(ExchangePtr exchange) {
+    asio::async_read_until(exchange->conn->socket, exchange->conn->buffer, "\r\n",
+        [this, exchange](const asio::error_code& ec, const std::size_t n) {
+            if (ec) {
+                Fail(exchange, ec, "read chunk size");
+                return;
+            }
+
+            std::string line = TakeFromBuffer(exchange->conn->buffer, n);
+            const auto extension = line.find(';');
+            if (extension != std::string::npos) {
+                line.erase(extension);
+            }
+
+            std::size_t chunk_size = 0;
+            try {
+                chunk_size = std::stoull(Trim(line), nullptr, 16);
+            } catch (const std::exception&) {
+                Fail(exchange, asio::error::invalid_argument, "parse chunk size");
+                return;
+            }
+
+            if (chunk_size == 0) {
+                ReadTrailers(exchange);
+            } else {
+                ReadChunkData(exchange, chunk_size);
+            }
+        });
+}
+
+void HttpClient::ReadChunkData(ExchangePtr exchange, const std::size_t length) {
+    // Every chunk is followed by CRLF
+    const std::size_t needed = length + 2;
+    auto on_chunk = [this, exchange, length] {
+        exchange->body += TakeFromBuffer(exchange->conn->buffer, length);
+        exchange->conn->buffer.consume(2);
+        ReadChunkSize(exchange);
+    };
+
+    auto& buffer = exchange->conn->buffer;
+    if (buffer.size() >= needed) {
+        on_chunk();
+        return;
+    }
+
+    asio::async_read(exchange->conn->socket, buffer, asio::transfer_exactly(needed - buffer.size()),
+        [this, exchange, on_chunk](const asio::error_code& ec, std::size_t) {
+            if (ec) {
+                Fail(exchange, ec, "read chunk");
+                return;
+            }
+            on_chunk();
+        });
+}
+
+void HttpClient::ReadTrailers(ExchangePtr exchange) {
+    asio::async_read_until(exchange->conn->socket, exchange->conn->buffer, "\r\n",
+        [this, exchange](const asio::error_code& ec, const std::size_t n) {
+            if (ec) {
+                Fail(exchange, ec, "read trailers");
+                return;
+            }
+            const std::string line = TakeFromBuffer(exchange->conn->buffer, n);
+            if (line == "\r\n") {
+                Finish(exchange);
+            } else {
+                ReadTrailers(exchange);
+            }
+        });
+}
+
+void HttpClient::ReadUntilEof(ExchangePtr exchange) {
+    asio::async_read(exchange->conn->socket, exchange->conn->buffer, asio::transfer_all(),
+        [this, exchange](const asio::error_code& ec, std::size_t) {
+            if (ec && ec != asio::error::eof) {
+                Fail(exchange, ec, "read body");
+                return;
+            }
+            exchange->body = TakeFromBuffer(exchange->conn->buffer, exchange->conn->buffer.size());
+            Finish(exchange);
+        });
+}
+
+void HttpClient::Finish(ExchangePtr exchange) {
+    exchange->done = true;
+    auto conn = exchange->conn;
+    conn->timer.cancel();
+
+    // Unconsumed bytes mean the framing is off, such a connection cannot be reused
+    if (exchange->keep_alive && conn->buffer.size() == 0) {
+        ReleaseIdle(exchange->key, conn);
+    } else {
+        asio::error_code ignored;
+        conn->socket.close(ignored);
+    }
+
+    crow::response response;
+    response.code = exchange->status_code;
+    response.body = std::move(exchange->body);
+    for (const auto& [name, value] : exchange->headers) {
+        response.set_header(name, value);
+    }
+    exchange->handler(response);
+}
+
+void HttpClient::Fail(ExchangePtr exchange, const asio::error_code& ec, const std::string& what) {
+    auto conn = exchange->conn;
+    asio::error_code ignored;
+    conn->socket.close(ignored);
+
+    // A pooled connection may have been closed by the server after it was checked in Start().
+    // Retry once on a fresh connection only if the request could not be written at all: once it has been,
+    // the service may be running it, and the stages must not run twice.
+    if (exchange->reused && !exchange->retried && !exchange->timed_out && !exchange->written &&
+        std::chrono::steady_clock::now() < exchange->deadline) {
+        conn->timer.cancel();
+        exchange->retried = true;
+        Start(exchange, false);
+        return;
+    }
+
+    exchange->done = true;
+    conn->timer.cancel();
+
+    crow::response response;
+    if (exchange->timed_out) {
+        response.code = 504;
+        response.body = "Request to " + exchange->key + exchange->target + " timed out at " + what;
+    } else {
+        response.code = 503;
+        response.body = "Request to " + exchange->key + exchange->target + " failed at " + what + ": " + ec.message();
+    }
+    std::cerr << response.body << std::endl;
+    exchange->handler(response);
+}
+
+/**
+ * Takes the most recently used idle connection to the host:port that is younger than the idle timeout.
+ * Only the age is checked here, the socket may only be used on the strand of the connection,
+ * where Start() checks that the server has not closed it.
+ */
+HttpClient::ConnectionPtr HttpClient::TakeIdle(const std::string& key) {
+    std::lock_guard<std::mutex> lock(idle_mutex_);
+    const auto it = idle_.find(key);
+    if (it == idle_.end()) {
+        return nullptr;
+    }
+
+    auto& connections = it->second;
+    const auto now = std::chrono::steady_clock::now();
+    while (!connections.empty()) {
+        ConnectionPtr conn = std::move(connections.back());
+        connections.pop_back();
+        if (now - conn->last_used < options_.idle_timeout) {
+            return conn;
+        }
+        // Closed on its strand, it may not be touched from this thread
+        asio::post(conn->strand, [conn] {
+            asio::error_code ignored;
+            conn->socket.close(ignored);
+        });
+    }
+    return nullptr;
+}
+
+void HttpClient::ReleaseIdle(const std::string& key, ConnectionPtr conn) {
+    conn->last_used = std::chrono::steady_clock::now();
+
+    std::lock_guard<std::mutex> lock(idle_mutex_);
+    auto& connections = idle_[key];
+    if (connections.size() >= options_.max_idle_per_host) {
+        asio::error_code ignored;
+        conn->socket.close(ignored);
+        return;
+    }
+    connections.push_back(std::move(conn));
+}
+
+} // namespace http
+} // namespace utils
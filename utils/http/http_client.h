@@ -0,0 +1,115 @@
+#ifndef HTTP_CLIENT_H
+#define HTTP_CLIENT_H
+
+#include <asio.hpp>
+#include <crow.h>
+
+#include <chrono>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace utils {
+namespace http {
+
+/**
+ * @brief Asynchronous HTTP/1.1 client with per-host keep-alive connection pools.
+ *
+ * Connections to the same host:port are reused between requests instead of being closed after every
+ * response, and resolved endpoints are cached for a configurable time. Responses are delimited by
+ * Content-Length or chunked transfer encoding, so a response is complete as soon as its body has been
+ * received rather than when the peer closes the socket. Every request has its own timeout.
+ *
+ * All operations run on the given io_context; the response handler is invoked from one of its threads.
+ * Transport errors are reported to the handler as a 503 response and timeouts as a 504 response.
+ */
+class HttpClient {
+public:
+    using ResponseHandler = std::function<void(const crow::response&)>;
+
+    struct Options {
+        // Maximum number of idle connections kept per host:port
+        std::size_t max_idle_per_host = 16;
+        // Idle connections older than this are dropped instead of reused.
+        // Crow closes idle keep-alive connections after 5 seconds.
+        std::chrono::milliseconds idle_timeout{4000};
+        // How long resolved endpoints are cached
+        std::chrono::seconds resolve_ttl{60};
+    };
+
+    explicit HttpClient(asio::io_context& io_context);
+    HttpClient(asio::io_context& io_context, Options options);
+
+    HttpClient(const HttpClient&) = delete;
+    HttpClient& operator=(const HttpClient&) = delete;
+
+    /**
+     * @brief Sends an HTTP request.
+     *
+     * @param method The HTTP method, e.g. "GET" or "POST".
+     * @param host The host of the request.
+     * @param port The port of the request.
+     * @param target The target of the request.
+     * @param body The body of the request, may be empty.
+     * @param timeout The time limit for the whole request, including connecting.
+     * @param handler The handler called with the response.
+     */
+    void Request(const std::string& method, const std::string& host, const std::string& port,
+                 const std::string& target, const std::string& body,
+                 std::chrono::milliseconds timeout, ResponseHandler handler);
+
+    void Post(const std::string& host, const std::string& port, const std::string& target,
+              const std::string& body, std::chrono::milliseconds timeout, ResponseHandler handler);
+
+    void Get(const std::string& host, const std::string& port, const std::string& target,
+             std::chrono::milliseconds timeout, ResponseHandler handler);
+
+    asio::io_context& GetIoContext() {
+        return io_context_;
+    }
+
+private:
+    struct Connection;
+    struct Exchange;
+
+    using ConnectionPtr = std::shared_ptr<Connection>;
+    using ExchangePtr = std::shared_ptr<Exchange>;
+
+    struct CachedEndpoints {
+        asio::ip::tcp::resolver::results_type endpoints;
+        std::chrono::steady_clock::time_point expires_at;
+    };
+
+    void Start(ExchangePtr exchange, bool allow_idle);
+    void Resolve(ExchangePtr exchange);
+    void Connect(ExchangePtr exchange, const asio::ip::tcp::resolver::results_type& endpoints);
+    void Send(ExchangePtr exchange);
+    void ReadHeaders(ExchangePtr exchange);
+    void ReadContent(ExchangePtr exchange, std::size_t length);
+    void ReadChunkSize(ExchangePtr exchange);
+    void ReadChunkData(ExchangePtr exchange, std::size_t length);
+    void ReadTrailers(ExchangePtr exchange);
+    void ReadUntilEof(ExchangePtr exchange);
+    void Finish(ExchangePtr exchange);
+    void Fail(ExchangePtr exchange, const asio::error_code& ec, const std::string& what);
+
+    ConnectionPtr TakeIdle(const std::string& key);
+    void ReleaseIdle(const std::string& key, ConnectionPtr conn);
+
+    asio::io_context& io_context_;
+    Options options_;
+
+    std::mutex idle_mutex_;
+    std::unordered_map<std::string, std::vector<ConnectionPtr>> idle_;
+
+    std::mutex resolve_mutex_;
+    std::unordered_map<std::string, CachedEndpoints> resolve_cache_;
+};
+
+} // namespace http
+} // namespace utils
+
+#endif // HTTP_CLIENT_H
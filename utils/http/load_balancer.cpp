@@ -0,0 +1,90 @@
+#include "load_balancer.h"
+
+#include <algorithm>
+#include <limits>
+
+namespace utils {
+namespace http {
+
+void LoadBalancer::AddInstance(const std::string& service, const std::string& host, const std::size_t port) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    services_[service].instances.push_back(InstanceState{Instance{host, std::to_string(port)}});
+}
+
+std::optional<LoadBalancer::Instance> LoadBalancer::Acquire(const std::string& service) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    const auto it = services_.find(service);
+    if (it == services_.end() || it->second.instances.empty()) {
+        return std::nullopt;
+    }
+
+    auto& instances = it->second.instances;
+    const std::size_t count = instances.size();
+    const std::size_t start = it->second.next % count;
+
+    InstanceState* best = nullptr;
+    std::size_t best_load = std::numeric_limits<std::size_t>::max();
+    std::size_t best_index = 0;
+    for (std::size_t i = 0; i < count; ++i) {
+        const std::size_t index = (start + i) % count;
+        auto& state = instances[index];
+        if (!IsAvailable(state.instance)) {
+            continue;
+        }
+        // The reported load already contains the requests of this process that the instance has received
+        const std::size_t load = std::max(state.outstanding,
+                                          health_.GetReportedLoad(state.instance.host, state.instance.port));
+        if (load < best_load) {
+            best = &state;
+            best_load = load;
+            best_index = index;
+        }
+    }
+
+    if (best == nullptr) {
+        return std::nullopt;
+    }
+
+    ++best->outstanding;
+    it->second.next = best_index + 1;
+    return best->instance;
+}
+
+void LoadBalancer::Release(const std::string& service, const Instance& instance) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    const auto it = services_.find(service);
+    if (it == services_.end()) {
+        return;
+    }
+    for (auto& state : it->second.instances) {
+        if (state.instance.host == instance.host && state.instance.port == instance.port) {
+            if (state.outstanding > 0) {
+                --state.outstanding;
+            }
+            return;
+        }
+    }
+}
+
+bool LoadBalancer::HasHealthyInstance(const std::string& service) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    const auto it = services_.find(service);
+    if (it == services_.end()) {
+        return false;
+    }
+    return std::any_of(it->second.instances.begin(), it->second.instances.end(), [this](const InstanceState& state) {
+        return IsAvailable(state.instance);
+    });
+}
+
+/**
+ * Tells whether a request may be routed to an instance: its last probe must have succeeded and its circuit
+ * breaker must admit the request, otherwise the request would be rejected after the instance was picked
+ * while another instance could have taken it.
+ */
+bool LoadBalancer::IsAvailable(const Instance& instance) {
+    return health_.IsHealthy(instance.host, instance.port) && health_.AllowRequest(instance.host, instance.port);
+}
+
+} // namespace http
+} // namespace utils
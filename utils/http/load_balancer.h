@@ -0,0 +1,83 @@
+#ifndef LOAD_BALANCER_H
+#define LOAD_BALANCER_H
+
+#include <mutex>
+#include <optional>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "health_monitor.h"
+
+namespace utils {
+namespace http {
+
+/**
+ * @brief Client-side load balancer over the instances of the pipeline services.
+ *
+ * A request is routed to the healthy instance with the fewest jobs in flight. The load of an instance is the
+ * larger of the requests this process has outstanding on it and the number of jobs the instance reported
+ * in its last health probe, which also accounts for jobs sent by other orchestrators. Ties are broken
+ * round-robin. Instances whose probes fail or whose circuit breaker does not admit requests are taken out
+ * of rotation until the HealthMonitor sees them recover.
+ */
+class LoadBalancer {
+public:
+    struct Instance {
+        std::string host;
+        std::string port;
+    };
+
+    explicit LoadBalancer(HealthMonitor& health) : health_(health) {}
+
+    LoadBalancer(const LoadBalancer&) = delete;
+    LoadBalancer& operator=(const LoadBalancer&) = delete;
+
+    /**
+     * @brief Registers an instance of a service.
+     *
+     * @param service The name of the service.
+     * @param host The host of the instance.
+     * @param port The port of the instance.
+     */
+    void AddInstance(const std::string& service, const std::string& host, std::size_t port);
+
+    /**
+     * @brief Picks the least loaded healthy instance of a service and counts a request as outstanding on it.
+     * Every acquired instance must be given back with Release() once its response has been received.
+     *
+     * @param service The name of the service.
+     * @return The instance, or std::nullopt if no instance of the service is healthy and admitted by its breaker.
+     */
+    std::optional<Instance> Acquire(const std::string& service);
+
+    void Release(const std::string& service, const Instance& instance);
+
+    /**
+     * @brief Tells whether at least one instance of the service is healthy and admitted by its breaker.
+     */
+    bool HasHealthyInstance(const std::string& service);
+
+private:
+    struct InstanceState {
+        Instance instance;
+        std::size_t outstanding = 0;
+    };
+
+    struct ServiceInstances {
+        std::vector<InstanceState> instances;
+        std::size_t next = 0;
+    };
+
+    bool IsAvailable(const Instance& instance);
+
+    HealthMonitor& health_;
+
+    std::mutex mutex_;
+    std::unordered_map<std::string, ServiceInstances> services_;
+};
+
+} // namespace http
+} // namespace utils
+
+#endif // LOAD_BALANCER_H
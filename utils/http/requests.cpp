@@ -1,5 +1,6 @@
 #include "requests.h"
 
+#include <cstddef>
 #include <exception>
 
 namespace requests {
@@ -71,4 +72,21 @@ VideoStatus StringToVideoStatus(const std::string& statusStr) {
     }
 }
 
+/**
+ * Lists the statuses from which a video may move to the given status.
+ *
+ * @param status The status to move to.
+ * @return The allowed previous statuses, empty for a status no video may move to.
+ */
+std::vector<VideoStatus> GetVideoStatusPredecessors(const VideoStatus status) {
+    std::vector<VideoStatus> predecessors;
+    for (std::size_t value = 1; value < detail::kVideoStatusTransitions.size(); ++value) {
+        const auto from = static_cast<VideoStatus>(value);
+        if (IsVideoStatusTransitionAllowed(from, status)) {
+            predecessors.push_back(from);
+        }
+    }
+    return predecessors;
+}
+
 } // namespace requests
\ No newline at end of file
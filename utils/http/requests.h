@@ -1,6 +1,9 @@
 #pragma once
 
+#include <array>
+#include <cstdint>
 #include <string>
+#include <vector>
 
 namespace requests {
 
@@ -17,6 +20,77 @@ enum class VideoStatus {
     Stopped = 10
 };
 
+namespace detail {
+
+template <typename... Statuses>
+constexpr std::uint32_t VideoStatusMask(const Statuses... statuses) {
+    return (0u | ... | (1u << static_cast<unsigned>(statuses)));
+}
+
+// A video can be failed or stopped at any time until it reaches a final status
+constexpr std::uint32_t kInterruptions = VideoStatusMask(VideoStatus::Failed, VideoStatus::Stopped);
+
+// The statuses a video may move to from each status, indexed by the status value.
+// Every in-progress status may be set again, so that redelivered jobs and events stay harmless,
+// while final statuses are never left.
+constexpr std::array<std::uint32_t, static_cast<std::size_t>(VideoStatus::Stopped) + 1> kVideoStatusTransitions = {
+    0,
+    // Received, a duplicate video is finished right away with the result of an earlier one
+    VideoStatusMask(VideoStatus::PreProcessingStarted, VideoStatus::Finished) | kInterruptions,
+    // PreProcessingStarted
+    VideoStatusMask(VideoStatus::PreProcessingStarted, VideoStatus::PreProcessingFinished) | kInterruptions,
+    // PreProcessingFinished
+    VideoStatusMask(VideoStatus::PreProcessingFinished, VideoStatus::YoloStarted) | kInterruptions,
+    // YoloStarted
+    VideoStatusMask(VideoStatus::YoloStarted, VideoStatus::YoloFinished) | kInterruptions,
+    // YoloFinished
+    VideoStatusMask(VideoStatus::YoloFinished, VideoStatus::FramesCleanUp, VideoStatus::PostProcessing) |
+        kInterruptions,
+    // FramesCleanUp
+    VideoStatusMask(VideoStatus::FramesCleanUp, VideoStatus::PostProcessing) | kInterruptions,
+    // PostProcessing
+    VideoStatusMask(VideoStatus::PostProcessing, VideoStatus::Finished) | kInterruptions,
+    // Finished, Failed and Stopped are final
+    0,
+    0,
+    0
+};
+
+} // namespace detail
+
+/**
+ * Tells whether a video may move from one status to another.
+ */
+constexpr bool IsVideoStatusTransitionAllowed(const VideoStatus from, const VideoStatus to) {
+    return (detail::kVideoStatusTransitions[static_cast<std::size_t>(from)] & detail::VideoStatusMask(to)) != 0;
+}
+
+/**
+ * Tells whether a video has reached a status it never leaves.
+ */
+constexpr bool IsFinalVideoStatus(const VideoStatus status) {
+    return detail::kVideoStatusTransitions[static_cast<std::size_t>(status)] == 0;
+}
+
+/**
+ * Tells whether a video has already moved past the given status without having been failed or stopped,
+ * which is the case when a job or an event of a stage it has completed is redelivered.
+ */
+constexpr bool IsVideoPastStatus(const VideoStatus current, const VideoStatus status) {
+    return current != VideoStatus::Failed && current != VideoStatus::Stopped && current > status;
+}
+
+// The code a stage answers with when the video has already moved past it. The job is a no-op:
+// the orchestrator neither fails nor continues the video.
+constexpr int kStageSkippedCode = 204;
+
+static_assert(IsFinalVideoStatus(VideoStatus::Finished) && IsFinalVideoStatus(VideoStatus::Failed) &&
+              IsFinalVideoStatus(VideoStatus::Stopped), "Finished, Failed and Stopped must be final");
+static_assert(!IsFinalVideoStatus(VideoStatus::Received) && !IsFinalVideoStatus(VideoStatus::PostProcessing),
+              "In-progress statuses must not be final");
+static_assert(!IsVideoStatusTransitionAllowed(VideoStatus::YoloStarted, VideoStatus::PreProcessingFinished),
+              "A video must never go back to an earlier stage");
+
 struct VideoRequest {
     std::string id;
     std::string path;
@@ -25,5 +99,6 @@ struct VideoRequest {
 
 std::string VideoStatusToString(const VideoStatus& status);
 VideoStatus StringToVideoStatus(const std::string& statusStr);
+std::vector<VideoStatus> GetVideoStatusPredecessors(VideoStatus status);
 
 } // namespace requests
@@ -5,96 +5,53 @@
 namespace utils {
 namespace http {
 
-void RequestsChain::AddRequest(const std::string& host, const std::string& port, const std::string& target, 
-                               const crow::json::wvalue& body, ResponseHandler handler) {
-    requests_.emplace_back(host, port, target, body, handler);
+void RequestsChain::AddRequest(const std::string& host, const std::string& port, const std::string& target,
+                               const crow::json::wvalue& body, ResponseHandler handler,
+                               std::chrono::milliseconds timeout) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    requests_.push_back(Request{host, port, target, body.dump(), std::move(handler), timeout});
 }
 
-bool RequestsChain::Execute() {
-    if (requests_.empty()) {
-        return true;
+void RequestsChain::Execute() {
+    std::optional<Request> request;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (requests_.empty()) {
+            return;
+        }
+        request = std::move(requests_.front());
+        requests_.pop_front();
     }
 
-    auto [host, port, target, body, handler] = requests_.front();
-    requests_.erase(requests_.begin());
-
-    try {
-        asio::ip::tcp::resolver resolver(io_context_);
-        asio::ip::tcp::resolver::results_type endpoints = resolver.resolve(host, port);
+    if (health_ != nullptr && !health_->AllowRequest(request->host, request->port)) {
+        std::cerr << "Service " << request->host << ":" << request->port << " is unavailable, circuit is open\n";
+        // Complete asynchronously so that the handler never runs inside its caller
+        asio::post(client_.GetIoContext(), [handler = std::move(request->handler)] {
+            crow::response response;
+            response.code = 503;
+            response.body = "Service unavailable";
+            handler(response);
+        });
+        return;
+    }
 
-        asio::ip::tcp::socket socket(io_context_);
-        asio::connect(socket, endpoints);
+    Send(std::move(*request));
+}
 
-        // Ping the server
-        asio::steady_timer timer(io_context_, std::chrono::seconds(2));
-        bool ping_success = false;
-        timer.async_wait([&](const asio::error_code& ec) {
-            if (!ec) {
-                ping_success = true;
-                socket.cancel();
+void RequestsChain::Send(Request request) {
+    auto handler = std::move(request.handler);
+    client_.Post(request.host, request.port, request.target, request.body, request.timeout,
+        [self = shared_from_this(), host = request.host, port = request.port,
+         handler = std::move(handler)](const crow::response& response) {
+            if (self->health_ != nullptr) {
+                if (HealthMonitor::IsUnavailableResponse(response)) {
+                    self->health_->RecordFailure(host, port);
+                } else {
+                    self->health_->RecordSuccess(host, port);
+                }
             }
+            handler(response);
         });
-
-        io_context_.run();
-        io_context_.restart();
-
-        if (!ping_success) {
-            return false;
-        }
-
-        const std::string body_str = body.dump();
-
-        asio::streambuf request;
-        std::ostream request_stream(&request);
-        request_stream << "POST " << target << " HTTP/1.1\r\n";
-        request_stream << "Host: " << host << "\r\n";
-        request_stream << "Content-Type: application/x-www-form-urlencoded\r\n";
-        request_stream << "Content-Length: " << body_str.length() << "\r\n";
-        request_stream << "Connection: close\r\n\r\n";
-        request_stream << body_str;
-
-        asio::write(socket, request);
-
-        asio::streambuf response;
-        asio::read_until(socket, response, "\r\n");
-
-        std::istream response_stream(&response);
-        std::string http_version;
-        response_stream >> http_version;
-        unsigned int status_code;
-        response_stream >> status_code;
-        std::string status_message;
-        std::getline(response_stream, status_message);
-
-        crow::response crow_response;
-        crow_response.code = status_code;
-
-        if (response.size() > 0) {
-            std::ostringstream ss;
-            ss << &response;
-            crow_response.body = ss.str();
-        }
-
-        handler(crow_response);
-
-        asio::error_code ec;
-        while (asio::read(socket, response, asio::transfer_at_least(1), ec)) {
-            std::ostringstream ss;
-            ss << &response;
-            crow_response.body += ss.str();
-        }
-
-        if (ec != asio::error::eof) {
-            throw asio::system_error(ec);
-        }
-
-        // Execute the next request in the chain
-        return Execute();
-
-    } catch (std::exception& e) {
-        std::cerr << "Exception: " << e.what() << "\n";
-        return false;
-    }
 }
 
 } // namespace http
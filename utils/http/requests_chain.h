@@ -4,64 +4,99 @@
 #include <asio.hpp>
 #include <crow.h>
 
-#include <vector>
+#include <chrono>
+#include <deque>
 #include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
 #include <string>
 
+#include "health_monitor.h"
+#include "http_client.h"
+
 namespace utils {
 namespace http {
 
 /**
  * @brief Represents a chain of HTTP requests.
- * 
+ *
  * The RequestsChain class allows you to add multiple HTTP requests to a chain and execute them sequentially.
  * Each request in the chain can have its own host, port, target, body, and response handler.
+ *
+ * The chain is fully asynchronous: Execute() only schedules the next request and returns immediately.
+ * Requests are sent through a shared HttpClient, so connections to the services are pooled and kept alive.
+ * When a HealthMonitor is given, a request to a service whose circuit is open fails fast without being sent.
+ * The chain must be owned by a std::shared_ptr, because every pending request keeps the chain alive
+ * until its handler has run.
  */
-class RequestsChain {
+class RequestsChain : public std::enable_shared_from_this<RequestsChain> {
 public:
-    using ResponseHandler = std::function<void(const crow::response&)>;
+    using ResponseHandler = HttpClient::ResponseHandler;
+
+    // Pipeline stages answer once the whole stage is done, which may take long for big videos
+    static constexpr std::chrono::milliseconds kDefaultTimeout = std::chrono::hours(1);
 
     /**
      * @brief Constructs a RequestsChain object.
-     * 
-     * @param io_context The asio::io_context object to be used for asynchronous operations.
+     *
+     * @param client The HTTP client used to send the requests.
+     * @param health The health monitor of the target services, may be nullptr.
      */
-    RequestsChain(asio::io_context& io_context)
-        : io_context_(io_context) {}
+    explicit RequestsChain(HttpClient& client, HealthMonitor* health = nullptr)
+        : client_(client), health_(health) {}
 
     /**
      * @brief Adds a request to the chain.
-     * 
+     *
      * @param host The host of the request.
      * @param port The port of the request.
      * @param target The target of the request.
      * @param body The body of the request.
      * @param handler The response handler for the request.
+     * @param timeout The time limit for the request.
      */
-    void AddRequest(const std::string& host, const std::string& port, const std::string& target, 
-                    const crow::json::wvalue& body, ResponseHandler handler);
+    void AddRequest(const std::string& host, const std::string& port, const std::string& target,
+                    const crow::json::wvalue& body, ResponseHandler handler,
+                    std::chrono::milliseconds timeout = kDefaultTimeout);
 
     /**
-     * @brief Executes the requests in the chain.
-     * 
+     * @brief Starts executing the requests in the chain.
+     *
      * The requests are executed sequentially in the order they were added to the chain.
-     * The response handlers are called for each request after the response is received.
-     * 
-     * @return true if all requests were executed successfully, false otherwise.
+     * The response handler of a request is called once its response has been fully received; the handler
+     * may add further requests and call Execute() again to continue the chain.
+     * If a request cannot be delivered or the target service is known to be down, its handler is called
+     * with a 503 (or 504 on timeout) response.
      */
-    bool Execute();
+    void Execute();
 
     std::size_t GetRequestsCount() const {
+        std::lock_guard<std::mutex> lock(mutex_);
         return requests_.size();
     }
 
     bool IsEmpty() const {
+        std::lock_guard<std::mutex> lock(mutex_);
         return requests_.empty();
     }
 
 private:
-    asio::io_context& io_context_;
-    std::vector<std::tuple<std::string, std::string, std::string, crow::json::wvalue, ResponseHandler>> requests_;
+    struct Request {
+        std::string host;
+        std::string port;
+        std::string target;
+        std::string body;
+        ResponseHandler handler;
+        std::chrono::milliseconds timeout;
+    };
+
+    void Send(Request request);
+
+    HttpClient& client_;
+    HealthMonitor* health_;
+    mutable std::mutex mutex_;
+    std::deque<Request> requests_;
 };
 
 } // namespace http
@@ -0,0 +1,381 @@
+#include "async_redis.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <utility>
+
+namespace redis {
+
+namespace {
+
+// Delay before a client with subscriptions reconnects after losing its connection
+constexpr std::chrono::seconds kReconnectDelay{1};
+
+Reply MakeErrorReply(const std::string& message) {
+    Reply reply;
+    reply.type = REDIS_REPLY_ERROR;
+    reply.str = message;
+    return reply;
+}
+
+/**
+ * Copies a hiredis reply, with its nested elements.
+ */
+Reply CopyReply(const redisReply* source) {
+    Reply reply;
+    reply.type = source->type;
+    reply.integer = source->integer;
+    if (source->str != nullptr) {
+        reply.str.assign(source->str, source->len);
+    }
+    if (source->type == REDIS_REPLY_ARRAY) {
+        reply.elements.reserve(source->elements);
+        for (std::size_t i = 0; i < source->elements; ++i) {
+            reply.elements.push_back(CopyReply(source->element[i]));
+        }
+    }
+    return reply;
+}
+
+} // namespace
+
+/**
+ * The socket of a hiredis context and the events hiredis is waiting for on it. A lost connection keeps
+ * its state until its pending waits are aborted, while the next connection gets a new one.
+ */
+struct AsyncRedis::Connection {
+    explicit Connection(asio::strand<asio::io_context::executor_type>& strand) : socket(strand) {}
+
+    asio::ip::tcp::socket socket;
+    bool reading = false;
+    bool writing = false;
+    bool read_waiting = false;
+    bool write_waiting = false;
+    bool closed = false;
+};
+
+struct AsyncRedis::PendingCommand {
+    AsyncRedis* client;
+    ReplyHandler handler;
+};
+
+/**
+ * A channel subscription. hiredis calls back with the same private data for every message of the channel,
+ * so it lives as long as the client.
+ */
+struct AsyncRedis::Subscription {
+    AsyncRedis* client;
+    std::string channel;
+    MessageHandler on_message;
+    SubscribedHandler on_subscribed;
+};
+
+AsyncRedis::AsyncRedis(asio::io_context& io_context, std::string host, const int port)
+    : io_context_(io_context), strand_(asio::make_strand(io_context)), host_(std::move(host)), port_(port),
+      reconnect_timer_(strand_) {}
+
+AsyncRedis::~AsyncRedis() {
+    stopping_ = true;
+    if (context_ != nullptr) {
+        // Calls the pending reply callbacks with no reply, then Cleanup
+        redisAsyncFree(context_);
+    }
+}
+
+void AsyncRedis::Command(std::vector<std::string> args, ReplyHandler handler) {
+    asio::post(strand_, [this, args = std::move(args), handler = std::move(handler)]() mutable {
+        Send(args, std::move(handler));
+    });
+}
+
+std::future<Reply> AsyncRedis::Command(std::vector<std::string> args) {
+    auto promise = std::make_shared<std::promise<Reply>>();
+    auto future = promise->get_future();
+    Command(std::move(args), [promise](const Reply& reply) {
+        promise->set_value(reply);
+    });
+    return future;
+}
+
+void AsyncRedis::Pipeline(std::vector<std::vector<std::string>> commands, PipelineHandler handler) {
+    if (commands.empty()) {
+        asio::post(io_context_, [handler = std::move(handler)] {
+            handler({});
+        });
+        return;
+    }
+
+    struct State {
+        std::vector<Reply> replies;
+        // The replies are handled on any thread of the io_context
+        std::atomic<std::size_t> remaining;
+        PipelineHandler handler;
+    };
+    auto state = std::make_shared<State>();
+    state->replies.resize(commands.size());
+    state->remaining.store(commands.size());
+    state->handler = std::move(handler);
+
+    // All the commands are buffered in one go on the strand and written together
+    asio::post(strand_, [this, commands = std::move(commands), state]() {
+        for (std::size_t i = 0; i < commands.size(); ++i) {
+            Send(commands[i], [state, i](const Reply& reply) {
+                state->replies[i] = reply;
+                if (state->remaining.fetch_sub(1) == 1) {
+                    state->handler(std::move(state->replies));
+                }
+            });
+        }
+    });
+}
+
+std::future<std::vector<Reply>> AsyncRedis::Pipeline(std::vector<std::vector<std::string>> commands) {
+    auto promise = std::make_shared<std::promise<std::vector<Reply>>>();
+    auto future = promise->get_future();
+    Pipeline(std::move(commands), [promise](std::vector<Reply> replies) {
+        promise->set_value(std::move(replies));
+    });
+    return future;
+}
+
+void AsyncRedis::Subscribe(std::string channel, MessageHandler on_message, SubscribedHandler on_subscribed) {
+    auto subscription = std::make_shared<Subscription>(
+        Subscription{this, std::move(channel), std::move(on_message), std::move(on_subscribed)});
+    asio::post(strand_, [this, subscription]() {
+        subscriptions_[subscription->channel] = subscription;
+        if (context_ == nullptr && !Connect()) {
+            ScheduleReconnect();
+            return;
+        }
+        SendSubscribe(subscription.get());
+    });
+}
+
+/**
+ * Sends the SUBSCRIBE command of a subscription. Runs on the strand, with a connection.
+ */
+void AsyncRedis::SendSubscribe(Subscription* subscription) {
+    const char* argv[] = {"SUBSCRIBE", subscription->channel.c_str()};
+    const std::size_t argv_len[] = {std::strlen("SUBSCRIBE"), subscription->channel.size()};
+    if (redisAsyncCommandArgv(context_, &AsyncRedis::OnSubscriptionReply, subscription, 2, argv,
+                              argv_len) != REDIS_OK) {
+        std::cerr << "Failed to subscribe to " << subscription->channel << std::endl;
+    }
+}
+
+/**
+ * Opens the connection again after a delay and renews the subscriptions. Runs on the strand.
+ */
+void AsyncRedis::ScheduleReconnect() {
+    if (stopping_ || subscriptions_.empty()) {
+        return;
+    }
+    reconnect_timer_.expires_after(kReconnectDelay);
+    reconnect_timer_.async_wait(asio::bind_executor(strand_, [this](const asio::error_code& ec) {
+        if (ec || stopping_ || context_ != nullptr) {
+            return;
+        }
+        if (!Connect()) {
+            ScheduleReconnect();
+            return;
+        }
+        for (auto& [channel, subscription] : subscriptions_) {
+            SendSubscribe(subscription.get());
+        }
+    }));
+}
+
+/**
+ * Opens the connection and hooks it to the strand. Runs on the strand.
+ *
+ * @return True if a connection is being established, false otherwise.
+ */
+bool AsyncRedis::Connect() {
+    redisAsyncContext* context = redisAsyncConnect(host_.c_str(), port_);
+    if (context == nullptr || context->err != 0) {
+        std::cerr << "Failed to create Redis connection: "
+                  << (context != nullptr ? context->errstr : "Unknown error") << std::endl;
+        if (context != nullptr) {
+            redisAsyncFree(context);
+        }
+        return false;
+    }
+
+    auto connection = std::make_shared<Connection>(strand_);
+    asio::error_code ec;
+    connection->socket.assign(asio::ip::tcp::v4(), context->c.fd, ec);
+    if (ec) {
+        std::cerr << "Failed to watch the Redis connection: " << ec.message() << std::endl;
+        redisAsyncFree(context);
+        return false;
+    }
+
+    context->data = this;
+    context->ev.data = this;
+    context->ev.addRead = &AsyncRedis::AddRead;
+    context->ev.delRead = &AsyncRedis::DelRead;
+    context->ev.addWrite = &AsyncRedis::AddWrite;
+    context->ev.delWrite = &AsyncRedis::DelWrite;
+    context->ev.cleanup = &AsyncRedis::Cleanup;
+    redisAsyncSetConnectCallback(context, &AsyncRedis::OnConnect);
+    redisAsyncSetDisconnectCallback(context, &AsyncRedis::OnDisconnect);
+
+    context_ = context;
+    connection_ = std::move(connection);
+    return true;
+}
+
+/**
+ * Hands a command over to hiredis. Runs on the strand.
+ */
+void AsyncRedis::Send(const std::vector<std::string>& args, ReplyHandler handler) {
+    if (context_ == nullptr && !Connect()) {
+        asio::post(io_context_, [handler = std::move(handler)] {
+            handler(MakeErrorReply("Redis connection error"));
+        });
+        return;
+    }
+
+    std::vector<const char*> argv;
+    std::vector<std::size_t> argv_len;
+    argv.reserve(args.size());
+    argv_len.reserve(args.size());
+    for (const auto& arg : args) {
+        argv.push_back(arg.c_str());
+        argv_len.push_back(arg.size());
+    }
+
+    auto* pending = new PendingCommand{this, std::move(handler)};
+    const int status = redisAsyncCommandArgv(context_, &AsyncRedis::OnReply, pending, static_cast<int>(argv.size()),
+                                             argv.data(), argv_len.data());
+    if (status != REDIS_OK) {
+        // hiredis does not call back for a command it refused
+        asio::post(io_context_, [handler = std::move(pending->handler)] {
+            handler(MakeErrorReply("Failed to send the Redis command"));
+        });
+        delete pending;
+    }
+}
+
+void AsyncRedis::WaitReadable(const std::shared_ptr<Connection>& connection) {
+    if (connection->read_waiting || connection->closed) {
+        return;
+    }
+    connection->read_waiting = true;
+    connection->socket.async_wait(asio::ip::tcp::socket::wait_read,
+        asio::bind_executor(strand_, [this, connection](const asio::error_code& ec) {
+            connection->read_waiting = false;
+            if (ec || connection->closed || !connection->reading) {
+                return;
+            }
+            redisAsyncHandleRead(context_);
+            // hiredis expects to be told about readability for as long as it has not called DelRead
+            if (connection->reading) {
+                WaitReadable(connection);
+            }
+        }));
+}
+
+void AsyncRedis::WaitWritable(const std::shared_ptr<Connection>& connection) {
+    if (connection->write_waiting || connection->closed) {
+        return;
+    }
+    connection->write_waiting = true;
+    connection->socket.async_wait(asio::ip::tcp::socket::wait_write,
+        asio::bind_executor(strand_, [this, connection](const asio::error_code& ec) {
+            connection->write_waiting = false;
+            if (ec || connection->closed || !connection->writing) {
+                return;
+            }
+            redisAsyncHandleWrite(context_);
+            if (connection->writing) {
+                WaitWritable(connection);
+            }
+        }));
+}
+
+void AsyncRedis::OnConnect(const redisAsyncContext* context, const int status) {
+    if (status != REDIS_OK) {
+        std::cerr << "Failed to connect to Redis: " << context->errstr << std::endl;
+    }
+}
+
+void AsyncRedis::OnDisconnect(const redisAsyncContext* context, const int status) {
+    if (status != REDIS_OK) {
+        std::cerr << "Redis connection lost: " << context->errstr << std::endl;
+    }
+}
+
+void AsyncRedis::OnReply(redisAsyncContext* context, void* reply, void* privdata) {
+    auto* pending = static_cast<PendingCommand*>(privdata);
+    // A command pending when the connection is lost is called back with no reply
+    Reply result = reply != nullptr
+        ? CopyReply(static_cast<redisReply*>(reply))
+        : MakeErrorReply(context->errstr[0] != '\0' ? context->errstr : "Redis connection lost");
+    asio::post(pending->client->io_context_, [handler = std::move(pending->handler), result = std::move(result)] {
+        handler(result);
+    });
+    delete pending;
+}
+
+void AsyncRedis::OnSubscriptionReply(redisAsyncContext* context, void* reply, void* privdata) {
+    auto* subscription = static_cast<Subscription*>(privdata);
+    const auto* pushed = static_cast<redisReply*>(reply);
+    // Called with no reply when the connection is lost, it is renewed by the reconnection
+    if (pushed == nullptr || pushed->type != REDIS_REPLY_ARRAY || pushed->elements < 3) {
+        return;
+    }
+    const std::string kind(pushed->element[0]->str, pushed->element[0]->len);
+    if (kind == "subscribe") {
+        asio::post(subscription->client->io_context_, [subscription] {
+            subscription->on_subscribed();
+        });
+    } else if (kind == "message") {
+        std::string message(pushed->element[2]->str, pushed->element[2]->len);
+        asio::post(subscription->client->io_context_, [subscription, message = std::move(message)] {
+            subscription->on_message(message);
+        });
+    }
+}
+
+void AsyncRedis::AddRead(void* privdata) {
+    auto* self = static_cast<AsyncRedis*>(privdata);
+    self->connection_->reading = true;
+    self->WaitReadable(self->connection_);
+}
+
+void AsyncRedis::DelRead(void* privdata) {
+    static_cast<AsyncRedis*>(privdata)->connection_->reading = false;
+}
+
+void AsyncRedis::AddWrite(void* privdata) {
+    auto* self = static_cast<AsyncRedis*>(privdata);
+    self->connection_->writing = true;
+    self->WaitWritable(self->connection_);
+}
+
+void AsyncRedis::DelWrite(void* privdata) {
+    static_cast<AsyncRedis*>(privdata)->connection_->writing = false;
+}
+
+/**
+ * Called by hiredis when it frees the context, after a disconnection or from the destructor.
+ * The socket is closed by hiredis, it is only released here; the next command opens a new connection.
+ */
+void AsyncRedis::Cleanup(void* privdata) {
+    auto* self = static_cast<AsyncRedis*>(privdata);
+    if (self->connection_) {
+        self->connection_->closed = true;
+        self->connection_->reading = false;
+        self->connection_->writing = false;
+        asio::error_code ec;
+        self->connection_->socket.release(ec);
+        self->connection_.reset();
+    }
+    self->context_ = nullptr;
+    self->ScheduleReconnect();
+}
+
+} // namespace redis
@@ -0,0 +1,129 @@
+#pragma once
+
+#include <functional>
+#include <future>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <asio.hpp>
+#include <hiredis.h>
+#include <async.h>
+
+namespace redis {
+
+/**
+ * @brief A Redis reply copied out of hiredis, so that it outlives the callback it was delivered to.
+ *
+ * A command that could not be sent or whose connection was lost is reported as an error reply.
+ */
+struct Reply {
+    int type = REDIS_REPLY_NIL;
+    long long integer = 0;
+    std::string str;
+    std::vector<Reply> elements;
+
+    bool IsError() const {
+        return type == REDIS_REPLY_ERROR;
+    }
+
+    bool IsNil() const {
+        return type == REDIS_REPLY_NIL;
+    }
+};
+
+/**
+ * @brief Non-blocking Redis client built on the hiredis async API and driven by an asio io_context.
+ *
+ * The connection is opened on the first command and opened again on the next command after it is lost.
+ * Commands are written as soon as the socket is writable and their replies are read as they arrive, so
+ * commands issued together are pipelined in one round trip. The hiredis context is only touched from
+ * a strand, while the reply handlers are posted to the io_context, so a handler may block or issue more
+ * commands without stalling the connection.
+ *
+ * A client can also subscribe to channels; it is then kept connected, subscribed again after a lost
+ * connection, and must not be used for other commands.
+ *
+ * The client must be destroyed once the io_context no longer runs; pending commands then fail.
+ */
+class AsyncRedis {
+public:
+    using ReplyHandler = std::function<void(const Reply&)>;
+    using PipelineHandler = std::function<void(std::vector<Reply>)>;
+    using MessageHandler = std::function<void(const std::string& message)>;
+    using SubscribedHandler = std::function<void()>;
+
+    AsyncRedis(asio::io_context& io_context, std::string host, int port);
+    ~AsyncRedis();
+
+    AsyncRedis(const AsyncRedis&) = delete;
+    AsyncRedis& operator=(const AsyncRedis&) = delete;
+
+    /**
+     * @brief Sends a command.
+     *
+     * @param args The command and its arguments, e.g. {"HGET", "request:<id>", "status"}.
+     * @param handler The handler called with the reply.
+     */
+    void Command(std::vector<std::string> args, ReplyHandler handler);
+    std::future<Reply> Command(std::vector<std::string> args);
+
+    /**
+     * @brief Sends several commands at once, without waiting for the reply of one to send the next.
+     *
+     * @param commands The commands with their arguments.
+     * @param handler The handler called with all the replies, in the order of the commands.
+     */
+    void Pipeline(std::vector<std::vector<std::string>> commands, PipelineHandler handler);
+    std::future<std::vector<Reply>> Pipeline(std::vector<std::vector<std::string>> commands);
+
+    /**
+     * @brief Subscribes to a channel.
+     *
+     * Messages published while the client is reconnecting are lost; on_subscribed is called every time
+     * the subscription is confirmed, so that the subscriber can catch up after a lost connection.
+     *
+     * @param channel The channel to subscribe to.
+     * @param on_message The handler called with every message published on the channel.
+     * @param on_subscribed The handler called when the subscription is confirmed.
+     */
+    void Subscribe(std::string channel, MessageHandler on_message, SubscribedHandler on_subscribed);
+
+private:
+    struct Connection;
+    struct PendingCommand;
+    struct Subscription;
+
+    bool Connect();
+    void SendSubscribe(Subscription* subscription);
+    void ScheduleReconnect();
+    void Send(const std::vector<std::string>& args, ReplyHandler handler);
+    void WaitReadable(const std::shared_ptr<Connection>& connection);
+    void WaitWritable(const std::shared_ptr<Connection>& connection);
+
+    static void OnConnect(const redisAsyncContext* context, int status);
+    static void OnDisconnect(const redisAsyncContext* context, int status);
+    static void OnReply(redisAsyncContext* context, void* reply, void* privdata);
+    static void OnSubscriptionReply(redisAsyncContext* context, void* reply, void* privdata);
+
+    static void AddRead(void* privdata);
+    static void DelRead(void* privdata);
+    static void AddWrite(void* privdata);
+    static void DelWrite(void* privdata);
+    static void Cleanup(void* privdata);
+
+    asio::io_context& io_context_;
+    asio::strand<asio::io_context::executor_type> strand_;
+    std::string host_;
+    int port_;
+
+    // Accessed only on the strand
+    redisAsyncContext* context_ = nullptr;
+    std::shared_ptr<Connection> connection_;
+    std::unordered_map<std::string, std::shared_ptr<Subscription>> subscriptions_;
+    asio::steady_timer reconnect_timer_;
+    bool stopping_ = false;
+};
+
+} // namespace redis
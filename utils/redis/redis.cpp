@@ -2,9 +2,100 @@
 
 #include <iostream>
 #include <cstdio> // for snprintf
+#include <cstring>
+#include <mutex>
+#include <vector>
 
 namespace redis_utils {
 
+namespace {
+
+// Checks the current status of a video against the allowed previous statuses and sets the new one,
+// all in one atomic step. A changed status bumps the version of the request and is published as
+// "<id> <version> <status>". KEYS[1] is the request hash, ARGV[1] the new status, ARGV[2] the channel,
+// ARGV[3] the ID of the video and the rest of ARGV the statuses it may follow. Returns whether the new
+// status has been set and the previous status, or nil when there is no such video.
+constexpr const char* kStatusTransitionScript = R"lua(
+local current = redis.call('HGET', KEYS[1], 'status')
+if not current then
+    return nil
+end
+for i = 4, #ARGV do
+    if ARGV[i] == current then
+        if current ~= ARGV[1] then
+            redis.call('HSET', KEYS[1], 'status', ARGV[1])
+            local version = redis.call('HINCRBY', KEYS[1], 'version', 1)
+            redis.call('PUBLISH', ARGV[2], ARGV[3] .. ' ' .. version .. ' ' .. ARGV[1])
+        end
+        return {1, current}
+    end
+end
+return {0, current}
+)lua";
+
+std::mutex status_transition_sha_mutex;
+std::string status_transition_sha;
+
+/**
+ * Loads the status transition script into the script cache of the Redis server.
+ *
+ * @return The SHA1 digest the script is run by, or an empty string if it could not be loaded.
+ */
+std::string LoadStatusTransitionScript(redisContext *redis_conn) {
+    redisReply *reply = static_cast<redisReply*>(redisCommand(redis_conn, "SCRIPT LOAD %s",
+                                                               kStatusTransitionScript));
+    if (reply == nullptr) {
+        std::cerr << "Failed to load the status transition script: " << redis_conn->errstr << std::endl;
+        return {};
+    }
+    std::string sha;
+    if (reply->type == REDIS_REPLY_STRING) {
+        sha.assign(reply->str, reply->len);
+    } else if (reply->type == REDIS_REPLY_ERROR) {
+        std::cerr << "Failed to load the status transition script: " << reply->str << std::endl;
+    }
+    freeReplyObject(reply);
+
+    std::lock_guard<std::mutex> lock(status_transition_sha_mutex);
+    status_transition_sha = sha;
+    return sha;
+}
+
+std::string GetStatusTransitionSha(redisContext *redis_conn) {
+    {
+        std::lock_guard<std::mutex> lock(status_transition_sha_mutex);
+        if (!status_transition_sha.empty()) {
+            return status_transition_sha;
+        }
+    }
+    return LoadStatusTransitionScript(redis_conn);
+}
+
+/**
+ * Runs the status transition script by its digest.
+ *
+ * @return The reply of the script, or nullptr if the command failed.
+ */
+redisReply* RunStatusTransitionScript(redisContext *redis_conn, const std::string& sha,
+                                      const std::vector<std::string>& args) {
+    std::vector<const char*> argv;
+    std::vector<std::size_t> argv_len;
+    argv.reserve(args.size() + 1);
+    argv_len.reserve(args.size() + 1);
+    argv.push_back("EVALSHA");
+    argv_len.push_back(std::strlen("EVALSHA"));
+    argv.push_back(sha.c_str());
+    argv_len.push_back(sha.size());
+    for (const auto& arg : args) {
+        argv.push_back(arg.c_str());
+        argv_len.push_back(arg.size());
+    }
+    return static_cast<redisReply*>(redisCommandArgv(redis_conn, static_cast<int>(argv.size()), argv.data(),
+                                                     argv_len.data()));
+}
+
+} // namespace
+
 /**
  * Generates a universally unique identifier (UUID) string.
  *
@@ -68,7 +159,8 @@ redisContext* RedisConnect(const std::string& ip, const std::size_t port) {
  * @brief Retrieves a Redis reply by executing a Redis command with variable arguments.
  * 
  * This function takes a Redis connection and a format string with variable arguments, and executes the Redis command.
- * It returns the Redis reply as a redisReply pointer.
+ * It returns the Redis reply as a redisReply pointer. The connection is left to its owner even when the
+ * command fails; its err field then tells that it is broken.
  * 
  * @param redis_conn A pointer to the redisContext representing the Redis connection.
  * @param format A format string specifying the Redis command to execute.
@@ -88,7 +180,6 @@ redisReply* RedisGetByKey(redisContext *redis_conn, const char* format, ...) {
 
     if (reply == nullptr) {
         std::cerr << "Error executing Redis command: " << redis_conn->errstr << std::endl;
-        redisFree(redis_conn);
         return nullptr;
     }
 
@@ -116,41 +207,73 @@ void RedisSaveVideoRequest(redisContext *redis_conn, const requests::VideoReques
 /**
  * @brief Updates the status of a video in Redis.
  *
- * This function updates the status of a video in Redis by executing an HSET command.
- * The video status is stored as a string in the Redis hash with the specified key.
- * The status is updated only if the current status is not VideoStatus::Stopped.
+ * The new status is set only if the current one may be followed by it according to the transitions
+ * of requests::IsVideoStatusTransitionAllowed, so a status never goes back to an earlier stage and a final
+ * status is never overwritten. The check and the update are done by a Lua script run with EVALSHA,
+ * in a single atomic round trip; the script is loaded again if the server no longer has it.
+ * Every change of the status increments the version field of the request and is published
+ * on kStatusChannel, so that clients waiting for it are notified.
  *
  * @param redis_conn A pointer to the Redis connection.
- * @param key The key of the Redis hash where the video status is stored.
+ * @param key The ID of the video, the status is stored in the request:<key> hash.
  * @param new_status The new status of the video.
+ * @return The outcome of the update and the previous status of the video.
  */
-void RedisUpdateVideoStatus(redisContext *redis_conn, const std::string& key, requests::VideoStatus new_status) {
+StatusTransition RedisUpdateVideoStatus(redisContext *redis_conn, const std::string& key,
+                                        requests::VideoStatus new_status) {
+    StatusTransition transition;
     if (redis_conn == nullptr) {
         std::cerr << "Redis connection is null" << std::endl;
-        return;
+        return transition;
     }
 
-    // Get the current status from Redis
-    std::optional<requests::VideoStatus> current_status = RedisGetRequestVideoStatus(redis_conn, key);
-    if (!current_status) {
-        std::cerr << "Failed to get current status from Redis" << std::endl;
-        return;
+    std::vector<std::string> args = {"1", "request:" + key, requests::VideoStatusToString(new_status),
+                                     kStatusChannel, key};
+    for (const auto status : requests::GetVideoStatusPredecessors(new_status)) {
+        args.push_back(requests::VideoStatusToString(status));
     }
 
-    // Check if the current status is VideoStatus::Stopped
-    if (*current_status == requests::VideoStatus::Stopped) {
-        std::cout << "Cannot update status. Current status is VideoStatus::Stopped" << std::endl;
-        return;
+    std::string sha = GetStatusTransitionSha(redis_conn);
+    if (sha.empty()) {
+        return transition;
+    }
+    redisReply *reply = RunStatusTransitionScript(redis_conn, sha, args);
+    if (reply != nullptr && reply->type == REDIS_REPLY_ERROR && std::strncmp(reply->str, "NOSCRIPT", 8) == 0) {
+        // The script cache has been flushed or the server restarted
+        freeReplyObject(reply);
+        sha = LoadStatusTransitionScript(redis_conn);
+        if (sha.empty()) {
+            return transition;
+        }
+        reply = RunStatusTransitionScript(redis_conn, sha, args);
     }
-
-    const std::string command = "HSET request:" + key + " status " + requests::VideoStatusToString(new_status);
-    redisReply *reply = static_cast<redisReply*>(redisCommand(redis_conn, command.c_str()));
     if (reply == nullptr) {
-        std::cerr << "Failed to execute command: " << command << std::endl;
-        return;
+        std::cerr << "Failed to update the status of " << key << ": " << redis_conn->errstr << std::endl;
+        return transition;
+    }
+
+    if (reply->type == REDIS_REPLY_NIL) {
+        transition.result = StatusTransition::Result::NotFound;
+    } else if (reply->type == REDIS_REPLY_ARRAY && reply->elements == 2) {
+        const bool applied = reply->element[0]->integer == 1;
+        transition.result = applied ? StatusTransition::Result::Applied : StatusTransition::Result::Rejected;
+        try {
+            transition.previous = requests::StringToVideoStatus(std::string(reply->element[1]->str,
+                                                                            reply->element[1]->len));
+        } catch (const std::exception&) {
+            std::cerr << "Unknown status of " << key << " in Redis" << std::endl;
+        }
+        if (!applied) {
+            std::cout << "Cannot update status of " << key << " to " << requests::VideoStatusToString(new_status)
+                      << " from " << std::string(reply->element[1]->str, reply->element[1]->len) << std::endl;
+        }
+    } else {
+        std::cerr << "Failed to update the status of " << key << ": "
+                  << (reply->type == REDIS_REPLY_ERROR ? reply->str : "unexpected reply") << std::endl;
     }
 
     freeReplyObject(reply);
+    return transition;
 }
 
 /**
@@ -177,7 +300,14 @@ void RedisSaveJsonResponse(redisContext *redis_conn, const std::string& key, con
 void RedisSaveYoloResponse(redisContext *redis_conn, const std::string& id, const crow::json::wvalue& json_response) {
     std::string json_str = json_response.dump();
     std::string key = "yolo_response:" + id;
-    redisCommand(redis_conn, "SET %s %s", key.c_str(), json_str.c_str());
+    if (redis_conn == nullptr) {
+        std::cerr << "Redis connection is null" << std::endl;
+        return;
+    }
+    redisReply *reply = static_cast<redisReply*>(redisCommand(redis_conn, "SET %s %s", key.c_str(), json_str.c_str()));
+    if (reply != nullptr) {
+        freeReplyObject(reply);
+    }
 }
 
 /**
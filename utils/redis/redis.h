@@ -17,6 +17,33 @@
 
 namespace redis_utils {
 
+// Channel the status changes of all videos are published on, as "<id> <version> <status>"
+constexpr const char* kStatusChannel = "video-status";
+
+/**
+ * @brief The outcome of a status update, applied atomically on the Redis server.
+ */
+struct StatusTransition {
+    enum class Result {
+        // The status has been set
+        Applied,
+        // The video is in a status the new one cannot follow
+        Rejected,
+        // There is no such video
+        NotFound,
+        // The command failed
+        Error
+    };
+
+    Result result = Result::Error;
+    // The status of the video before the update, known when it was applied or rejected
+    std::optional<requests::VideoStatus> previous;
+
+    bool applied() const {
+        return result == Result::Applied;
+    }
+};
+
 std::string GenerateUUID();
 
 redisContext* RedisConnect(const std::string& ip, const std::size_t port);
@@ -25,7 +52,8 @@ redisReply* RedisGetByKey(redisContext *redis_conn, const char* format, ...);
 
 void RedisSaveVideoRequest(redisContext *redis_conn, const requests::VideoRequest& request);
 
-void RedisUpdateVideoStatus(redisContext *redis_conn, const std::string& key, requests::VideoStatus new_status);
+StatusTransition RedisUpdateVideoStatus(redisContext *redis_conn, const std::string& key,
+                                        requests::VideoStatus new_status);
 
 void RedisSaveJsonResponse(redisContext *redis_conn, const std::string& key, const crow::json::wvalue& json_response);
 
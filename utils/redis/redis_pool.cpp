@@ -1,61 +1,153 @@
 #include "redis_pool.h"
 #include <iostream>
+#include <utility>
 
 #include "../cfg/global_config.h"
 
 namespace redis {
 
+PooledConnection::~PooledConnection() {
+    release();
+}
+
+PooledConnection::PooledConnection(PooledConnection&& other) noexcept
+    : pool_(std::exchange(other.pool_, nullptr)), connection_(std::exchange(other.connection_, nullptr)) {
+}
+
+PooledConnection& PooledConnection::operator=(PooledConnection&& other) noexcept {
+    if (this != &other) {
+        release();
+        pool_ = std::exchange(other.pool_, nullptr);
+        connection_ = std::exchange(other.connection_, nullptr);
+    }
+    return *this;
+}
+
+void PooledConnection::release() {
+    if (pool_ != nullptr && connection_ != nullptr) {
+        pool_->releaseConnection(connection_);
+    }
+    pool_ = nullptr;
+    connection_ = nullptr;
+}
+
 RedisPool& RedisPool::getInstance() {
-    constexpr std::size_t poolSize = 5;
     const auto& config = cfg::GlobalConfig::getInstance();
     const auto& redisConfig = config.getRedis();
-    static RedisPool instance(redisConfig.host, redisConfig.port, poolSize);
+    const auto& poolConfig = config.getRedisPool();
+    Options options;
+    options.size = poolConfig.size;
+    options.checkout_timeout = std::chrono::milliseconds(poolConfig.checkout_timeout_ms);
+    options.validate_after = std::chrono::milliseconds(poolConfig.validate_after_ms);
+    static RedisPool instance(redisConfig.host, static_cast<int>(redisConfig.port), options);
     return instance;
 }
 
-RedisPool::RedisPool(const std::string& host, int port, int poolSize)
-    : host_(host), port_(port), poolSize_(poolSize) {
-    initializePool();
+RedisPool::RedisPool(const std::string& host, int port, Options options)
+    : host_(host), port_(port), options_(options) {
+    if (options_.size == 0) {
+        options_.size = 1;
+    }
 }
 
 RedisPool::~RedisPool() {
     releasePool();
 }
 
-redisContext* RedisPool::getConnection() {
+PooledConnection RedisPool::acquire() {
+    const auto deadline = std::chrono::steady_clock::now() + options_.checkout_timeout;
     std::unique_lock<std::mutex> lock(mutex_);
-    while (pool_.empty()) {
-        cv_.wait(lock);
+    while (true) {
+        if (!idle_.empty()) {
+            const IdleConnection idle = idle_.back();
+            idle_.pop_back();
+
+            const bool needs_validation = std::chrono::steady_clock::now() - idle.since >= options_.validate_after;
+            if (!needs_validation) {
+                return PooledConnection(this, idle.connection);
+            }
+            lock.unlock();
+            if (validate(idle.connection)) {
+                return PooledConnection(this, idle.connection);
+            }
+            // Replace the broken connection
+            redisFree(idle.connection);
+            redisContext* connection = connect();
+            lock.lock();
+            if (connection != nullptr) {
+                return PooledConnection(this, connection);
+            }
+            --open_;
+            cv_.notify_one();
+            return PooledConnection();
+        }
+
+        if (open_ < options_.size) {
+            ++open_;
+            lock.unlock();
+            redisContext* connection = connect();
+            lock.lock();
+            if (connection != nullptr) {
+                return PooledConnection(this, connection);
+            }
+            --open_;
+            cv_.notify_one();
+            return PooledConnection();
+        }
+
+        if (cv_.wait_until(lock, deadline) == std::cv_status::timeout && idle_.empty() && open_ >= options_.size) {
+            std::cerr << "Timed out waiting for a Redis connection from the pool" << std::endl;
+            return PooledConnection();
+        }
+    }
+}
+
+redisContext* RedisPool::connect() {
+    redisContext* connection = redisConnect(host_.c_str(), port_);
+    if (connection == nullptr || connection->err != 0) {
+        std::cerr << "Failed to create Redis connection: "
+                  << (connection != nullptr ? connection->errstr : "Unknown error")
+                  << std::endl;
+        if (connection != nullptr) {
+            redisFree(connection);
+        }
+        return nullptr;
     }
-    redisContext* connection = pool_.back();
-    pool_.pop_back();
     return connection;
 }
 
-void RedisPool::releaseConnection(redisContext* connection) {
-    std::unique_lock<std::mutex> lock(mutex_);
-    pool_.push_back(connection);
-    cv_.notify_one();
+bool RedisPool::validate(redisContext* connection) {
+    if (connection->err != 0) {
+        return false;
+    }
+    redisReply* reply = static_cast<redisReply*>(redisCommand(connection, "PING"));
+    if (reply == nullptr) {
+        return false;
+    }
+    const bool valid = reply->type == REDIS_REPLY_STATUS;
+    freeReplyObject(reply);
+    return valid;
 }
 
-void RedisPool::initializePool() {
-    for (int i = 0; i < poolSize_; ++i) {
-        redisContext* connection = redisConnect(host_.c_str(), port_);
-        if (connection != nullptr && connection->err == 0) {
-            pool_.push_back(connection);
-        } else {
-            std::cerr << "Failed to create Redis connection: " 
-                      << (connection != nullptr ? connection->errstr : "Unknown error") 
-                      << std::endl;
-        }
+void RedisPool::releaseConnection(redisContext* connection) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    if (connection->err != 0) {
+        // A connection that failed is closed, the next checkout opens a new one
+        redisFree(connection);
+        --open_;
+    } else {
+        idle_.push_back(IdleConnection{connection, std::chrono::steady_clock::now()});
     }
+    cv_.notify_one();
 }
 
 void RedisPool::releasePool() {
-    for (redisContext* connection : pool_) {
-        redisFree(connection);
+    std::unique_lock<std::mutex> lock(mutex_);
+    for (const auto& idle : idle_) {
+        redisFree(idle.connection);
     }
-    pool_.clear();
+    open_ -= idle_.size();
+    idle_.clear();
 }
 
-} // namespace redis
\ No newline at end of file
+} // namespace redis
@@ -1,37 +1,102 @@
 #pragma once
 
-#include <vector>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
 #include <mutex>
 #include <string>
-#include <condition_variable>
+#include <vector>
 
 #include <hiredis.h>
 
 namespace redis {
 
+class RedisPool;
+
+/**
+ * @brief A Redis connection checked out of the pool, returned to it when the handle goes out of scope.
+ *
+ * A handle may be empty when no connection could be checked out in time, which is tested with
+ * operator bool. A connection whose context reports an error is closed instead of being returned.
+ */
+class PooledConnection {
+public:
+    PooledConnection() = default;
+    PooledConnection(RedisPool* pool, redisContext* connection) : pool_(pool), connection_(connection) {}
+    ~PooledConnection();
+
+    PooledConnection(const PooledConnection&) = delete;
+    PooledConnection& operator=(const PooledConnection&) = delete;
+    PooledConnection(PooledConnection&& other) noexcept;
+    PooledConnection& operator=(PooledConnection&& other) noexcept;
+
+    redisContext* get() const {
+        return connection_;
+    }
+
+    explicit operator bool() const {
+        return connection_ != nullptr;
+    }
+
+private:
+    void release();
+
+    RedisPool* pool_ = nullptr;
+    redisContext* connection_ = nullptr;
+};
+
+/**
+ * @brief Bounded pool of Redis connections shared by all the threads of a service.
+ *
+ * Connections are opened lazily up to the pool size and reused afterwards. A connection that has been
+ * idle for a while is validated with a PING when it is checked out, and a broken connection is replaced
+ * by a new one. A checkout waits at most checkout_timeout for a connection to be returned.
+ */
 class RedisPool {
 public:
+    struct Options {
+        std::size_t size = 16;
+        std::chrono::milliseconds checkout_timeout{2000};
+        // Idle connections older than this are pinged before being handed out
+        std::chrono::milliseconds validate_after{1000};
+    };
+
     static RedisPool& getInstance();
 
     RedisPool(const RedisPool&) = delete;
     RedisPool& operator=(const RedisPool&) = delete;
 
-    redisContext* getConnection();
-    void releaseConnection(redisContext* connection);
+    /**
+     * @brief Checks a connection out of the pool.
+     *
+     * @return The connection, or an empty handle if none could be opened or returned in time.
+     */
+    PooledConnection acquire();
 
 private:
-    RedisPool(const std::string& host, int port, int poolSize);
+    friend class PooledConnection;
+
+    struct IdleConnection {
+        redisContext* connection;
+        std::chrono::steady_clock::time_point since;
+    };
+
+    RedisPool(const std::string& host, int port, Options options);
     ~RedisPool();
 
-    void initializePool();
+    redisContext* connect();
+    bool validate(redisContext* connection);
+    void releaseConnection(redisContext* connection);
     void releasePool();
 
     std::string host_;
     int port_;
-    int poolSize_;
-    std::vector<redisContext*> pool_;
+    Options options_;
+    // Connections currently open, idle or checked out
+    std::size_t open_ = 0;
+    std::vector<IdleConnection> idle_;
     std::mutex mutex_;
     std::condition_variable cv_;
 };
 
-} // namespace redis
\ No newline at end of file
+} // namespace redis
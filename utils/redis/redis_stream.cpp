@@ -0,0 +1,346 @@
+#include "redis_stream.h"
+
+#include <iostream>
+
+namespace redis_utils {
+
+namespace {
+
+/**
+ * Executes a Redis command given as a list of arguments.
+ * Arguments are passed binary-safe, so they may contain spaces (e.g. JSON payloads).
+ *
+ * @param redis_conn A pointer to the Redis connection.
+ * @param args The command and its arguments.
+ * @return The reply, or nullptr if the command could not be executed.
+ */
+redisReply* RedisCommandArgv(redisContext *redis_conn, const std::vector<std::string>& args) {
+    std::vector<const char*> argv;
+    std::vector<std::size_t> argvlen;
+    argv.reserve(args.size());
+    argvlen.reserve(args.size());
+    for (const auto& arg : args) {
+        argv.push_back(arg.data());
+        argvlen.push_back(arg.size());
+    }
+    return static_cast<redisReply*>(redisCommandArgv(redis_conn, static_cast<int>(args.size()),
+                                                     argv.data(), argvlen.data()));
+}
+
+std::string ReplyString(const redisReply *reply) {
+    if (reply == nullptr || (reply->type != REDIS_REPLY_STRING && reply->type != REDIS_REPLY_STATUS)) {
+        return "";
+    }
+    return std::string(reply->str, reply->len);
+}
+
+/**
+ * Parses a [id, [field, value, ...]] stream entry.
+ * Entries deleted from the stream while pending come back with a nil field list and are skipped.
+ */
+std::optional<StreamEntry> ParseEntry(const redisReply *reply) {
+    if (reply == nullptr || reply->type != REDIS_REPLY_ARRAY || reply->elements < 2) {
+        return std::nullopt;
+    }
+    StreamEntry entry;
+    entry.id = ReplyString(reply->element[0]);
+    const redisReply *fields = reply->element[1];
+    if (fields == nullptr || fields->type != REDIS_REPLY_ARRAY) {
+        return std::nullopt;
+    }
+    for (std::size_t i = 0; i + 1 < fields->elements; i += 2) {
+        entry.fields[ReplyString(fields->element[i])] = ReplyString(fields->element[i + 1]);
+    }
+    return entry;
+}
+
+void ParseEntries(const redisReply *reply, std::vector<StreamEntry>& entries) {
+    if (reply == nullptr || reply->type != REDIS_REPLY_ARRAY) {
+        return;
+    }
+    for (std::size_t i = 0; i < reply->elements; ++i) {
+        auto entry = ParseEntry(reply->element[i]);
+        if (entry.has_value()) {
+            entries.push_back(std::move(entry.value()));
+        }
+    }
+}
+
+} // namespace
+
+/**
+ * Appends an entry to a stream (XADD).
+ *
+ * @param redis_conn A pointer to the Redis connection.
+ * @param stream The name of the stream.
+ * @param fields The field/value pairs of the entry.
+ * @return The ID of the new entry, or std::nullopt if an error occurred.
+ */
+std::optional<std::string> RedisStreamAdd(redisContext *redis_conn, const std::string& stream,
+                                          const std::vector<std::pair<std::string, std::string>>& fields) {
+    if (redis_conn == nullptr) {
+        std::cerr << "Redis connection is null" << std::endl;
+        return std::nullopt;
+    }
+
+    std::vector<std::string> args = {"XADD", stream, "*"};
+    for (const auto& [field, value] : fields) {
+        args.push_back(field);
+        args.push_back(value);
+    }
+
+    redisReply *reply = RedisCommandArgv(redis_conn, args);
+    if (reply == nullptr || reply->type == REDIS_REPLY_ERROR) {
+        std::cerr << "Failed to add entry to stream " << stream << ": "
+                  << (reply ? reply->str : redis_conn->errstr) << std::endl;
+        if (reply) {
+            freeReplyObject(reply);
+        }
+        return std::nullopt;
+    }
+
+    std::string id = ReplyString(reply);
+    freeReplyObject(reply);
+    return id;
+}
+
+/**
+ * Creates a consumer group for a stream, creating the stream too if it does not exist.
+ * An already existing group is not an error.
+ *
+ * @param redis_conn A pointer to the Redis connection.
+ * @param stream The name of the stream.
+ * @param group The name of the consumer group.
+ * @return True if the group exists after the call, false otherwise.
+ */
+bool RedisStreamCreateGroup(redisContext *redis_conn, const std::string& stream, const std::string& group) {
+    if (redis_conn == nullptr) {
+        std::cerr << "Redis connection is null" << std::endl;
+        return false;
+    }
+
+    // Start from the beginning so entries added before the first consumer started are not lost
+    redisReply *reply = RedisCommandArgv(redis_conn, {"XGROUP", "CREATE", stream, group, "0", "MKSTREAM"});
+    if (reply == nullptr) {
+        std::cerr << "Failed to create consumer group: " << redis_conn->errstr << std::endl;
+        return false;
+    }
+
+    bool success = true;
+    if (reply->type == REDIS_REPLY_ERROR && std::string(reply->str).rfind("BUSYGROUP", 0) != 0) {
+        std::cerr << "Failed to create consumer group " << group << ": " << reply->str << std::endl;
+        success = false;
+    }
+    freeReplyObject(reply);
+    return success;
+}
+
+/**
+ * Reads new entries for a consumer of a group (XREADGROUP ... STREAMS stream >).
+ *
+ * @param redis_conn A pointer to the Redis connection.
+ * @param stream The name of the stream.
+ * @param group The name of the consumer group.
+ * @param consumer The name of the consumer.
+ * @param count The maximum number of entries to read.
+ * @param block_ms How long to wait for new entries.
+ * @return The entries read (possibly none), or std::nullopt if the command failed.
+ */
+std::optional<std::vector<StreamEntry>> RedisStreamReadGroup(redisContext *redis_conn, const std::string& stream,
+                                                             const std::string& group, const std::string& consumer,
+                                                             const std::size_t count, const std::size_t block_ms) {
+    if (redis_conn == nullptr) {
+        std::cerr << "Redis connection is null" << std::endl;
+        return std::nullopt;
+    }
+
+    redisReply *reply = RedisCommandArgv(redis_conn, {"XREADGROUP", "GROUP", group, consumer,
+                                                      "COUNT", std::to_string(count),
+                                                      "BLOCK", std::to_string(block_ms),
+                                                      "STREAMS", stream, ">"});
+    if (reply == nullptr || reply->type == REDIS_REPLY_ERROR) {
+        std::cerr << "Failed to read from stream " << stream << ": "
+                  << (reply ? reply->str : redis_conn->errstr) << std::endl;
+        if (reply) {
+            freeReplyObject(reply);
+        }
+        return std::nullopt;
+    }
+
+    std::vector<StreamEntry> entries;
+    // Reply: [[stream, [entry, ...]]], or nil on timeout
+    if (reply->type == REDIS_REPLY_ARRAY) {
+        for (std::size_t i = 0; i < reply->elements; ++i) {
+            const redisReply *stream_reply = reply->element[i];
+            if (stream_reply->type == REDIS_REPLY_ARRAY && stream_reply->elements == 2) {
+                ParseEntries(stream_reply->element[1], entries);
+            }
+        }
+    }
+
+    freeReplyObject(reply);
+    return entries;
+}
+
+/**
+ * Takes over entries that were delivered to some consumer but not acknowledged for a while,
+ * e.g. because that consumer crashed (XAUTOCLAIM, Redis >= 6.2).
+ *
+ * @param redis_conn A pointer to the Redis connection.
+ * @param stream The name of the stream.
+ * @param group The name of the consumer group.
+ * @param consumer The name of the consumer taking the entries over.
+ * @param min_idle_ms The minimal time since the last delivery of an entry.
+ * @param count The maximum number of entries to claim.
+ * @return The claimed entries, or std::nullopt if the command failed.
+ */
+std::optional<std::vector<StreamEntry>> RedisStreamClaimIdle(redisContext *redis_conn, const std::string& stream,
+                                                             const std::string& group, const std::string& consumer,
+                                                             const std::size_t min_idle_ms, const std::size_t count) {
+    if (redis_conn == nullptr) {
+        std::cerr << "Redis connection is null" << std::endl;
+        return std::nullopt;
+    }
+
+    redisReply *reply = RedisCommandArgv(redis_conn, {"XAUTOCLAIM", stream, group, consumer,
+                                                      std::to_string(min_idle_ms), "0-0",
+                                                      "COUNT", std::to_string(count)});
+    if (reply == nullptr || reply->type == REDIS_REPLY_ERROR) {
+        std::cerr << "Failed to claim idle entries of stream " << stream << ": "
+                  << (reply ? reply->str : redis_conn->errstr) << std::endl;
+        if (reply) {
+            freeReplyObject(reply);
+        }
+        return std::nullopt;
+    }
+
+    std::vector<StreamEntry> entries;
+    // Reply: [next-start-id, [entry, ...], (deleted ids)]
+    if (reply->type == REDIS_REPLY_ARRAY && reply->elements >= 2) {
+        ParseEntries(reply->element[1], entries);
+    }
+
+    freeReplyObject(reply);
+    return entries;
+}
+
+/**
+ * Returns how many times a pending entry has been delivered (XPENDING).
+ *
+ * @param redis_conn A pointer to the Redis connection.
+ * @param stream The name of the stream.
+ * @param group The name of the consumer group.
+ * @param id The ID of the entry.
+ * @return The number of deliveries, or std::nullopt if the entry is not pending or an error occurred.
+ */
+std::optional<std::size_t> RedisStreamDeliveryCount(redisContext *redis_conn, const std::string& stream,
+                                                    const std::string& group, const std::string& id) {
+    if (redis_conn == nullptr) {
+        std::cerr << "Redis connection is null" << std::endl;
+        return std::nullopt;
+    }
+
+    redisReply *reply = RedisCommandArgv(redis_conn, {"XPENDING", stream, group, id, id, "1"});
+    if (reply == nullptr) {
+        std::cerr << "Failed to get pending entry: " << redis_conn->errstr << std::endl;
+        return std::nullopt;
+    }
+
+    std::optional<std::size_t> deliveries;
+    // Reply: [[id, consumer, idle-ms, deliveries]]
+    if (reply->type == REDIS_REPLY_ARRAY && reply->elements == 1) {
+        const redisReply *pending = reply->element[0];
+        if (pending->type == REDIS_REPLY_ARRAY && pending->elements == 4 &&
+            pending->element[3]->type == REDIS_REPLY_INTEGER) {
+            deliveries = static_cast<std::size_t>(pending->element[3]->integer);
+        }
+    }
+
+    freeReplyObject(reply);
+    return deliveries;
+}
+
+/**
+ * Acknowledges an entry, removing it from the pending entries list of the group (XACK).
+ *
+ * @param redis_conn A pointer to the Redis connection.
+ * @param stream The name of the stream.
+ * @param group The name of the consumer group.
+ * @param id The ID of the entry.
+ * @return True if the command succeeded, false otherwise.
+ */
+bool RedisStreamAck(redisContext *redis_conn, const std::string& stream, const std::string& group,
+                    const std::string& id) {
+    if (redis_conn == nullptr) {
+        std::cerr << "Redis connection is null" << std::endl;
+        return false;
+    }
+
+    redisReply *reply = RedisCommandArgv(redis_conn, {"XACK", stream, group, id});
+    if (reply == nullptr || reply->type == REDIS_REPLY_ERROR) {
+        std::cerr << "Failed to acknowledge entry " << id << ": "
+                  << (reply ? reply->str : redis_conn->errstr) << std::endl;
+        if (reply) {
+            freeReplyObject(reply);
+        }
+        return false;
+    }
+
+    freeReplyObject(reply);
+    return true;
+}
+
+namespace {
+
+// Resets the idle time of an entry only if the consumer still owns it, in one atomic step: XCLAIM with
+// a min-idle-time of 0 would otherwise take back an entry another consumer has claimed in the meantime.
+// KEYS[1] is the stream, ARGV[1] the group, ARGV[2] the consumer and ARGV[3] the ID of the entry.
+// Returns 1 if the claim has been renewed, 0 if the entry is no longer pending for the consumer.
+constexpr const char* kRenewClaimScript = R"lua(
+local pending = redis.call('XPENDING', KEYS[1], ARGV[1], ARGV[3], ARGV[3], 1)
+if #pending == 0 or pending[1][2] ~= ARGV[2] then
+    return 0
+end
+redis.call('XCLAIM', KEYS[1], ARGV[1], ARGV[2], 0, ARGV[3], 'JUSTID')
+return 1
+)lua";
+
+} // namespace
+
+/**
+ * Renews the claim of a consumer on an entry it is still handling, resetting its idle time so that
+ * other consumers do not claim it (XCLAIM ... JUSTID, which leaves the delivery count as it is).
+ * The claim is only renewed while the entry is pending for the consumer.
+ *
+ * @param redis_conn A pointer to the Redis connection.
+ * @param stream The name of the stream.
+ * @param group The name of the consumer group.
+ * @param consumer The name of the consumer handling the entry.
+ * @param id The ID of the entry.
+ * @return True if the claim has been renewed, false if another consumer has claimed the entry or it has been
+ *         acknowledged, std::nullopt if an error occurred.
+ */
+std::optional<bool> RedisStreamRenewClaim(redisContext *redis_conn, const std::string& stream,
+                                          const std::string& group, const std::string& consumer,
+                                          const std::string& id) {
+    if (redis_conn == nullptr) {
+        std::cerr << "Redis connection is null" << std::endl;
+        return std::nullopt;
+    }
+
+    redisReply *reply = RedisCommandArgv(redis_conn, {"EVAL", kRenewClaimScript, "1", stream, group, consumer, id});
+    if (reply == nullptr || reply->type == REDIS_REPLY_ERROR) {
+        std::cerr << "Failed to renew the claim on entry " << id << ": "
+                  << (reply ? reply->str : redis_conn->errstr) << std::endl;
+        if (reply) {
+            freeReplyObject(reply);
+        }
+        return std::nullopt;
+    }
+
+    const bool renewed = reply->type == REDIS_REPLY_INTEGER && reply->integer == 1;
+    freeReplyObject(reply);
+    return renewed;
+}
+
+} // namespace redis_utils
@@ -0,0 +1,52 @@
+#pragma once
+
+#include <optional>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include <hiredis.h>
+
+namespace redis_utils {
+
+// Work queues of the pipeline stages and the stream the stages report their outcome to
+constexpr const char* kPreProcessingStream = "jobs:video-pre-processing";
+constexpr const char* kFrameAnalyticsStream = "jobs:frame-analytics";
+constexpr const char* kPostProcessingStream = "jobs:video-post-processing";
+constexpr const char* kPipelineEventsStream = "jobs:events";
+
+struct StreamEntry {
+    std::string id;
+    std::unordered_map<std::string, std::string> fields;
+
+    std::string Get(const std::string& field) const {
+        const auto it = fields.find(field);
+        return it == fields.end() ? std::string() : it->second;
+    }
+};
+
+std::optional<std::string> RedisStreamAdd(redisContext *redis_conn, const std::string& stream,
+                                          const std::vector<std::pair<std::string, std::string>>& fields);
+
+bool RedisStreamCreateGroup(redisContext *redis_conn, const std::string& stream, const std::string& group);
+
+std::optional<std::vector<StreamEntry>> RedisStreamReadGroup(redisContext *redis_conn, const std::string& stream,
+                                                             const std::string& group, const std::string& consumer,
+                                                             std::size_t count, std::size_t block_ms);
+
+std::optional<std::vector<StreamEntry>> RedisStreamClaimIdle(redisContext *redis_conn, const std::string& stream,
+                                                             const std::string& group, const std::string& consumer,
+                                                             std::size_t min_idle_ms, std::size_t count);
+
+std::optional<std::size_t> RedisStreamDeliveryCount(redisContext *redis_conn, const std::string& stream,
+                                                    const std::string& group, const std::string& id);
+
+bool RedisStreamAck(redisContext *redis_conn, const std::string& stream, const std::string& group,
+                    const std::string& id);
+
+std::optional<bool> RedisStreamRenewClaim(redisContext *redis_conn, const std::string& stream,
+                                          const std::string& group, const std::string& consumer,
+                                          const std::string& id);
+
+} // namespace redis_utils
@@ -0,0 +1,129 @@
+#include "stage_jobs.h"
+
+#include <iostream>
+
+#include "redis.h"
+#include "redis_pool.h"
+#include "redis_stream.h"
+#include "../cfg/global_config.h"
+
+namespace redis_utils {
+
+/**
+ * Adds a job to the work queue of a pipeline stage.
+ *
+ * @param redis_conn A pointer to the Redis connection.
+ * @param stream The stream of the stage.
+ * @param payload The JSON body of the job.
+ * @return The ID of the stream entry, or std::nullopt if an error occurred.
+ */
+std::optional<std::string> RedisEnqueueStageJob(redisContext *redis_conn, const std::string& stream,
+                                                const std::string& payload) {
+    return RedisStreamAdd(redis_conn, stream, {{"payload", payload}});
+}
+
+/**
+ * Enqueues a job on behalf of a stage's HTTP endpoint.
+ *
+ * @param stream The stream of the stage.
+ * @param payload The JSON body of the job.
+ * @return 202 with the stream entry ID if the job was queued, 500 otherwise.
+ */
+crow::response EnqueueStageJob(const std::string& stream, const std::string& payload) {
+    auto redis_conn = redis::RedisPool::getInstance().acquire();
+    if (!redis_conn) {
+        return crow::response(500, "Redis connection error");
+    }
+
+    const auto entry_id = RedisEnqueueStageJob(redis_conn.get(), stream, payload);
+    if (!entry_id.has_value()) {
+        return crow::response(500, "Failed to enqueue job");
+    }
+    return crow::response(202, entry_id.value());
+}
+
+/**
+ * Reports the outcome of a stage job to the orchestrator through the events stream.
+ *
+ * @param redis_conn A pointer to the Redis connection.
+ * @param stage The name of the stage.
+ * @param id The ID of the video.
+ * @param result The result of the stage, as it would have been returned over HTTP.
+ * @return True if the event was added to the stream, false otherwise.
+ */
+bool RedisReportStageResult(redisContext *redis_conn, const std::string& stage, const std::string& id,
+                            const crow::response& result) {
+    return RedisStreamAdd(redis_conn, kPipelineEventsStream, {
+        {"id", id},
+        {"stage", stage},
+        {"code", std::to_string(result.code)},
+        // Successful results are stored by the stages themselves, only errors are reported
+        {"message", result.code == 200 ? std::string() : result.body},
+    }).has_value();
+}
+
+namespace {
+
+/**
+ * Runs a job and reports its result on a pooled connection checked out once the job is done,
+ * since the job may run for a long time. The result is not reported if another consumer has claimed
+ * the job meanwhile, that consumer reports its own.
+ *
+ * @return True if the result was reported and the entry can be acknowledged.
+ */
+bool RunAndReport(const std::string& stage, const StageJob& job, const StreamEntry& entry,
+                  const redis::StreamWorker::Lease& lease, const bool dead_letter) {
+    const std::string payload = entry.Get("payload");
+    const auto body = crow::json::load(payload);
+    if (!body || !body.has("redis_id")) {
+        std::cerr << "Dropping malformed " << stage << " job " << entry.id << ": " << payload << std::endl;
+        return true;
+    }
+    const std::string id = body["redis_id"].s();
+
+    const crow::response result = dead_letter
+        ? crow::response(500, "Job was redelivered too many times")
+        : job(body);
+    if (!lease.IsOwned()) {
+        return false;
+    }
+
+    auto redis_conn = redis::RedisPool::getInstance().acquire();
+    if (!redis_conn) {
+        return false;
+    }
+    return RedisReportStageResult(redis_conn.get(), stage, id, result);
+}
+
+} // namespace
+
+/**
+ * Starts consuming the work queue of a pipeline stage.
+ *
+ * @param stream The stream of the stage.
+ * @param stage The name of the stage, also used as the consumer group.
+ * @param job The function running the stage.
+ * @return The running worker; it stops when destroyed.
+ */
+std::unique_ptr<redis::StreamWorker> StartStageWorker(const std::string& stream, const std::string& stage,
+                                                      StageJob job) {
+    const auto& queue = cfg::GlobalConfig::getInstance().getQueue();
+    redis::StreamWorker::Options options;
+    options.consumers = queue.consumers;
+    options.block_ms = queue.block_ms;
+    options.claim_idle_ms = queue.claim_idle_ms;
+    options.max_deliveries = queue.max_deliveries;
+
+    auto worker = std::make_unique<redis::StreamWorker>(stream, stage,
+        [stage, job](const StreamEntry& entry, const redis::StreamWorker::Lease& lease) {
+            return RunAndReport(stage, job, entry, lease, false);
+        },
+        [stage, job](const StreamEntry& entry, const redis::StreamWorker::Lease& lease) {
+            return RunAndReport(stage, job, entry, lease, true);
+        },
+        options);
+    worker->Start();
+    return worker;
+}
+
+} // namespace redis_utils
@@ -0,0 +1,29 @@
+#pragma once
+
+#include <functional>
+#include <memory>
+#include <optional>
+#include <string>
+
+#include <hiredis.h>
+#include <crow.h>
+
+#include "stream_worker.h"
+
+namespace redis_utils {
+
+// Runs a pipeline stage for the given job body, as received by the stage's HTTP endpoint
+using StageJob = std::function<crow::response(const crow::json::rvalue&)>;
+
+std::optional<std::string> RedisEnqueueStageJob(redisContext *redis_conn, const std::string& stream,
+                                                const std::string& payload);
+
+crow::response EnqueueStageJob(const std::string& stream, const std::string& payload);
+
+bool RedisReportStageResult(redisContext *redis_conn, const std::string& stage, const std::string& id,
+                            const crow::response& result);
+
+std::unique_ptr<redis::StreamWorker> StartStageWorker(const std::string& stream, const std::string& stage,
+                                                      StageJob job);
+
+} // namespace redis_utils
@@ -0,0 +1,197 @@
+#include "stream_worker.h"
+
+#include <chrono>
+#include <condition_variable>
+#include <iostream>
+#include <mutex>
+#include <optional>
+
+#include "redis.h"
+#include "redis_pool.h"
+#include "../cfg/global_config.h"
+
+namespace redis {
+
+StreamWorker::StreamWorker(std::string stream, std::string group, Handler handler, Handler dead_letter_handler,
+                           Options options)
+    : stream_(std::move(stream)), group_(std::move(group)), handler_(std::move(handler)),
+      dead_letter_handler_(std::move(dead_letter_handler)), options_(options) {}
+
+StreamWorker::~StreamWorker() {
+    Stop();
+}
+
+void StreamWorker::Start() {
+    if (running_.exchange(true)) {
+        return;
+    }
+    // Consumer names only have to be unique, pending entries of old names are claimed by the others
+    const std::string prefix = group_ + "-" + redis_utils::GenerateUUID().substr(0, 8);
+    for (std::size_t i = 0; i < options_.consumers; ++i) {
+        threads_.emplace_back(&StreamWorker::Run, this, prefix + "-" + std::to_string(i));
+    }
+    std::cout << "Consuming " << stream_ << " as group " << group_ << " with "
+              << options_.consumers << " consumer(s)" << std::endl;
+}
+
+/**
+ * Stops the consumers. Blocking reads return within block_ms, so this waits at most that long
+ * plus the time needed to finish the entries being handled.
+ */
+void StreamWorker::Stop() {
+    if (!running_.exchange(false)) {
+        return;
+    }
+    for (auto& thread : threads_) {
+        thread.join();
+    }
+    threads_.clear();
+}
+
+void StreamWorker::Run(const std::string& consumer) {
+    const auto& redis_config = cfg::GlobalConfig::getInstance().getRedis();
+    const auto claim_interval = std::chrono::milliseconds(options_.claim_idle_ms / 2 + 1);
+    auto next_claim = std::chrono::steady_clock::now();
+
+    // Every consumer owns its connection instead of taking one from the pool, since it blocks on reads
+    redisContext *redis_conn = nullptr;
+    while (running_) {
+        if (redis_conn == nullptr) {
+            redis_conn = redis_utils::RedisConnect(redis_config.host, redis_config.port);
+            if (redis_conn == nullptr || !redis_utils::RedisStreamCreateGroup(redis_conn, stream_, group_)) {
+                if (redis_conn != nullptr) {
+                    redisFree(redis_conn);
+                    redis_conn = nullptr;
+                }
+                std::this_thread::sleep_for(std::chrono::seconds(1));
+                continue;
+            }
+        }
+
+        bool failed = false;
+
+        // Take over the entries of consumers that died or got stuck
+        if (std::chrono::steady_clock::now() >= next_claim) {
+            next_claim = std::chrono::steady_clock::now() + claim_interval;
+            const auto claimed = redis_utils::RedisStreamClaimIdle(redis_conn, stream_, group_, consumer,
+                                                                   options_.claim_idle_ms, 1);
+            if (!claimed.has_value()) {
+                failed = true;
+            } else {
+                for (const auto& entry : claimed.value()) {
+                    failed |= !Process(redis_conn, consumer, entry, true);
+                }
+            }
+        }
+
+        if (!failed) {
+            const auto entries = redis_utils::RedisStreamReadGroup(redis_conn, stream_, group_, consumer,
+                                                                   1, options_.block_ms);
+            if (!entries.has_value()) {
+                failed = true;
+            } else {
+                for (const auto& entry : entries.value()) {
+                    failed |= !Process(redis_conn, consumer, entry, false);
+                }
+            }
+        }
+
+        // Reconnect if the connection is broken
+        if (failed && redis_conn->err) {
+            redisFree(redis_conn);
+            redis_conn = nullptr;
+        }
+    }
+
+    if (redis_conn != nullptr) {
+        redisFree(redis_conn);
+    }
+}
+
+/**
+ * Handles one entry and acknowledges it on success.
+ *
+ * @return False if talking to Redis failed, true otherwise.
+ */
+bool StreamWorker::Process(redisContext *redis_conn, const std::string& consumer, const redis_utils::StreamEntry& entry,
+                           const bool redelivered) {
+    if (redelivered) {
+        const auto deliveries = redis_utils::RedisStreamDeliveryCount(redis_conn, stream_, group_, entry.id);
+        if (deliveries.has_value() && deliveries.value() > options_.max_deliveries) {
+            std::cerr << "Entry " << entry.id << " of " << stream_ << " was delivered "
+                      << deliveries.value() << " times, dropping it" << std::endl;
+            const Lease lease;
+            if (!dead_letter_handler_ || dead_letter_handler_(entry, lease)) {
+                return redis_utils::RedisStreamAck(redis_conn, stream_, group_, entry.id);
+            }
+            return true;
+        }
+    }
+
+    Lease lease;
+    const bool handled = Handle(consumer, entry, lease);
+    if (!lease.IsOwned()) {
+        std::cerr << "Entry " << entry.id << " of " << stream_ << " has been claimed by another consumer, "
+                  << "leaving it to its new owner" << std::endl;
+        return true;
+    }
+
+    // Unacknowledged entries are redelivered after claim_idle_ms
+    if (handled) {
+        return redis_utils::RedisStreamAck(redis_conn, stream_, group_, entry.id);
+    }
+    return true;
+}
+
+/**
+ * Runs the handler on an entry while a heartbeat renews the claim of the consumer on it, since the entry
+ * would otherwise be claimed by another consumer and handled twice once it has been idle for claim_idle_ms.
+ * The heartbeat uses a pooled connection, the consumer's own is not used while the handler runs.
+ * If the entry has been claimed by another consumer, the lease is marked as lost and no longer renewed.
+ *
+ * @return True if the handler succeeded.
+ */
+bool StreamWorker::Handle(const std::string& consumer, const redis_utils::StreamEntry& entry, Lease& lease) {
+    std::mutex mutex;
+    std::condition_variable cv;
+    bool finished = false;
+
+    const auto renew_interval = std::chrono::milliseconds(options_.claim_idle_ms / 3 + 1);
+    std::thread heartbeat([&] {
+        std::unique_lock<std::mutex> lock(mutex);
+        while (!cv.wait_for(lock, renew_interval, [&finished] { return finished; })) {
+            lock.unlock();
+            std::optional<bool> renewed;
+            {
+                auto redis_conn = RedisPool::getInstance().acquire();
+                renewed = redis_utils::RedisStreamRenewClaim(redis_conn.get(), stream_, group_, consumer, entry.id);
+            }
+            lock.lock();
+            if (!renewed.has_value()) {
+                // Retried with the next renewal, the entry is only claimed once it has been idle for claim_idle_ms
+                std::cerr << "Could not renew the claim on entry " << entry.id << " of " << stream_ << std::endl;
+            } else if (!renewed.value()) {
+                lease.owned_ = false;
+                return;
+            }
+        }
+    });
+
+    bool handled = false;
+    try {
+        handled = handler_(entry, lease);
+    } catch (const std::exception& e) {
+        std::cerr << "Exception while handling entry " << entry.id << " of " << stream_ << ": "
+                  << e.what() << std::endl;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        finished = true;
+    }
+    cv.notify_one();
+    heartbeat.join();
+    return handled;
+}
+
+} // namespace redis
@@ -0,0 +1,79 @@
+#pragma once
+
+#include <atomic>
+#include <functional>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "redis_stream.h"
+
+namespace redis {
+
+/**
+ * @brief Consumes a Redis Stream as a member of a consumer group.
+ *
+ * Each consumer thread owns a dedicated connection (XREADGROUP blocks it) and reads one entry at a time,
+ * so a busy process does not take work it cannot start yet and other consumers of the group pick it up.
+ * An entry is acknowledged only after the handler returns true. Entries left unacknowledged for longer
+ * than the claim timeout, e.g. by a consumer that crashed, are claimed and redelivered; the claim on an entry
+ * being handled is renewed every third of the claim timeout, so long jobs are not redelivered. An entry that has
+ * been delivered more than the allowed number of times is passed to the dead letter handler and dropped.
+ * A consumer whose entry has been claimed by another one, e.g. after it missed renewals, leaves the entry
+ * to its new owner and does not acknowledge it.
+ */
+class StreamWorker {
+public:
+    /**
+     * @brief Tells a handler whether its consumer still owns the entry being handled.
+     * Once another consumer has claimed the entry, the handler must not publish its outcome,
+     * the new owner does.
+     */
+    class Lease {
+    public:
+        bool IsOwned() const {
+            return owned_.load();
+        }
+
+    private:
+        friend class StreamWorker;
+        std::atomic<bool> owned_{true};
+    };
+
+    // Returns true if the entry has been handled and can be acknowledged
+    using Handler = std::function<bool(const redis_utils::StreamEntry&, const Lease&)>;
+
+    struct Options {
+        std::size_t consumers = 1;
+        std::size_t block_ms = 2000;
+        std::size_t claim_idle_ms = 60000;
+        std::size_t max_deliveries = 3;
+    };
+
+    StreamWorker(std::string stream, std::string group, Handler handler, Handler dead_letter_handler,
+                 Options options);
+    ~StreamWorker();
+
+    StreamWorker(const StreamWorker&) = delete;
+    StreamWorker& operator=(const StreamWorker&) = delete;
+
+    void Start();
+    void Stop();
+
+private:
+    void Run(const std::string& consumer);
+    bool Process(redisContext *redis_conn, const std::string& consumer, const redis_utils::StreamEntry& entry,
+                 bool redelivered);
+    bool Handle(const std::string& consumer, const redis_utils::StreamEntry& entry, Lease& lease);
+
+    std::string stream_;
+    std::string group_;
+    Handler handler_;
+    Handler dead_letter_handler_;
+    Options options_;
+
+    std::atomic<bool> running_{false};
+    std::vector<std::thread> threads_;
+};
+
+} // namespace redis